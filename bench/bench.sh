@@ -0,0 +1,193 @@
+#!/bin/sh
+#
+# End-to-end benchmark of mvme2root: converts synthetic listfiles through
+# the full command line in each major configuration and records wall time,
+# throughput and peak memory.
+#
+#   bench/bench.sh [-s MB] [-r N] [-d DIR] [-o RESULTS] [-b BASELINE] [-t PCT] [-c]
+#   bench/bench.sh --compare BASELINE RESULTS [PCT]
+#
+#   -s MB        size of the generated listfile (default 2048)
+#   -r N         runs per configuration, the fastest is kept (default 1)
+#   -d DIR       where the inputs are generated and converted (default
+#                bench/data); inputs are reused if they have the size
+#   -o RESULTS   results file (default bench/results.tsv)
+#   -b BASELINE  compare the results against this file afterwards
+#   -t PCT       tolerance of the comparison in percent (default 10)
+#   -c           cold start: drop the page cache before every conversion
+#                (needs root), so unzipping and reading come from disk
+#
+# Besides the run of -s MB in each configuration, a run of 4 MB is
+# converted from .zip (smallzip), the case where startup counts.
+#
+# "make bench" builds mvme2root and bench/genlist and runs this script,
+# BENCHFLAGS are passed on. The results are tab separated, one line per
+# configuration: config, input MB, events, wall s, MB/s, events/s, peak
+# RSS MB. Peak RSS is what mvme2root reports from getrusage at the end.
+#
+# --compare flags a configuration whose events/s dropped, or whose peak
+# RSS grew, by more than PCT percent, and exits with 1 if there is one.
+# Keep a results file of a known good build as the baseline; results of
+# different input sizes or machines do not compare.
+
+cd "$(dirname "$0")/.." || exit 1
+
+compare()
+{
+    awk -F '\t' -v tol="${3:-10}" '
+        /^#/ || $1=="config" { next }
+        FNR==NR { evs[$1]=$6; rss[$1]=$7; next }
+        {
+            if (!($1 in evs)) { printf "%-12s not in baseline\n", $1; next }
+            dev = (evs[$1]>0) ? 100*($6-evs[$1])/evs[$1] : 0
+            drss = (rss[$1]>0) ? 100*($7-rss[$1])/rss[$1] : 0
+            flag = ""
+            if (dev < -tol) flag = flag " SLOWER"
+            if (drss > tol) flag = flag " MORE MEMORY"
+            if (flag != "") bad++
+            printf "%-12s %10.0f -> %10.0f events/s (%+6.1f%%)  %6d -> %6d MB (%+6.1f%%)%s\n",
+                   $1, evs[$1], $6, dev, rss[$1], $7, drss, flag
+        }
+        END {
+            if (bad) { printf "%d regressions over %s%%\n", bad, tol; exit 1 }
+            printf "no regressions over %s%%\n", tol
+        }' "$1" "$2"
+}
+
+if [ "$1" = "--compare" ]; then
+    if [ $# -lt 3 ]; then
+        echo "Usage: $0 --compare BASELINE RESULTS [PCT]" >&2
+        exit 1
+    fi
+    compare "$2" "$3" "$4"
+    exit $?
+fi
+
+size=2048
+repeat=1
+dir=bench/data
+results=bench/results.tsv
+baseline=
+tol=10
+cold=
+while getopts s:r:d:o:b:t:c opt; do
+    case $opt in
+        s) size=$OPTARG ;;
+        r) repeat=$OPTARG ;;
+        d) dir=$OPTARG ;;
+        o) results=$OPTARG ;;
+        b) baseline=$OPTARG ;;
+        t) tol=$OPTARG ;;
+        c) cold=1 ;;
+        *) exit 1 ;;
+    esac
+done
+
+if [ -n "$cold" ] && [ ! -w /proc/sys/vm/drop_caches ]; then
+    echo "-c needs to write /proc/sys/vm/drop_caches, run as root" >&2
+    exit 1
+fi
+
+for f in ./mvme2root bench/genlist; do
+    if [ ! -x $f ]; then
+        echo "$f is not built, run make bench" >&2
+        exit 1
+    fi
+done
+
+# inputs: the same run as .mvmelst and as .zip (deflated, with messages.log)
+mkdir -p "$dir" || exit 1
+bytes=$((size*1024*1024))
+list="$dir/bench.mvmelst"
+zip="$dir/benchzip.zip"
+if [ ! -f "$list" ] || [ $(stat -c %s "$list") -lt $((bytes-1024*1024)) ] ||
+   [ $(stat -c %s "$list") -gt $((bytes+1024*1024)) ]; then
+    rm -f "$list" "$zip"
+    bench/genlist "$list" "$size" || exit 1
+fi
+if [ ! -f "$zip" ]; then
+    bench/genlist "$zip" "$size" || exit 1
+fi
+inmb=$(($(stat -c %s "$list")/1024/1024))
+
+# a small run as .zip, where startup and unzipping are most of the time
+smallmb=4
+small="$dir/benchsmall.zip"
+if [ ! -f "$small" ]; then
+    bench/genlist "$small" "$smallmb" || exit 1
+fi
+
+# one conversion: wall time, events and peak RSS from the log
+run()
+{
+    name=$1
+    input=$2
+    shift 2
+    best=
+    for i in $(seq "$repeat"); do
+        rm -f "$dir"/bench*.root "$dir"/bench*.arrow "$dir"/bench*_parts.C
+        if [ -n "$cold" ]; then
+            sync
+            echo 3 > /proc/sys/vm/drop_caches
+        fi
+        start=$(date +%s%N)
+        ./mvme2root "$@" "$input" > "$dir/$name.log" 2>&1
+        status=$?
+        stop=$(date +%s%N)
+        if [ $status -ne 0 ]; then
+            echo "$name: mvme2root failed, see $dir/$name.log" >&2
+            return 1
+        fi
+        ns=$((stop-start))
+        if [ -z "$best" ] || [ $ns -lt $best ]; then
+            best=$ns
+        fi
+    done
+    events=$(awk '/ events total$/ { n=$1 } END { print n+0 }' "$dir/$name.log")
+    rss=$(awk '/^Peak memory use:/ { n=$4 } END { print n+0 }' "$dir/$name.log")
+    awk -v name="$name" -v mb="$inmb" -v ev="$events" -v ns="$best" -v rss="$rss" 'BEGIN {
+        s = ns/1e9
+        printf "%s\t%d\t%d\t%.2f\t%.1f\t%.0f\t%d\n", name, mb, ev, s, mb/s, ev/s, rss
+    }' | tee -a "$results.tmp"
+}
+
+rm -f "$results.tmp"
+printf "config\tinput_MB\tevents\twall_s\tMB_per_s\tevents_per_s\tpeak_rss_MB\n" | tee "$results.tmp"
+run default "$list"
+run zip "$zip"
+run split "$list" --split-events
+run roll "$list" --roll 1min
+run select "$list" --select "SCP.ADC[0]>1000 || QDC.ADC_long[0]>1000"
+run shm "$list" --shm mvme2root_bench --shm-only
+run arrow "$list" --arrow sparse --arrow-only
+run arrowdense "$list" --arrow dense --arrow-only
+run arrowtree "$list" --arrow sparse
+run budget "$list" --max-memory 256
+mb=$inmb
+inmb=$smallmb
+run smallzip "$small"
+inmb=$mb
+rm -f "$dir"/bench*.root "$dir"/bench*.arrow "$dir"/bench*_parts.C /dev/shm/mvme2root_bench
+
+{
+    echo "# $(date -u +%Y-%m-%dT%H:%M:%SZ) $(git rev-parse --short HEAD 2>/dev/null) $(uname -n) $(nproc) cores"
+    cat "$results.tmp"
+} > "$results"
+rm -f "$results.tmp"
+echo "Results in $results"
+
+# the Arrow output against the trees of the same run
+awk -F '\t' '
+    { evs[$1]=$6 }
+    END {
+        if (evs["default"]<=0) exit
+        n = split("arrow arrowdense arrowtree", c, " ")
+        for (i=1; i<=n; i++)
+            if (c[i] in evs)
+                printf "%-12s %5.2fx the events/s of the trees (default)\n", c[i], evs[c[i]]/evs["default"]
+    }' "$results"
+
+if [ -n "$baseline" ]; then
+    compare "$baseline" "$results" "$tol"
+    exit $?
+fi
@@ -0,0 +1,422 @@
+
+//Synthetic mvme listfiles for the conversion benchmark (bench/bench.sh).
+//
+//  genlist OUT.mvmelst|OUT.zip SIZE_MB [RATE_HZ] [SEED] [ANALYSIS]
+//
+//Writes a version 1 listfile of about SIZE_MB with one MDPP-16 SCP and one
+//MDPP-16 QDC in the main trigger (event 0) and a pulser (event 1) at 10 Hz
+//that fires all channels. Channel multiplicities fall off like in a
+//detector array (mostly 1-3 hits, sometimes all 16), with a few percent
+//pileup and overflow. Events are spaced at random for an average RATE_HZ
+//(default 20000) on the 16 MHz module clock; there are no extended time
+//stamp words, so the 30 bit time stamp rolls over every 67 s of run time
+//and the converter has to count the rollovers. A timetick section is
+//written for every second of run time.
+//
+//With .zip the listfile is deflated into OUT.zip as OUT.mvmelst (zip64,
+//like the archives of mvme) together with a messages.log holding the run
+//start and stop, so the unzip path is measured as well. The file ANALYSIS
+//is added to the zip as analysis.analysis if given.
+//
+//Needs only zlib: g++ -O2 -I include -o bench/genlist bench/genlist.cc -lz
+
+#include "listfile.hh"
+
+#include <zlib.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+using std::cout;
+using std::cerr;
+using std::endl;
+
+static const double ClockHz = 16e6;         //MDPP time stamp clock
+static const u32 TimeMask = 0x3fffffff;     //30 bit time stamp
+static const double PulserHz = 10;
+
+//output of the listfile words, plain or deflated into a zip entry
+class listout
+{
+  public:
+
+    listout(FILE *file_, bool deflated_) : crc(0), usize(0), csize(0), file(file_), deflated(deflated_)
+    {
+        if (deflated){
+            memset(&zs, 0, sizeof(zs));
+            //raw deflate as in zip, level 1 like a fast archiver
+            deflateInit2(&zs, Z_BEST_SPEED, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY);
+            out.resize(1<<22);
+        }
+    }
+
+    bool write(const void *data, size_t n, bool last = false)
+    {
+        crc = crc32(crc, (const Bytef *)data, n);
+        usize += n;
+        if (!deflated){
+            csize += n;
+            return fwrite(data, 1, n, file)==n;
+        }
+        zs.next_in = (Bytef *)data;
+        zs.avail_in = n;
+        int ret;
+        do{
+            zs.next_out = (Bytef *)out.data();
+            zs.avail_out = out.size();
+            ret = deflate(&zs, last ? Z_FINISH : Z_NO_FLUSH);
+            size_t have = out.size()-zs.avail_out;
+            if (fwrite(out.data(), 1, have, file)!=have)
+                return 0;
+            csize += have;
+        }while ((zs.avail_out==0)||(last && (ret!=Z_STREAM_END)));
+        if (last)
+            deflateEnd(&zs);
+        return 1;
+    }
+
+    uint32_t crc;
+    uint64_t usize;
+    uint64_t csize;
+
+  private:
+
+    FILE *file;
+    bool deflated;
+    z_stream zs;
+    std::vector<char> out;
+};
+
+template<typename T> void put(std::vector<char> &b, T v)
+{
+    b.insert(b.end(), (const char *)&v, (const char *)&v+sizeof(T));
+}
+
+//zip64 local header with sizes patched in after the data
+static std::vector<char> localHeader(const std::string &name, uint32_t crc, uint64_t usize, uint64_t csize, bool deflated)
+{
+    std::vector<char> h;
+    put<uint32_t>(h, 0x04034b50);
+    put<uint16_t>(h, 45);               //version needed, zip64
+    put<uint16_t>(h, 0);
+    put<uint16_t>(h, deflated ? 8 : 0);
+    put<uint16_t>(h, 0);                //dos time
+    put<uint16_t>(h, 0x21);             //dos date 1980-01-01
+    put<uint32_t>(h, crc);
+    put<uint32_t>(h, 0xffffffff);
+    put<uint32_t>(h, 0xffffffff);
+    put<uint16_t>(h, name.size());
+    put<uint16_t>(h, 20);
+    h.insert(h.end(), name.begin(), name.end());
+    put<uint16_t>(h, 1);                //zip64 extra field
+    put<uint16_t>(h, 16);
+    put<uint64_t>(h, usize);
+    put<uint64_t>(h, csize);
+    return h;
+}
+
+static void centralHeader(std::vector<char> &h, const std::string &name, uint32_t crc, uint64_t usize,
+                          uint64_t csize, uint64_t offset, bool deflated)
+{
+    put<uint32_t>(h, 0x02014b50);
+    put<uint16_t>(h, 45);
+    put<uint16_t>(h, 45);
+    put<uint16_t>(h, 0);
+    put<uint16_t>(h, deflated ? 8 : 0);
+    put<uint16_t>(h, 0);
+    put<uint16_t>(h, 0x21);
+    put<uint32_t>(h, crc);
+    put<uint32_t>(h, 0xffffffff);
+    put<uint32_t>(h, 0xffffffff);
+    put<uint16_t>(h, name.size());
+    put<uint16_t>(h, 28);
+    put<uint16_t>(h, 0);                //comment
+    put<uint16_t>(h, 0);                //disk
+    put<uint16_t>(h, 0);
+    put<uint32_t>(h, 0);
+    put<uint32_t>(h, 0xffffffff);       //offset in zip64 extra field
+    h.insert(h.end(), name.begin(), name.end());
+    put<uint16_t>(h, 1);
+    put<uint16_t>(h, 24);
+    put<uint64_t>(h, usize);
+    put<uint64_t>(h, csize);
+    put<uint64_t>(h, offset);
+}
+
+//words of one MDPP subevent: header, data words, end of event
+class mdppgen
+{
+  public:
+
+    mdppgen(std::mt19937 &rng_) : rng(rng_), uni(0., 1.) {}
+
+    //number of channels hit, 1 to 16, mostly few
+    int multiplicity()
+    {
+        int n = 1;
+        while ((n<16)&&(uni(rng)<0.45))
+            n++;
+        if (uni(rng)<0.002)
+            n = 16;
+        return n;
+    }
+
+    //n distinct channels
+    void channels(int n, int *chn)
+    {
+        int all[16];
+        for (int i=0; i<16; i++)
+            all[i] = i;
+        for (int i=0; i<n; i++){
+            int k = i + rng()%(16-i);
+            std::swap(all[i], all[k]);
+            chn[i] = all[i];
+        }
+    }
+
+    void scp(std::vector<u32> &w, int n, u32 time)
+    {
+        int chn[16];
+        channels(n, chn);
+        size_t header = w.size();
+        w.push_back(0);
+        for (int i=0; i<n; i++){
+            u32 flags = 0;
+            if (uni(rng)<0.05) flags |= 1u << 23;   //pileup
+            if (uni(rng)<0.01) flags |= 1u << 22;   //overflow
+            u32 adc = (flags & (1u << 22)) ? 0xffff : energy(60000);
+            w.push_back(0x10000000 | flags | (chn[i] << 16) | adc);
+            w.push_back(0x10000000 | ((chn[i]+16) << 16) | (rng() & 0xffff));
+        }
+        if (uni(rng)<0.1)
+            w.push_back(0x10000000 | (32 << 16) | (rng() & 0xffff));
+        subevent(w, header, time);
+    }
+
+    void qdc(std::vector<u32> &w, int n, u32 time)
+    {
+        int chn[16];
+        channels(n, chn);
+        size_t header = w.size();
+        w.push_back(0);
+        for (int i=0; i<n; i++){
+            u32 ov = (uni(rng)<0.01) ? (1u << 22) : 0;
+            u32 along = ov ? 0xfff : energy(4095);
+            u32 ashort = along/2 + rng()%(along/4+1);
+            w.push_back(0x10000000 | ov | (chn[i] << 16) | along);
+            w.push_back(0x10000000 | ((chn[i]+48) << 16) | ashort);
+            w.push_back(0x10000000 | ((chn[i]+16) << 16) | (rng() & 0xffff));
+        }
+        subevent(w, header, time);
+    }
+
+  private:
+
+    //falling spectrum with a peak, like a source measurement
+    u32 energy(u32 max)
+    {
+        double x = (uni(rng)<0.3) ? 0.6 + 0.01*std::normal_distribution<double>()(rng)
+                                  : std::exponential_distribution<double>(5.)(rng);
+        if (x<0) x = 0;
+        u32 v = 1 + (u32)(x*max);
+        return (v>max) ? max : v;
+    }
+
+    void subevent(std::vector<u32> &w, size_t header, u32 time)
+    {
+        w.push_back(0xC0000000 | (time & TimeMask));
+        w[header] = 0x40000000 | (w.size()-header-1);
+    }
+
+    std::mt19937 &rng;
+    std::uniform_real_distribution<double> uni;
+};
+
+static u32 section(int type, int eventType, size_t nwords)
+{
+    return ((u32)type << listfile_v1::SectionTypeShift) |
+           ((u32)eventType << listfile_v1::EventTypeShift) | (u32)nwords;
+}
+
+static u32 subeventHeader(int moduleType, size_t nwords)
+{
+    return ((u32)moduleType << listfile_v1::ModuleTypeShift) | (u32)nwords;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc<3){
+        cerr << "Usage: " << argv[0] << " OUT.mvmelst|OUT.zip SIZE_MB [RATE_HZ] [SEED] [ANALYSIS]" << endl;
+        return 1;
+    }
+    std::string outname = argv[1];
+    uint64_t target = (uint64_t)(atof(argv[2])*1024*1024);
+    double rate = (argc>3) ? atof(argv[3]) : 20000;
+    std::mt19937 rng((argc>4) ? atoi(argv[4]) : 1);
+    std::string analysis;
+    if (argc>5){
+        FILE *in = fopen(argv[5], "rb");
+        if (!in){
+            cerr << "Error opening " << argv[5] << ": " << std::strerror(errno) << endl;
+            return 1;
+        }
+        char buf[4096];
+        size_t n;
+        while ((n = fread(buf, 1, sizeof(buf), in))>0)
+            analysis.append(buf, n);
+        fclose(in);
+    }
+
+    bool zip = (outname.size()>4) && (outname.compare(outname.size()-4, 4, ".zip")==0);
+    std::string listname = outname;
+    if (zip)
+        listname = outname.substr(0, outname.size()-4) + ".mvmelst";
+    std::string entryname = listname.substr(listname.rfind('/')+1);
+
+    FILE *file = fopen(outname.c_str(), "wb");
+    if (!file){
+        cerr << "Error opening " << outname << " for writing: " << std::strerror(errno) << endl;
+        return 1;
+    }
+    std::vector<char> local;
+    if (zip){
+        local = localHeader(entryname, 0, 0, 0, 1);
+        fwrite(local.data(), 1, local.size(), file);
+    }
+    listout out(file, zip);
+
+    std::vector<u32> w;
+    w.reserve(1<<21);
+    w.push_back(0x454d564d);    //"MVME"
+    w.push_back(listfile_v1::Version);
+    std::string config = "{\"DAQConfig\":{\"name\":\"mvme2root benchmark\"}}";
+    config.resize((config.size()+3)/4*4, ' ');
+    w.push_back(section(listfile::SectionType_Config, 0, config.size()/4));
+    w.resize(w.size()+config.size()/4);
+    memcpy(&w[w.size()-config.size()/4], config.data(), config.size());
+
+    mdppgen gen(rng);
+    std::exponential_distribution<double> interval(rate/ClockHz);
+    double clock = 0;               //module clock ticks since start
+    double nextpulser = ClockHz/PulserHz;
+    double nexttick = 0;
+    uint64_t nevents = 0, nrollover = 0;
+    uint64_t written = 0;
+    std::vector<u32> sub;
+
+    while (written + w.size()*4 < target){
+        clock += interval(rng);
+        while (clock>=nexttick){
+            w.push_back(section(listfile::SectionType_Timetick, 0, 0));
+            nexttick += ClockHz;
+        }
+        int eventType = 0;
+        if (clock>=nextpulser){
+            eventType = 1;
+            nextpulser += ClockHz/PulserHz;
+        }
+        u32 time = (u32)((uint64_t)clock & TimeMask);
+
+        size_t start = w.size();
+        w.push_back(0);
+        sub.clear();
+        gen.scp(sub, eventType ? 16 : gen.multiplicity(), time);
+        w.push_back(subeventHeader(listfile::MDPP16_SCP, sub.size()));
+        w.insert(w.end(), sub.begin(), sub.end());
+        sub.clear();
+        gen.qdc(sub, eventType ? 16 : gen.multiplicity(), time);
+        w.push_back(subeventHeader(listfile::MDPP16_QDC, sub.size()));
+        w.insert(w.end(), sub.begin(), sub.end());
+        w.push_back(0x87654321);    //EndMarker
+        w[start] = section(listfile::SectionType_Event, eventType, w.size()-start-1);
+        nevents++;
+
+        if (w.size()>=(1<<20)){
+            if (!out.write(w.data(), w.size()*4))
+                break;
+            written += w.size()*4;
+            w.clear();
+        }
+    }
+    nrollover = (uint64_t)clock >> 30;
+    w.push_back(section(listfile::SectionType_End, 0, 0));
+    bool ok = out.write(w.data(), w.size()*4, 1);
+    written += w.size()*4;
+
+    if (ok && zip){
+        //messages.log with the run times, analysis.analysis, then the directory
+        time_t stop = 1700000000 + (time_t)(clock/ClockHz);
+        char start_s[32], stop_s[32];
+        time_t start = 1700000000;
+        strftime(start_s, sizeof(start_s), "%Y-%m-%dT%H:%M:%S", gmtime(&start));
+        strftime(stop_s, sizeof(stop_s), "%Y-%m-%dT%H:%M:%S", gmtime(&stop));
+        std::string log = std::string("Switching to DAQ mode: readout starting on ") + start_s +
+                          "\nSwitching to DAQ mode: readout stopped on " + stop_s + "\n";
+
+        //stored entries after the listfile
+        std::vector<std::string> names(1, "messages.log");
+        std::vector<std::string> contents(1, log);
+        if (argc>5){
+            names.push_back("analysis.analysis");
+            contents.push_back(analysis);
+        }
+        std::vector<uint32_t> crcs;
+        std::vector<uint64_t> offsets;
+        for (size_t i=0; i<names.size(); i++){
+            crcs.push_back(crc32(0, (const Bytef *)contents[i].data(), contents[i].size()));
+            offsets.push_back(ftello(file));
+            std::vector<char> hdr = localHeader(names[i], crcs[i], contents[i].size(), contents[i].size(), 0);
+            fwrite(hdr.data(), 1, hdr.size(), file);
+            fwrite(contents[i].data(), 1, contents[i].size(), file);
+        }
+
+        uint64_t cdoffset = ftello(file);
+        std::vector<char> cd;
+        centralHeader(cd, entryname, out.crc, out.usize, out.csize, 0, 1);
+        for (size_t i=0; i<names.size(); i++)
+            centralHeader(cd, names[i], crcs[i], contents[i].size(), contents[i].size(), offsets[i], 0);
+        uint64_t nentries = 1+names.size();
+        uint64_t cdend = cdoffset + cd.size();
+        put<uint32_t>(cd, 0x06064b50);  //zip64 end of central directory
+        put<uint64_t>(cd, 44);
+        put<uint16_t>(cd, 45);
+        put<uint16_t>(cd, 45);
+        put<uint32_t>(cd, 0);
+        put<uint32_t>(cd, 0);
+        put<uint64_t>(cd, nentries);
+        put<uint64_t>(cd, nentries);
+        put<uint64_t>(cd, cdend-cdoffset);
+        put<uint64_t>(cd, cdoffset);
+        put<uint32_t>(cd, 0x07064b50);  //zip64 locator
+        put<uint32_t>(cd, 0);
+        put<uint64_t>(cd, cdend);
+        put<uint32_t>(cd, 1);
+        put<uint32_t>(cd, 0x06054b50);  //end of central directory
+        put<uint16_t>(cd, 0xffff);
+        put<uint16_t>(cd, 0xffff);
+        put<uint16_t>(cd, 0xffff);
+        put<uint16_t>(cd, 0xffff);
+        put<uint32_t>(cd, 0xffffffff);
+        put<uint32_t>(cd, 0xffffffff);
+        put<uint16_t>(cd, 0);
+        ok = (fwrite(cd.data(), 1, cd.size(), file)==cd.size());
+
+        //sizes and crc of the listfile entry
+        local = localHeader(entryname, out.crc, out.usize, out.csize, 1);
+        ok = ok && (fseeko(file, 0, SEEK_SET)==0) && (fwrite(local.data(), 1, local.size(), file)==local.size());
+    }
+    if ((fclose(file)!=0)||(!ok)){
+        cerr << "Error writing " << outname << ": " << std::strerror(errno) << endl;
+        return 1;
+    }
+
+    cout << outname << ": " << nevents << " events, " << written/(1024*1024) << " MB listfile, "
+         << (uint64_t)(clock/ClockHz) << " s run time, " << nrollover << " time stamp rollovers" << endl;
+    return 0;
+}
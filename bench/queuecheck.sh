@@ -0,0 +1,110 @@
+#!/bin/sh
+#
+# Check of the spool directory queue (--enqueue/--queue): several workers
+# convert zips from one directory at the same time, every zip with its own
+# analysis.analysis, and each job has to be converted exactly once with its
+# own calibration.
+#
+#   bench/queuecheck.sh [-j JOBS] [-w WORKERS] [-s MB] [-d DIR]
+#
+#   -j JOBS      zips in the spool (default 12)
+#   -w WORKERS   workers started at once (default 4)
+#   -s MB        listfile size of each zip (default 8)
+#   -d DIR       work directory, emptied first (default bench/queuecheck)
+#
+# Needs ./mvme2root and bench/genlist (make bench/genlist). The zips
+# get unitMin = job number in their calibration. With root in the PATH
+# the b[16] of every output is compared against it; without, the logs are
+# checked for a calibration that could not be read. Exits with 1 on any
+# failure.
+
+cd "$(dirname "$0")/.." || exit 1
+
+jobs=12
+workers=4
+size=8
+dir=bench/queuecheck
+while getopts j:w:s:d: opt; do
+    case $opt in
+        j) jobs=$OPTARG ;;
+        w) workers=$OPTARG ;;
+        s) size=$OPTARG ;;
+        d) dir=$OPTARG ;;
+        *) exit 1 ;;
+    esac
+done
+
+for f in ./mvme2root bench/genlist; do
+    if [ ! -x $f ]; then
+        echo "$f is not built" >&2
+        exit 1
+    fi
+done
+
+rm -rf "$dir"
+mkdir -p "$dir/runs" || exit 1
+dir=$(cd "$dir" && pwd)
+
+# an analysis.analysis with unitMin N and unitMax N+1000 for all channels
+analysis()
+{
+    echo '{'
+    echo '"class": "analysis::CalibrationMinMax",'
+    echo '"data": {'
+    echo '"calibrations": ['
+    for chn in $(seq 16); do
+        echo '{'
+        echo "\"unitMax\": $(($1+1000)),"
+        echo "\"unitMin\": $1"
+        echo '},'
+    done
+    echo '],'
+    echo '"name": "amplitude",'
+    echo '}'
+}
+
+for n in $(seq "$jobs"); do
+    analysis "$n" > "$dir/analysis$n"
+    bench/genlist "$dir/runs/run$n.zip" "$size" 20000 "$n" "$dir/analysis$n" > /dev/null || exit 1
+    rm -f "$dir/analysis$n"
+done
+
+./mvme2root --enqueue "$dir/spool" "$dir"/runs/*.zip > /dev/null || exit 1
+for w in $(seq "$workers"); do
+    ./mvme2root --queue "$dir/spool" > "$dir/worker$w.log" 2>&1 &
+done
+wait
+
+fail=0
+check()
+{
+    if [ "$1" -ne "$2" ]; then
+        echo "FAIL: $3: $1, expected $2"
+        fail=1
+    fi
+}
+check $(ls "$dir/spool/done" | wc -l) "$jobs" "jobs in done/"
+check $(find "$dir/spool/failed" "$dir/spool/claimed" "$dir/spool/pending" -type f | wc -l) 0 \
+      "jobs left in failed/, claimed/ or pending/"
+check $(ls "$dir"/runs/*.root | wc -l) "$jobs" "root files"
+check $(ls -a "$dir/runs" | grep -c '\.mvme2root_unzip_\|\.mvmelst$\|^analysis\.analysis$\|^messages\.log$') 0 \
+      "unzipped files left behind"
+check $(cat "$dir"/worker*.log | grep -c '^Found ADC calibration') "$jobs" "calibrations read"
+check $(cat "$dir"/worker*.log | grep -c 'Error opening .*analysis.analysis') 0 "calibrations missing"
+
+if command -v root > /dev/null; then
+    for n in $(seq "$jobs"); do
+        b=$(root -l -b -q -e "TFile f(\"$dir/runs/run$n.root\"); TVectorD *b = (TVectorD *)f.Get(\"b[16]\"); printf(\"%g\\n\", b ? (*b)[0] : -1.);" | tail -1)
+        if [ "$b" != "$n" ]; then
+            echo "FAIL: run$n.root has b[0] = $b, expected $n"
+            fail=1
+        fi
+    done
+fi
+
+if [ $fail -ne 0 ]; then
+    echo "Queue check failed, see $dir"
+    exit 1
+fi
+echo "Queue check passed: $jobs jobs, $workers workers"
+rm -rf "$dir"
@@ -0,0 +1,108 @@
+
+#ifndef arrowwriter_h
+#define arrowwriter_h 1
+
+#include "TString.h"
+#include "shmring.hh"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+class fbbuilder;
+
+//Events of one MDPP module as an Apache Arrow IPC file (--arrow), for
+//tools that do not link ROOT. The file is written directly, the flatbuffer
+//metadata with a small builder of its own, so the Arrow library is not
+//needed. Events are taken as the shmrecord of fillRecord() and kept in
+//column buffers until a record batch of BatchRows events is full, which
+//is then written with one fwrite per buffer. Buffers start on 64 byte
+//boundaries of the file, so readers can map the file and use the columns
+//in place. The file is created with the first event, so modules that are
+//not in the data leave none.
+//
+//Columns: event (uint64), eventType (uint8), tick (uint32, timeticks of
+//the listfile so far), seconds (double, since start of run), time_stamp, extendedtime (int32), hitmask, pileupmask (SCP),
+//overflowmask (uint32), Trigger (2 x uint16) and either ADC, ADC_short
+//(QDC), TDC as fixed size lists of num_chn uint16, or with sparse the list
+//hits of {chn, ADC, ADC_short, TDC} for the channels with a value.
+class arrowwriter
+{
+  public:
+
+    arrowwriter(TString filename, int num_chn, bool qdc, bool sparse);
+   ~arrowwriter();
+
+  public:
+
+    void append(const shmrecord *rec, uint32_t tick);   //one event, throws on write errors
+    void finish();      //last batch and footer, then close
+    uint64_t rows() const { return nwritten+nrows; }
+
+    static const int BatchRows = 65536;
+
+  private:
+
+    //column values of the current batch, capacity for a full batch
+    struct colbuf
+    {
+        std::vector<char> bytes;
+        size_t used;
+        template<typename T> void push(T v){
+            memcpy(&bytes[used], &v, sizeof(T));
+            used += sizeof(T);
+        }
+    };
+
+    //Arrow Type union ids
+    enum { Int = 2, FloatingPoint = 3, List = 12, Struct = 13, FixedSizeList = 16 };
+
+    struct field
+    {
+        std::string name;
+        int type;
+        int bits;           //Int bit width, FloatingPoint precision
+        bool is_signed;
+        int listsize;       //FixedSizeList
+        colbuf data;        //values, offsets of a List
+        std::vector<field> children;
+    };
+
+    field &addField(std::vector<field> &to, const char *name, int type, int bits, bool is_signed,
+                    size_t capacity, int listsize = 0);
+    int64_t length(const field &f) const;
+    uint32_t buildSchema(fbbuilder &b) const;
+    uint32_t buildField(fbbuilder &b, const field &f) const;
+    void collect(const field &f, std::vector<int64_t> &nodes, std::vector<const colbuf *> &buffers) const;
+    void writeMessage(fbbuilder &b, const std::vector<const colbuf *> &buffers, int64_t bodylength);
+    void open();
+    void writeBatch();
+    void write(const void *data, size_t n);
+    void clear();
+
+    TString filename;
+    FILE *file;
+    uint64_t filepos;
+    int num_chn;
+    bool qdc;
+    bool sparse;
+
+    std::vector<field> fields;
+    int nrows;              //events in the current batch
+    int32_t nhits;          //sparse: hits in the current batch
+    uint64_t nwritten;      //events in batches already written
+
+    //columns filled by append()
+    colbuf *event, *eventType, *tick, *seconds, *time_stamp, *extendedtime;
+    colbuf *hitmask, *pileupmask, *overflowmask, *Trigger;
+    colbuf *ADC, *ADC_short, *TDC;
+    colbuf *offsets, *chn;
+
+    //offset, metadata length and body length of each record batch
+    struct block { int64_t offset; int32_t metalength; int32_t pad; int64_t bodylength; };
+    std::vector<block> blocks;
+};
+
+#endif
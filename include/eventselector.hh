@@ -0,0 +1,111 @@
+
+#ifndef eventselector_h
+#define eventselector_h 1
+
+#include "TString.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <map>
+
+//Event selection (--select EXPR)
+//The expression is parsed once into a small stack program. The decoded
+//values are bound by address, so evaluating an event only runs the
+//program, no strings or lookups are involved.
+//
+//  expr     C-like: || && | & == != < <= > >= + - * / % ! unary-
+//  values   decimal or 0x hex numbers, variables, variable[index]
+//
+//Variables are registered by the modules under their prefix (SCP.ADC[3],
+//QDC.seconds); a name that only one module has can be used without the
+//prefix.
+class eventselector
+{
+  public:
+
+    eventselector();
+   ~eventselector();
+
+  public:
+
+    int parse(TString expr);    //returns 0 on success
+
+    //register decoded values, call before bind()
+    void addVariable(TString name, const int *ptr, int size = 1);
+    void addVariable(TString name, const double *ptr, int size = 1);
+    void addVariable(TString name, const bool *ptr, int size = 1);
+    void addVariable(TString name, const uint32_t *ptr, int size = 1);
+    void clearVariables();
+    int bind();                 //resolve variables, returns 0 on success
+
+    bool is_active() const { return !program.empty(); }
+    bool evaluate() const;
+    inline bool accept(){
+        bool pass = evaluate();
+        if (pass) naccepted++;
+        else nrejected++;
+        return pass;
+    }
+    void printCounters() const;
+    void resetCounters();
+
+  private:
+
+    enum OpCode
+    {
+        Const, LoadInt, LoadDouble, LoadBool, LoadUInt,
+        Neg, Not, Mul, Div, Mod, Add, Sub,
+        Less, LessEq, Greater, GreaterEq, Equal, NotEqual,
+        BitAnd, BitOr, And, Or
+    };
+
+    struct instruction
+    {
+        int op;
+        double value;           //Const
+        const void *ptr;        //Load*, resolved by bind()
+        std::string name;       //Load*, variable name
+        int index;              //Load*, array index
+    };
+
+    struct variable
+    {
+        int type;               //LoadInt, LoadDouble, LoadBool, LoadUInt
+        const void *ptr;
+        int size;
+    };
+
+    void addVariable(TString name, int type, const void *ptr, int size);
+
+    //recursive descent parser
+    bool parseOr();
+    bool parseAnd();
+    bool parseBitOr();
+    bool parseBitAnd();
+    bool parseCompare();
+    bool parseSum();
+    bool parseProduct();
+    bool parseUnary();
+    bool parsePrimary();
+    void skipSpace();
+    bool match(const char *token);
+    void emit(int op);
+
+    static const int MaxStack = 64;
+
+    std::string text;       //expression being parsed
+    size_t pos;
+    std::string error;
+    int depth;              //current stack depth while parsing
+    int maxdepth;
+
+    std::vector<instruction> program;
+    std::map<std::string, variable> variables;
+    std::map<std::string, std::string> aliases;    //unprefixed name, "" if ambiguous
+
+    uint64_t naccepted;
+    uint64_t nrejected;
+};
+
+#endif
@@ -0,0 +1,26 @@
+
+#ifndef eventsink_h
+#define eventsink_h 1
+
+#include "listfile.hh"
+
+//Receiver of the events of a listfile reader. process_listfile implements
+//it once, so the v0/v1 sections and the MVLC frames end up in the same
+//decoders and trees.
+class eventsink
+{
+  public:
+
+    virtual ~eventsink() {}
+
+    virtual void beginEvent() = 0;
+    //data of a module, fill words included. The data of one module can
+    //come in several pieces when it is split over readout frames.
+    virtual void subEvent(u32 moduleType, const u32 *data, u32 nwords) = 0;
+    //complete is 0 if data of the event was lost, the event is not written.
+    //Readers that can tell give such events without their module data.
+    virtual void endEvent(u32 eventType, bool complete) = 0;
+    virtual void timetick() = 0;
+};
+
+#endif
@@ -0,0 +1,77 @@
+
+#ifndef eventstream_h
+#define eventstream_h 1
+
+#include "TString.h"
+#include "TFile.h"
+#include "mdpp_SCP.hh"
+#include "mdpp_QDC.hh"
+#include "mxdc32.hh"
+#include "shmring.hh"
+
+#include <cstdint>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+//The events of one VME event type (--split-events), written to their own
+//root file by their own thread. The decoder copies each event into a slot
+//with the modules' fillRecord(); the writer restores it with loadRecord()
+//and fills its trees, so tree filling and compression of the streams run
+//in parallel to each other and to the decoding.
+class eventstream
+{
+  public:
+
+    //mdpp32: 0 none, 1 SCP firmware, 2 QDC firmware. The stream modules
+    //only have trees, the calibration is copied from the modules of the
+    //main file (scp32 0 without an MDPP-32 SCP). The MxDC-32 trees start
+    //at the first record with their module set, with empty entries before,
+    //as in the main file. Call
+    //ROOT::EnableThreadSafety() once before the first stream.
+    eventstream(TString rootfilename, TString listfilename, bool psdsparse, int mdpp32,
+                const mdpp16_SCP &scp, const mdpp32_SCP *scp32);
+   ~eventstream();
+
+  public:
+
+    //module 0 in an MxDC slot: the module was not seen yet
+    enum { SlotSCP = 0, SlotQDC, SlotMDPP32, SlotMADC, SlotMQDC, SlotMTDC, SlotRecords };
+
+    //records of the next event, SlotRecords of them. Blocks while the
+    //writer is a full queue behind.
+    shmrecord *claim();
+    void commit();              //hand the claimed event to the writer
+    void finish(bool SCPon, bool QDCon, bool MDPP32on);   //write and close
+    uint64_t entries() const { return head; }
+
+  private:
+
+    void writer();
+    template<typename MOD>
+    void writeMxDC(MOD &rootdata, bool &on, const shmrecord *rec, uint64_t entry);
+
+    static const int QueueSize = 4096;   //events
+
+    TFile *rootfile;
+    mdpp16_SCP *rootdata_SCP;
+    mdpp16_QDC *rootdata_QDC;
+    mdpp32_SCP *rootdata_SCP32;
+    mdpp32_QDC *rootdata_QDC32;
+    madc32 *rootdata_MADC;
+    mqdc32 *rootdata_MQDC;
+    mtdc32 *rootdata_MTDC;
+    bool MADCon;        //writer side
+    bool MQDCon;
+    bool MTDCon;
+
+    shmrecord *slots;           //QueueSize*SlotRecords records
+    uint64_t head;              //events committed, decoder side
+    uint64_t tail;              //events written, writer side
+    bool finishing;
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::thread thread;
+};
+
+#endif
@@ -0,0 +1,61 @@
+
+#ifndef histmerger_h
+#define histmerger_h 1
+
+#include "TString.h"
+#include "TH1.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+//Campaign sums of converted root files (--merge): the histograms of the
+//histos_* directories, the calibration vectors and the run times, without
+//reading the trees. A pool of threads reads the files, each summing its
+//share into histograms of its own; the partial sums are then added
+//pairwise in parallel (a tree reduction), so no histogram is ever added to
+//by two threads.
+class histmerger
+{
+  public:
+
+    histmerger(int nthreads = 0);
+   ~histmerger();
+
+  public:
+
+    int merge(TString outname, const std::vector<TString> &files);    //0 on success
+
+  private:
+
+    //what is kept of one converted file
+    struct runinfo
+    {
+        TString file;
+        bool ok;            //file could be read
+        bool timed;         //has start_time and stop_time
+        UInt_t start;       //unix time
+        UInt_t stop;
+        long seconds;       //run time, of the part with --roll
+        std::map<std::string, std::vector<double> > calibration;  //m[16], b[16], ...
+    };
+
+    //histograms summed over a share of the files
+    struct partial
+    {
+        std::map<std::string, TH1 *> histos;    //"histos_SCP/hADC0"
+        std::vector<std::string> order;         //as first seen, for writing
+        long nskipped;      //histograms with other binning than the first
+        partial() : nskipped(0) {}
+    };
+
+    void readShare(const std::vector<TString> &files, size_t first, size_t last,
+                   partial &sum, std::vector<runinfo> &runs);
+    bool readFile(TString name, partial &sum, runinfo &run);
+    static void add(partial &into, partial &from);
+    static bool sameBinning(TH1 *a, TH1 *b);
+
+    int nthreads;
+};
+
+#endif
@@ -0,0 +1,305 @@
+
+#ifndef listfile_h
+#define listfile_h 1
+
+//mvme listfile format, from mvme-listfile-dumper by Florian Lüke
+//<f.lueke@mesytec.com>. Shared by the converter and the scanner.
+
+#include <cstdint>
+#include <map>
+
+typedef uint8_t  u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+
+typedef int8_t  s8;
+typedef int16_t s16;
+typedef int32_t s32;
+typedef int64_t s64;
+
+/*  ===== VERSION 0 =====
+ *
+ *  ------- Section (Event) Header ----------
+ *  33222222222211111111110000000000
+ *  10987654321098765432109876543210
+ * +--------------------------------+
+ * |ttt         eeeessssssssssssssss|
+ * +--------------------------------+
+ *
+ * t =  3 bit section type
+ * e =  4 bit event type (== event number/index) for event sections
+ * s = 16 bit size in units of 32 bit words (fillwords added to data if needed) -> 256k section max size
+ *
+ * Section size is the number of following 32 bit words not including the header word itself.
+* Sections with SectionType_Event contain subevents with the following header:
+
+ *  ------- Subevent (Module) Header --------
+ *  33222222222211111111110000000000
+ *  10987654321098765432109876543210
+ * +--------------------------------+
+ * |              mmmmmm  ssssssssss|
+ * +--------------------------------+
+ *
+ * m =  6 bit module type (VMEModuleType enum from globals.h)
+ * s = 10 bit size in units of 32 bit words
+ *
+ * The last word of each event section is the EndMarker (globals.h)
+ *
+*/
+struct listfile_v0
+{
+    static const int Version = 0;
+    static const int FirstSectionOffset = 0;
+
+    static const int SectionMaxWords  = 0xffff;
+    static const int SectionMaxSize   = SectionMaxWords * sizeof(u32);
+
+    static const int SectionTypeMask  = 0xe0000000; // 3 bit section type
+    static const int SectionTypeShift = 29;
+    static const int SectionSizeMask  = 0xffff;    // 16 bit section size in 32 bit words
+    static const int SectionSizeShift = 0;
+    static const int EventTypeMask  = 0xf0000;   // 4 bit event type
+    static const int EventTypeShift = 16;
+
+    // Subevent containing module data
+    static const int ModuleTypeMask  = 0x3f000; // 6 bit module type
+    static const int ModuleTypeShift = 12;
+
+    static const int SubEventMaxWords  = 0x3ff;
+    static const int SubEventMaxSize   = SubEventMaxWords * sizeof(u32);
+    static const int SubEventSizeMask  = 0x3ff; // 10 bit subevent size in 32 bit words
+    static const int SubEventSizeShift = 0;
+};
+
+/*  ===== VERSION 1 =====
+ *
+ * Differences to version 0:
+ * - Starts with the FourCC "MVME" followed by a 32 bit word containing the
+ *   listfile version number.
+ * - Larger section and subevent sizes: 16 -> 20 bits for sections and 10 -> 20
+ *   bits for subevents.
+ * - Module type is now 8 bit instead of 6.
+ *
+ *  ------- Section (Event) Header ----------
+ *  33222222222211111111110000000000
+ *  10987654321098765432109876543210
+ * +--------------------------------+
+ * |ttteeee     ssssssssssssssssssss|
+ * +--------------------------------+
+ *
+ * t =  3 bit section type
+ * e =  4 bit event type (== event number/index) for event sections
+ * s = 20 bit size in units of 32 bit words (fillwords added to data if needed) -> 256k section max size
+ *
+ * Section size is the number of following 32 bit words not including the header word itself.
+
+ * Sections with SectionType_Event contain subevents with the following header:
+
+ *  ------- Subevent (Module) Header --------
+ *  33222222222211111111110000000000
+ *  10987654321098765432109876543210
+ * +--------------------------------+
+ * |mmmmmmmm    ssssssssssssssssssss|
+ * +--------------------------------+
+ *
+ * m =  8 bit module type (VMEModuleType enum from globals.h)
+ * s = 10 bit size in units of 32 bit words
+ *
+ * The last word of each event section is the EndMarker (globals.h)
+ *
+*/
+struct listfile_v1
+{
+    static const int Version = 1;
+
+    static const int FirstSectionOffset = 8;
+
+    static const int SectionMaxWords  = 0xfffff;
+    static const int SectionMaxSize   = SectionMaxWords * sizeof(u32);
+
+    static const int SectionTypeMask  = 0xe0000000; // 3 bit section type
+    static const int SectionTypeShift = 29;
+    static const int SectionSizeMask  = 0x000fffff; // 20 bit section size in 32 bit words
+    static const int SectionSizeShift = 0;
+    static const int EventTypeMask    = 0x1e000000; // 4 bit event type
+    static const int EventTypeShift   = 25;
+
+    // Subevent containing module data
+    static const int ModuleTypeMask  = 0xff000000;  // 8 bit module type
+    static const int ModuleTypeShift = 24;
+
+    static const int SubEventMaxWords  = 0xfffff;
+    static const int SubEventMaxSize   = SubEventMaxWords * sizeof(u32);
+    static const int SubEventSizeMask  = 0x000fffff; // 20 bit subevent size in 32 bit words
+    static const int SubEventSizeShift = 0;
+};
+
+namespace listfile
+{
+    enum SectionType
+    {
+        /* The config section contains the mvmecfg as a json string padded with
+         * spaces to the next 32 bit boundary. If the config data size exceeds
+         * the maximum section size multiple config sections will be written at
+         * the start of the file. */
+        SectionType_Config      = 0,
+
+        /* Readout data generated by one VME Event. Contains Subevent Headers
+         * to split into VME Module data. */
+        SectionType_Event       = 1,
+
+        /* Last section written to a listfile before closing the file. Used for
+         * verification purposes. */
+        SectionType_End         = 2,
+
+        /* Marker section written once at the start of a run and then once per
+         * elapsed second. */
+        SectionType_Timetick    = 3,
+
+        /* Max section type possible. */
+        SectionType_Max         = 7
+    };
+
+    enum VMEModuleType
+    {
+        Invalid         = 0,
+        MADC32          = 1,
+        MQDC32          = 2,
+        MTDC32          = 3,
+        MDPP16_SCP      = 4,
+        MDPP32          = 5,
+        MDI2            = 6,
+        MDPP16_RCP      = 7,
+        MDPP16_QDC      = 8,
+        VMMR            = 9,
+
+        MesytecCounter = 16,
+        VHS4030p = 21,
+    };
+
+    static const std::map<VMEModuleType, const char *> VMEModuleTypeNames =
+    {
+        { VMEModuleType::MADC32,            "MADC-32" },
+        { VMEModuleType::MQDC32,            "MQDC-32" },
+        { VMEModuleType::MTDC32,            "MTDC-32" },
+        { VMEModuleType::MDPP16_SCP,        "MDPP-16_SCP" },
+        { VMEModuleType::MDPP32,            "MDPP-32" },
+        { VMEModuleType::MDI2,              "MDI-2" },
+        { VMEModuleType::MDPP16_RCP,        "MDPP-16_RCP" },
+        { VMEModuleType::MDPP16_QDC,        "MDPP-16_QDC" },
+        { VMEModuleType::VMMR,              "VMMR" },
+        { VMEModuleType::VHS4030p,          "iseg VHS4030p" },
+        { VMEModuleType::MesytecCounter,    "Mesytec Counter" },
+    };
+
+    inline const char *get_vme_module_name(VMEModuleType moduleType)
+    {
+        auto it = VMEModuleTypeNames.find(moduleType);
+        if (it != VMEModuleTypeNames.end())
+        {
+            return it->second;
+        }
+
+        return "unknown";
+    }
+
+} // end namespace listfile
+
+/*  ===== MVLC =====
+ *
+ * Listfiles of crates read out through an MVLC start with the magic
+ * "MVLC_USB" or "MVLC_ETH" followed by the readout buffers as they came
+ * from the controller, with system event frames written in between.
+ *
+ *  ------- Frame Header --------------------
+ *  33222222222211111111110000000000
+ *  10987654321098765432109876543210
+ * +--------------------------------+
+ * |ttttttttffffssssccclllllllllllll|
+ * +--------------------------------+
+ *
+ * t =  8 bit frame type
+ * f =  4 bit flags, Continue if the next frame carries on with the data
+ * s =  4 bit stack number, event index + 1 for readout stacks
+ * c =  3 bit controller id
+ * l = 13 bit length in units of 32 bit words, not including the header
+ *
+ * The data of one event is a stack frame followed by stack continuation
+ * frames while Continue is set. The data of a block read inside it is a
+ * block read frame, again continued in further block read frames.
+ *
+ *  ------- System Event Header -------------
+ * +--------------------------------+
+ * |11111010kcccssssssslllllllllllll|
+ * +--------------------------------+
+ *
+ * k = continue, c = 3 bit controller id, s = 7 bit subtype, l = 13 bit length
+ *
+ *  ------- ETH Packet Header (two words) ---
+ * +--------------------------------+
+ * |00hhnnnnnnnnnnnnccclllllllllllll|
+ * |uuuuuuuuuuuuuuuuuuuupppppppppppp|
+ * +--------------------------------+
+ *
+ * h =  2 bit channel, n = 12 bit packet number, c = controller id,
+ * l = 13 bit number of data words, u = 20 bit time stamp, p = 12 bit offset
+ * of the first frame header in the packet data, 0xfff if the packet only
+ * continues a frame. System events are written between the packets.
+ *
+*/
+namespace mvlc
+{
+    static const int MagicSize = 8;
+
+    static const u32 FrameTypeMask   = 0xff000000;
+    static const int FrameTypeShift  = 24;
+    static const u32 FrameFlagsMask  = 0x00f00000;
+    static const int FrameFlagsShift = 20;
+    static const u32 StackNumMask    = 0x000f0000;
+    static const int StackNumShift   = 16;
+    static const u32 FrameLengthMask = 0x00001fff;
+
+    enum FrameType
+    {
+        SuperFrame          = 0xF1,
+        StackFrame          = 0xF3,
+        BlockRead           = 0xF5,
+        StackError          = 0xF7,
+        StackContinuation   = 0xF9,
+        SystemEvent         = 0xFA,
+    };
+
+    enum FrameFlags
+    {
+        Timeout     = 1,
+        BusError    = 2,
+        SyntaxError = 4,
+        Continue    = 8,
+    };
+
+    static const u32 SystemSubtypeMask  = 0x000fe000;
+    static const int SystemSubtypeShift = 13;
+
+    enum SystemEventType
+    {
+        BeginRun        = 0x02,
+        EndRun          = 0x03,
+        MVMEConfig      = 0x10,
+        UnixTimetick    = 0x11,
+        Pause           = 0x12,
+        Resume          = 0x13,
+        EndOfFile       = 0x77,
+    };
+
+    static const u32 PacketChannelMask   = 0x30000000;
+    static const int PacketChannelShift  = 28;
+    static const u32 PacketNumberMask    = 0x0fff0000;
+    static const int PacketNumberShift   = 16;
+    static const u32 PacketWordsMask     = 0x00001fff;
+    static const u32 NextHeaderMask      = 0x00000fff;
+    static const u32 NoHeaderPointer     = 0xfff;
+    static const u32 DataChannel         = 2;
+} // end namespace mvlc
+
+#endif
@@ -0,0 +1,124 @@
+
+#ifndef listreader_h
+#define listreader_h 1
+
+#include "TString.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <sys/types.h>
+
+#ifdef USE_URING
+#include <liburing.h>
+#endif
+
+//Asynchronous read-ahead input for listfiles.
+//The file is read in large, page aligned blocks which are kept in flight
+//ahead of the decoder. With USE_URING the reads are queued with io_uring,
+//otherwise, or if io_uring cannot be set up, a small pool of threads
+//issues them with pread().
+//"-" (stdin), pipes and other files that cannot seek are streams: one
+//thread reads them forward with read(), still ahead of the decoder, and
+//nothing is ever seeked back to.
+class listreader
+{
+  public:
+
+    listreader(TString name, size_t blocksize = 4*1024*1024, int depth = 8);
+   ~listreader();
+
+  public:
+
+    bool is_open() const { return fd>=0; }  //errno tells why not
+    void start();       //start reading ahead (prefetch)
+
+    //read nbytes into dest, throws std::runtime_error at end of file
+    inline void read(char *dest, size_t nbytes){
+        if (curpos+nbytes <= curlen){
+            std::memcpy(dest, curdata+curpos, nbytes);
+            curpos += nbytes;
+        }
+        else{
+            read_slow(dest, nbytes);
+        }
+    }
+    //nbytes in place if they are inside the current block, else copied to
+    //scratch. Valid until the next read.
+    inline const char *view(size_t nbytes, std::vector<char> &scratch){
+        if (curpos+nbytes <= curlen){
+            const char *p = curdata+curpos;
+            curpos += nbytes;
+            return p;
+        }
+        scratch.resize(nbytes);
+        read_slow(scratch.data(), nbytes);
+        return scratch.data();
+    }
+    //up to maxbytes in place from the current block, never copied. nbytes
+    //is 0 at end of file. Valid until the next read.
+    const char *viewBlock(size_t maxbytes, size_t &nbytes);
+    void peek(char *dest, size_t nbytes);  //read without consuming
+    void skip(uint64_t nbytes);
+    bool more(size_t nbytes);   //at least nbytes left, may wait for a block
+    void drain();       //streams: read to the end, so size() is all sent
+    uint64_t tell() const { return curoffset+curpos; }   //bytes consumed
+    uint64_t size() const { return filesize; }  //streams: bytes read so far
+    bool isStream() const { return streamed; }
+
+  private:
+
+    void read_slow(char *dest, size_t nbytes);
+    ssize_t read_block(char *buf, uint64_t index);
+    bool next_block();
+    void release_block(uint64_t index);
+    void submit_block(uint64_t index);
+    void worker();
+
+    enum { Free = 0, Reading, Ready };
+
+    struct block
+    {
+        char *data;
+        size_t len;
+        uint64_t index;
+        int state;
+        int error;      //errno of a failed read
+    };
+
+    TString filename;
+    int fd;
+    uint64_t filesize;
+    uint64_t nblocks;
+    size_t blocksize;
+    int depth;
+    bool started;
+    bool streamed;          //read forward with read(), nblocks known at the end
+
+    std::vector<block> blocks;
+
+    //current block, owned by the decoding thread
+    const char *curdata;
+    size_t curlen;
+    size_t curpos;
+    uint64_t curoffset;     //file offset of current block
+    uint64_t nextindex;     //next block to hand to the decoder
+
+#ifdef USE_URING
+    struct io_uring ring;
+    int inflight;           //reads submitted but not yet completed
+#endif
+    bool uringON;           //reads go through io_uring, else the thread pool
+
+    std::vector<std::thread> workers;
+    std::mutex mtx;
+    std::condition_variable cv;
+    uint64_t nextsubmit;    //next block to be read by the thread pool
+    bool stopping;
+};
+
+#endif
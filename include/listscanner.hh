@@ -0,0 +1,54 @@
+
+#ifndef listscanner_h
+#define listscanner_h 1
+
+#include "listfile.hh"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+//Statistics and integrity check of listfiles without converting them
+//(--scan). The file is mapped and walked section by section with the
+//header masks of listfile_v0/v1; only the fill words inside subevents are
+//looked at, and no ROOT objects are created.
+class listscanner
+{
+  public:
+
+    listscanner(std::string name);
+   ~listscanner();
+
+  public:
+
+    int scan();                 //0 if the file is complete and well formed
+    std::string json() const;   //summary as one line of JSON
+
+    //scan files in parallel and print one JSON line per file in the given
+    //order. Directories are replaced by the .mvmelst files in them.
+    //Returns the number of files that are incomplete or broken.
+    static int scanAll(const std::vector<std::string> &paths, int nthreads = 0);
+
+  private:
+
+    template<typename LF>
+    void walk(const u32 *data, const u32 *end);
+
+    std::string filename;
+    std::string error;          //first problem found, empty if none
+    uint64_t filesize;
+    u32 version;
+
+    bool endsection;            //file has an End section
+    uint64_t bytesafterend;     //bytes after the End section
+    bool truncated;             //last section goes past the end of file
+    uint64_t nevents;
+    uint64_t nconfig;
+    uint64_t ntimeticks;        //one per second of the run
+    uint64_t nunknown;          //sections of unknown type
+    uint64_t nfill;             //fill words in subevents
+    uint64_t eventtypes[16];    //events per VME event type
+    uint64_t modules[256];      //subevents per module type
+};
+
+#endif
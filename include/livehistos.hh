@@ -0,0 +1,68 @@
+
+#ifndef livehistos_h
+#define livehistos_h 1
+
+#include "TString.h"
+#include "TH1.h"
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+
+class THttpServer;
+
+//Serves the spectra on http://localhost:port while a file is converted.
+//The decode loop keeps filling its own histograms; at most once per
+//interval their contents are copied into snapshot histograms, which are the
+//only ones the http server ever sees. The server runs in its own thread, if
+//it is busy the copy is simply tried again later, so the decode loop never
+//waits for a client.
+class livehistos
+{
+  public:
+
+    livehistos(int port, double interval);
+   ~livehistos();
+
+  public:
+
+    bool is_open() const { return running; }
+
+    void attach(const char *folder, TH1 *hist);   //call before the first event
+    void detach();      //call at end of file, keeps the last snapshot visible
+
+    //call once per event
+    inline void update(){
+        if ((++calls & 0xfff)==0)
+            poll();
+    }
+
+  private:
+
+    void poll();
+    bool snapshot();
+    void copyContents(size_t i);    //live[i] to snap[i], with the lock held
+    void serve(int port);
+
+    std::vector<TH1 *> live;        //filled by the decode loop
+    std::vector<TH1 *> snap;        //registered with the server
+    std::vector<TString> folders;
+
+    unsigned long calls;
+    std::chrono::steady_clock::duration interval;
+    std::chrono::steady_clock::time_point lastsnap;
+    bool pending;       //a snapshot is due but the server was busy
+
+    THttpServer *server;
+    std::thread thread;
+    std::mutex mtx;     //guards the snapshots and the server
+    std::condition_variable cv;
+    bool running;
+    bool started;
+    std::atomic<bool> stopping;
+};
+
+#endif
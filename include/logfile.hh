@@ -14,6 +14,11 @@ class logfile
   public:
      
     int readLog();
+    void writeTimes();  //start and stop time to the current directory
+
+    //getters
+    UInt_t getStart() const { return found ? start_time.Convert() : 0; }    //unix time, 0 without messages.log
+    UInt_t getStop() const { return found ? stop_time.Convert() : 0; }
 
     //setters
   
@@ -24,6 +29,7 @@ class logfile
     //values from messages.log
     TDatime start_time;
     TDatime stop_time;
+    bool found;         //messages.log was read
 
 };
 
@@ -0,0 +1,69 @@
+
+#ifndef matrix2d_h
+#define matrix2d_h 1
+
+#include "TString.h"
+#include "TH2I.h"
+
+#include <cstdint>
+#include <vector>
+
+//2D spectra filled during conversion (--2d)
+enum
+{
+    Spectrum_ADC_TDC = 1,   //ADC vs TDC per channel
+    Spectrum_ADC_chn = 2    //ADC vs channel
+};
+
+//Flat integer accumulator for a 2D spectrum. Values are binned by a shift,
+//counted in one contiguous array and turned into a TH2I once at the end,
+//so filling costs an index computation and an increment.
+class matrix2d
+{
+  public:
+
+    //nx bins of width 1<<xshift along x, ny of 1<<yshift along y.
+    //growx: x is extended as needed up to maxnx bins (time axis)
+    matrix2d(int nx, int xshift, int ny, int yshift, bool growx = 0, uint32_t maxnx = 0);
+   ~matrix2d();
+
+  public:
+
+    inline void fill(uint32_t x, uint32_t y){
+        x >>= xshift;
+        y >>= yshift;
+        if (y>=ny)
+            return;
+        if (x>=nx){
+            //a corrupt time stamp must not grow the axis without end
+            if ((!growx)||(x>=maxnx)){
+                nout++;
+                return;
+            }
+            grow(x+1);
+        }
+        counts[(size_t)x*ny+y]++;     //x major so the time axis can grow
+    }
+
+    //new histogram with the contents, axes start at 0
+    TH2I *makeHist(TString name, TString title) const;
+    void reset();       //clear the counts, keeps the size
+
+    uint64_t outside() const { return nout; }   //fills beyond the x axis
+    size_t maxBytes() const { return (size_t)maxnx*ny*sizeof(uint32_t); }
+
+  private:
+
+    void grow(uint32_t n);
+
+    std::vector<uint32_t> counts;
+    uint32_t nx;
+    uint32_t maxnx;     //nx for a fixed axis
+    uint32_t ny;
+    int xshift;
+    int yshift;
+    bool growx;
+    uint64_t nout;
+};
+
+#endif
@@ -0,0 +1,137 @@
+#ifndef mdpp_QDC_h
+#define mdpp_QDC_h 1
+
+#include "TTree.h"
+#include "TString.h"
+#include "spectrum.hh"
+#include "TH2F.h"
+#include "TDatime.h"
+#include "TVectorD.h"
+#include "shmring.hh"
+#include "matrix2d.hh"
+
+class livehistos;
+class eventselector;
+
+//MDPP-16 or MDPP-32 with QDC firmware, NCHN is the number of channels.
+//All per event arrays have a fixed size, so the decode loop works on the
+//stack-sized members without any bounds other than compile time ones.
+template<int NCHN>
+class mdpp_QDC
+{
+  public:
+  
+    //psdsparse: store PSD as (nPSD, PSDchn, PSDval) instead of PSD[num_chn]
+    //psdhist: also fill ADC_long vs PSD histograms
+    //histos 0: tree only (--split-events streams), no histograms
+    mdpp_QDC(TString name, bool psdsparse = 0, bool psdhist = 0, bool histos = 1);
+   ~mdpp_QDC();
+
+  public:
+     
+    void initEvent();   //call at start of event
+    void printValues();
+    void endEvent();    //call at end of event
+    void writeEvent();  //call after endEvent to fill the tree
+    void writeTree();   //call at end of file
+    void writeHistos();   //call at end of file
+    void fillRecord(shmrecord *rec);  //call after endEvent
+    void loadRecord(const shmrecord *rec);  //event back from fillRecord
+    void attachLive(livehistos *live);  //serve histograms during conversion
+    void registerVariables(eventselector &sel, const char *prefix);  //for --select
+    uint32_t getHitmask() const { return hitmask; }  //channels with a value, after endEvent
+
+    //setters
+    void setADC(int chn, int value);
+    void setADC_short(int chn, int value);
+    void setADC_long(int chn, int value);
+    void setTDC(int chn, int value);
+    void setTime(int value);
+    void setExtendedTime(int value);
+    void setOverflow(int chn, bool value);
+    void setFillTree(bool value);
+    void dropTree();    //--histos-only, no tree at all, call before setMemoryBudget
+    void setMemoryBudget(size_t bytes);   //--max-memory, call before attachLive
+    void setSpectra(int which);   //--2d, Spectrum_* flags, call before setMemoryBudget
+    void nextFile();    //--roll, new tree and histograms in the current directory
+    void setTrigger(int chn, int value);
+  
+    static const int num_chn = NCHN;
+    static const int num_trigger = 2;
+
+    //data word: channel address at bit 16, 6 bits for MDPP-16 and 7 bits
+    //for MDPP-32, followed by the overflow and pileup flags
+    static const int chn_bits = (NCHN<=16) ? 6 : 7;
+    static const int overflow_bit = 16+chn_bits;
+    static const int pileup_bit = 17+chn_bits;
+
+    //"QDC" for MDPP-16, "QDC32" for MDPP-32: histogram directory suffix,
+    //live histogram folder and --select prefix
+    static const char *label(){ return (NCHN==16) ? "QDC" : "QDC32"; }
+
+  private:
+
+    static_assert((NCHN==16)||(NCHN==32), "MDPP modules have 16 or 32 channels");
+
+    static const uint32_t allmask = 0xffffffffu >> (32-NCHN);   //all channels
+
+    void computePSD();
+    size_t spectraBytes() const;    //--2d accumulators at their largest
+    void makeTree();
+    void makeHistos();
+    void configureTree();
+
+    TTree *roottree;
+    Long64_t treebytes; //tree memory budget, 0 for ROOT defaults
+    bool fillON;        //0 tree is not filled (--shm-only)
+    bool treeON;        //0 no tree is made (--histos-only)
+    bool histsON;       //0 no histograms are made (stream modules)
+
+    TString filename;
+    
+    //values from MDPP
+    int ADC_long[num_chn];
+    int ADC_short[num_chn];
+    int TDC[num_chn];
+    int Trigger[num_trigger];
+    bool overflow[num_chn];
+    uint32_t longdirty;     //channels with ADC_long or overflow set since initEvent
+    uint32_t shortdirty;    //channels with ADC_short set
+    uint32_t tdcdirty;      //channels with TDC set
+    int time_stamp;
+    int extendedtime;
+
+    //calculated  values
+    double PSD[num_chn];    //(long-short)/long, 0 for channels without long integral
+    int nPSD;               //sparse PSD: number of channels with a long integral
+    int PSDchn[num_chn];    //sparse PSD: channel
+    double PSDval[num_chn]; //sparse PSD: value
+    bool psdsparse;
+    bool psdhist;
+    int lasttime;       //time stamp of last event
+    bool extendedON;    //0 extended time stamp off,
+                        //1 extended time stamp on
+    double seconds;     //seconds since start of run
+    uint32_t hitmask;   //bit i set if channel i has an ADC value
+    int mult;           //number of channels with an ADC value
+    int histshift;      //value>>histshift is the bin of the 64k bin spectra
+    int spectra;        //Spectrum_* flags of the 2D spectra filled
+
+    //Projected histograms
+    TH1 *hADC_short[num_chn];   //TH1I with --histos-only
+    TH1 *hADC_long[num_chn];
+    TH1 *hPSD[num_chn];
+    TH1 *hTDC[num_chn];
+    TH2F *hLongPSD[num_chn];    //0 unless psdhist
+
+    //2D spectra (--2d), 0 if not filled
+    matrix2d *mADC_TDC[num_chn];
+    matrix2d *mADC_chn;
+    
+};
+
+typedef mdpp_QDC<16> mdpp16_QDC;
+typedef mdpp_QDC<32> mdpp32_QDC;
+
+#endif
+
@@ -0,0 +1,137 @@
+#ifndef mdpp_SCP_h
+#define mdpp_SCP_h 1
+
+#include "TTree.h"
+#include "TString.h"
+#include "spectrum.hh"
+#include "TDatime.h"
+#include "TVectorD.h"
+#include "shmring.hh"
+#include "matrix2d.hh"
+
+class livehistos;
+class eventselector;
+
+//MDPP-16 or MDPP-32 with SCP or RCP firmware, NCHN is the number of channels.
+//All per event arrays have a fixed size, so the decode loop works on the
+//stack-sized members without any bounds other than compile time ones.
+template<int NCHN>
+class mdpp_SCP
+{
+  public:
+  
+    //histos 0: tree only (--split-events streams), no histograms and no
+    //analysis.analysis, take the calibration with copyCalibration()
+    mdpp_SCP(TString name, bool histos = 1);
+   ~mdpp_SCP();
+
+  public:
+     
+    void initEvent();   //call at start of event
+    void printValues();
+    void endEvent();    //call at end of event
+    void writeEvent();  //call after endEvent to fill the tree
+    void writeTree();   //call at end of file
+    void writeHistos();   //call at end of file
+    void writeCalibration();    //m and b, call at end of file with or without tree
+    void fillRecord(shmrecord *rec);  //call after endEvent
+    void loadRecord(const shmrecord *rec);  //event back from fillRecord
+    void attachLive(livehistos *live);  //serve histograms during conversion
+    void registerVariables(eventselector &sel, const char *prefix);  //for --select
+    uint32_t getHitmask() const { return hitmask; }  //channels with a value, after endEvent
+
+    int readAnalysis();
+    void copyCalibration(const mdpp_SCP &other);
+
+    //unitMin/unitMax of the amplitude calibration in an analysis.analysis
+    //file, min and max are left alone for channels it does not have
+    static int readCalibration(TString analysis_filename, double *min, double *max);
+
+    //setters
+    void setADC(int chn, int value);
+    void setTDC(int chn, int value);
+    void setTrigger(int chn, int value);
+    void setTime(int value);
+    void setExtendedTime(int value);
+    void setPileup(int chn, bool value);
+    void setOverflow(int chn, bool value);
+    void setFillTree(bool value);
+    void dropTree();    //--histos-only, no tree at all, call before setMemoryBudget
+    void setMemoryBudget(size_t bytes);   //--max-memory, call before attachLive
+    void setSpectra(int which);   //--2d, Spectrum_* flags, call before setMemoryBudget
+    void nextFile();    //--roll, new tree and histograms in the current directory
+  
+    static const int num_chn = NCHN;
+    static const int num_trigger = 2;
+
+    //data word: channel address at bit 16, 6 bits for MDPP-16 and 7 bits
+    //for MDPP-32, followed by the overflow and pileup flags
+    static const int chn_bits = (NCHN<=16) ? 6 : 7;
+    static const int overflow_bit = 16+chn_bits;
+    static const int pileup_bit = 17+chn_bits;
+
+    //"SCP" for MDPP-16, "SCP32" for MDPP-32: histogram directory suffix,
+    //live histogram folder and --select prefix
+    static const char *label(){ return (NCHN==16) ? "SCP" : "SCP32"; }
+
+  private:
+
+    static_assert((NCHN==16)||(NCHN==32), "MDPP modules have 16 or 32 channels");
+
+    static const uint32_t allmask = 0xffffffffu >> (32-NCHN);   //all channels
+
+    void makeTree();
+    size_t spectraBytes() const;    //--2d accumulators at their largest
+    void makeHistos();
+    void configureTree();
+
+    TTree *roottree;
+    Long64_t treebytes; //tree memory budget, 0 for ROOT defaults
+    bool fillON;        //0 tree is not filled (--shm-only)
+    bool treeON;        //0 no tree is made (--histos-only)
+    bool histsON;       //0 no histograms are made (stream modules)
+
+    TString filename;
+    
+    //values from MDPP
+    int ADC[num_chn];
+    int TDC[num_chn];
+    int Trigger[num_trigger];
+    int time_stamp;
+    int extendedtime;
+    bool pileup[num_chn];
+    bool overflow[num_chn];
+    uint32_t adcdirty;  //channels with ADC, pileup or overflow set since initEvent
+    uint32_t tdcdirty;  //channels with TDC set
+
+    //values from analysis.analysis (energy calibration)
+    TVectorD m;
+    TVectorD b;
+    double min[num_chn], max[num_chn];
+
+    //calculated  values
+    int lasttime;       //time stamp of last event
+    bool extendedON;    //0 extended time stamp off,
+                        //1 extended time stamp on
+    double seconds;     //seconds since start of run
+    uint32_t hitmask;   //bit i set if channel i has an ADC value
+    int mult;           //number of channels with an ADC value
+    int histshift;      //value>>histshift is the bin of the 64k bin spectra
+    int spectra;        //Spectrum_* flags of the 2D spectra filled
+
+    //Projected histograms, TH1I with --histos-only
+    TH1 *hADC[num_chn];
+    TH1 *hTDC[num_chn];
+    TH1 *hEn[num_chn];
+
+    //2D spectra (--2d), 0 if not filled
+    matrix2d *mADC_TDC[num_chn];
+    matrix2d *mADC_chn;
+    
+};
+
+typedef mdpp_SCP<16> mdpp16_SCP;
+typedef mdpp_SCP<32> mdpp32_SCP;
+
+#endif
+
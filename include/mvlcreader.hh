@@ -0,0 +1,100 @@
+
+#ifndef mvlcreader_h
+#define mvlcreader_h 1
+
+#include "listfile.hh"
+#include "eventsink.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class listreader;
+
+//Reader of MVLC listfiles (see mvlc in listfile.hh). The frames carry no
+//module types, the modules read out by each event are taken in readout
+//order from the MVMEConfig system event at the start of the file, or from
+//the list given for the event (--mvlc-modules), which wins. The data of a block read is handed to the sink in place, a module
+//split over several frames, packets or read blocks in several pieces. An
+//event goes to the sink only once it is complete, so events with lost data
+//never reach the decoders; only the pieces of events that cross a read
+//block or ETH packet are copied until then.
+class mvlcreader
+{
+  public:
+
+    //modules[i] are the module types of event i, 16 events, an empty list
+    //takes them from the MVMEConfig system event
+    mvlcreader(listreader &infile, const std::vector<u32> *modules, bool verbose = 0);
+   ~mvlcreader();
+
+  public:
+
+    void read(eventsink &sink);     //whole file, after the magic
+
+    //0 if magic is not an MVLC listfile, 1 for USB, 2 for ETH
+    static int format(const char *magic);
+    //listfile::VMEModuleType of a name like mdpp16_scp or MDPP-16_SCP, 0
+    //if unknown
+    static u32 moduleType(const char *name);
+
+    enum { USB = 1, ETH = 2 };
+
+  private:
+
+    void readUSB(eventsink &sink);
+    void readETH(eventsink &sink);
+    size_t parse(const u32 *data, size_t nwords, eventsink &sink);
+    void systemEvent(u32 header, eventsink &sink);
+    void systemData(const u32 *data, u32 nwords);
+    void systemEnd();   //after the last word of a system event
+    void applyConfig(); //module lists of the MVMEConfig JSON
+    void finishEvent(eventsink &sink, bool complete);
+    void keepPieces();  //copy pieces out of the block before it is left
+
+    listreader &infile;
+    std::vector<u32> modules[16];   //module types of each event
+    bool given[16];                 //from the constructor, not the config
+    bool verbose;
+    int fileformat;
+
+    //frame state, kept across chunks of the file and ETH packets
+    u32 skipWords;      //rest of a frame that is not readout data
+    bool inEvent;
+    u32 eventIndex;
+    u32 stackLeft;      //words left in the stack (continuation) frame
+    bool stackContinue; //a continuation frame follows
+    u32 blockLeft;      //words left in the block read frame
+    bool blockContinue; //the next block read frame is the same module
+    int module;         //index of the module in the event
+    u32 currentType;    //its module type
+
+    //module data of the open event, handed to the sink when it is complete
+    struct piece
+    {
+        u32 type;
+        const u32 *data;    //in the read block, 0 once copied to buffer
+        size_t offset;      //in buffer
+        u32 nwords;
+    };
+    std::vector<piece> pieces;
+    std::vector<u32> buffer;
+    u32 pendingTicks;   //timeticks inside the open event
+
+    //MVMEConfig system event, split in frames flagged Continue
+    bool inConfig;      //words of the system event go to config
+    bool sysContinue;   //another frame of the system event follows
+    std::string config;
+    bool configFound;
+
+    bool endoffile;     //EndOfFile system event seen
+    uint64_t eofoffset; //file offset after it
+    uint64_t nevents;
+    uint64_t nlostpackets;  //ETH
+    uint64_t ndropped;      //events with lost data
+    uint64_t nunknown;      //words that are no frame header
+    bool extrawarned;
+};
+
+#endif
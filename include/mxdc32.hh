@@ -0,0 +1,105 @@
+#ifndef mxdc32_h
+#define mxdc32_h 1
+
+#include "TTree.h"
+#include "TString.h"
+#include "spectrum.hh"
+#include "listfile.hh"
+#include "subeventdecoder.hh"
+#include "shmring.hh"
+
+class livehistos;
+class eventselector;
+
+//MADC-32, MQDC-32 or MTDC-32, TYPE is the listfile::VMEModuleType. The
+//three share the mesytec MxDC data format: a header word, one word per
+//converted channel, an optional extended time stamp and the end of event
+//word with a 30 bit time stamp or event counter.
+template<int TYPE>
+class mxdc32 : public subeventdecoder
+{
+  public:
+
+    mxdc32(bool verbose = 0, bool histos = 1);
+   ~mxdc32();
+
+  public:
+
+    u32 decode(const u32 *data, u32 nwords);    //one subevent
+
+    void initEvent();   //call at start of event
+    void endEvent();    //call at end of event
+    void writeEvent();  //call after endEvent to fill the tree
+    void fillEmpty(Long64_t n);     //n empty events and the spectra, call before the first decode
+    void fillRecord(shmrecord *rec);  //call after endEvent, for --split-events
+    void loadRecord(const shmrecord *rec);  //event back from fillRecord
+    void writeTree();   //call at end of file
+    void writeHistos();   //call at end of file
+    void nextFile();    //--roll, new tree and histograms in the current directory
+    void attachLive(livehistos *live);  //serve histograms during conversion
+    void registerVariables(eventselector &sel, const char *prefix);  //for --select
+    uint32_t getHitmask() const { return hitmask; }  //channels with a value, after endEvent
+    void setFillTree(bool value);
+    void dropTree();    //--histos-only, no tree at all, call before setMemoryBudget
+    void setMemoryBudget(size_t bytes);   //--max-memory, call before the first decode
+
+    static const int num_chn = 32;
+    static const int num_trigger = 2;   //MTDC-32 trigger inputs
+
+    //data word: channel at bit 16, value in the low value_bits, MADC-32
+    //and MQDC-32 flag an out of range value at overflow_bit
+    static const int value_bits = (TYPE==listfile::MADC32) ? 13 :
+                                  (TYPE==listfile::MQDC32) ? 12 : 16;
+    static const int overflow_bit = (TYPE==listfile::MADC32) ? 14 : 15;
+
+    //tree, histogram directory suffix, live histogram folder and --select
+    //prefix
+    static const char *label(){
+        return (TYPE==listfile::MADC32) ? "MADC32" :
+               (TYPE==listfile::MQDC32) ? "MQDC32" : "MTDC32";
+    }
+    //name of the per channel value: ADC, QDC or TDC
+    static const char *valueName(){
+        return (TYPE==listfile::MADC32) ? "ADC" :
+               (TYPE==listfile::MQDC32) ? "QDC" : "TDC";
+    }
+
+  private:
+
+    static_assert((TYPE==listfile::MADC32)||(TYPE==listfile::MQDC32)||(TYPE==listfile::MTDC32),
+                  "mxdc32 decodes MADC-32, MQDC-32 and MTDC-32");
+
+    void makeTree();
+    void makeHistos();
+    void configureTree();
+
+    TTree *roottree;
+    Long64_t treebytes; //tree memory budget, 0 for ROOT defaults
+    bool fillON;        //0 tree is not filled (--shm-only)
+    bool treeON;        //0 no tree is made (--histos-only)
+    bool histsON;       //0 no histograms are made (stream modules)
+    bool started;       //module seen, the spectra are made
+    livehistos *live;   //--http, for spectra made later
+    bool verbose;       //print every word
+
+    //values from the module
+    int value[num_chn];
+    bool overflow[num_chn];     //MADC-32 and MQDC-32
+    int Trigger[num_trigger];   //MTDC-32
+    int module_id;
+    int time_stamp;
+    int extendedtime;
+
+    //calculated values
+    uint32_t hitmask;   //bit i set if channel i has a value
+    int mult;           //number of channels with a value
+
+    TH1 *hValue[num_chn];   //TH1I with --histos-only
+    int histshift;      //value>>histshift is the bin of the spectra
+};
+
+typedef mxdc32<listfile::MADC32> madc32;
+typedef mxdc32<listfile::MQDC32> mqdc32;
+typedef mxdc32<listfile::MTDC32> mtdc32;
+
+#endif
@@ -0,0 +1,40 @@
+
+#ifndef recalibrator_h
+#define recalibrator_h 1
+
+#include "TString.h"
+#include "TFile.h"
+
+//Energies of converted root files with a new calibration (--recalibrate),
+//without going back to the listfile. The ADC branch of the SCP trees is
+//read in chunks, calibrated by a pool of threads and filled into the
+//friend tree MDPP16_SCP_cal (MDPP32_SCP_cal) of filename_cal.root by a
+//writer thread while the next chunk is read. hEn is rebuilt from hADC the
+//way the conversion fills it. The converted file is only read.
+class recalibrator
+{
+  public:
+
+    recalibrator(TString analysis_filename, int nthreads = 0);
+   ~recalibrator();
+
+  public:
+
+    bool is_open() const { return ok; }
+    int recalibrate(TString rootfilename);     //0 on success
+
+  private:
+
+    //0 done, -1 the file has no such tree, 1 error
+    template<int NCHN>
+    int recalibrateTree(TFile *in, TFile *out, const double *min, const double *max);
+
+    static const long Chunk = 65536;    //events per chunk
+
+    bool ok;
+    int nthreads;
+    double min16[16], max16[16];
+    double min32[32], max32[32];
+};
+
+#endif
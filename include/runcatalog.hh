@@ -0,0 +1,55 @@
+
+#ifndef runcatalog_h
+#define runcatalog_h 1
+
+#include "TString.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+//Run catalog (--catalog FILE, --query FILE EXPR)
+//One CSV line per root file written: the file, its listfile and part, run
+//start and stop (unix time, 0 without messages.log), seconds of run time
+//from the timeticks, events read, written and lost, the modules present
+//and whether analysis.analysis was found. A line is appended with a single
+//write() on a file opened with O_APPEND and locked with flock(), so
+//conversions running in parallel can share a catalog. Queries filter the
+//lines with an --select expression and never open a root file.
+class runcatalog
+{
+  public:
+
+    runcatalog(TString filename);
+   ~runcatalog();
+
+  public:
+
+    struct entry
+    {
+        TString file;       //root file
+        TString listfile;
+        int part;           //--roll part, 0 without
+        uint32_t start;     //unix time
+        uint32_t stop;
+        int seconds;        //timeticks
+        double events;      //read, with lost data
+        double kept;        //written to the trees
+        double lost;        //with lost data
+        TString modules;    //present, e.g. "SCP|QDC|MADC32"
+        bool calibrated;    //analysis.analysis found
+        uint32_t converted; //unix time
+    };
+
+    int append(const entry &e);     //returns 0 on success
+    int query(TString expr);        //prints the header and matching lines, -1 on error
+
+  private:
+
+    static std::string quote(const TString &field);
+    static bool split(const std::string &line, std::vector<std::string> &fields);
+
+    TString filename;
+};
+
+#endif
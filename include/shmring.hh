@@ -0,0 +1,143 @@
+
+#ifndef shmring_h
+#define shmring_h 1
+
+#include "TString.h"
+
+#include <atomic>
+#include <cstdint>
+
+/*
+ * Shared memory event stream (--shm NAME)
+ *
+ * Decoded events are published as fixed size records into a POSIX shared
+ * memory ring buffer (/dev/shm/NAME) so that local consumers can read them
+ * while the conversion is running. The writer never waits for consumers; a
+ * consumer that falls more than one ring behind loses records.
+ *
+ * Layout (native byte order, x86-64):
+ *
+ *   offset 0              shmheader
+ *   offset header_size    shmrecord slot[capacity]
+ *
+ * Writer protocol for record number i (slot i & (capacity-1)):
+ *   slot.seq = 2*i+1         (record is being written)
+ *   ... fill record ...
+ *   slot.seq = 2*i+2         (release)
+ *   header.write_index = i+1 (release)
+ *
+ * Consumer protocol: read write_index (acquire), pick a record number i
+ * with write_index-capacity <= i < write_index, check slot.seq == 2*i+2,
+ * use the record in place and check slot.seq again afterwards. If it has
+ * changed the record was overwritten while it was read. shmconsumer below
+ * implements this.
+ */
+
+static const char ShmMagic[8] = {'M','V','M','E','2','R','T','\0'};
+static const uint32_t ShmVersion = 1;
+static const int ShmMaxChn = 32;
+static const int ShmMaxTrigger = 2;
+static const uint32_t ShmMaxSlots = 1u << 30;  //largest capacity
+
+struct shmheader
+{
+    char magic[8];                  //ShmMagic, written last at creation
+    uint32_t version;               //ShmVersion
+    uint32_t header_size;           //offset of slot 0 in bytes
+    uint32_t record_size;           //sizeof(shmrecord)
+    uint32_t capacity;              //number of slots, power of 2
+    uint32_t writer_pid;            //a converter for the same name checks it
+    std::atomic<uint32_t> state;    //1 converting, 2 writer finished
+    std::atomic<uint64_t> write_index;  //number of records published
+    std::atomic<uint32_t> file_index;   //file of the batch being converted
+    uint32_t reserved[9];
+};
+
+struct shmrecord
+{
+    std::atomic<uint64_t> seq;      //sequence lock, see above
+    uint64_t event;                 //event number within the file
+    uint32_t file;                  //file index within the batch
+    uint32_t module;                //listfile::VMEModuleType
+    uint32_t eventType;             //VME event index
+    uint32_t num_chn;               //valid entries in the arrays
+    int32_t time_stamp;
+    int32_t extendedtime;
+    double seconds;                 //seconds since start of run
+    uint32_t hitmask;               //bit i set if channel i has an ADC value
+    uint32_t pileupmask;
+    uint32_t overflowmask;
+    int32_t Trigger[ShmMaxTrigger];
+    uint32_t reserved;
+    int32_t ADC[ShmMaxChn];         //SCP: ADC, QDC: long integral
+    int32_t ADC_short[ShmMaxChn];   //QDC only
+    int32_t TDC[ShmMaxChn];
+};
+
+//publishes records, owned by the converter
+class shmring
+{
+  public:
+
+    shmring(TString name, uint32_t capacity);
+   ~shmring();
+
+  public:
+
+    bool is_open() const { return header!=0; }
+    void setFile(uint32_t file);
+
+    //claim the next slot, fill it and call publish()
+    inline shmrecord *claim(){
+        uint64_t i = next;
+        shmrecord *rec = slots + (i & (header->capacity-1));
+        rec->seq.store(2*i+1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        return rec;
+    }
+    inline void publish(shmrecord *rec){
+        rec->file = file;
+        rec->seq.store(2*next+2, std::memory_order_release);
+        next++;
+        header->write_index.store(next, std::memory_order_release);
+    }
+
+  private:
+
+    TString shmname;
+    size_t mapsize;
+    shmheader *header;
+    shmrecord *slots;
+    uint64_t next;
+    uint32_t file;
+};
+
+//reads records in place, for online consumers
+class shmconsumer
+{
+  public:
+
+    shmconsumer(TString name);
+   ~shmconsumer();
+
+  public:
+
+    bool is_open() const { return header!=0; }
+    bool finished() const { return header->state.load()==2; }
+
+    //next unread record or 0 if there is none yet. The record is not
+    //copied; check valid() after using it.
+    const shmrecord *next();
+    bool valid(const shmrecord *rec) const;
+    uint64_t lost() const { return nlost; }
+
+  private:
+
+    size_t mapsize;
+    const shmheader *header;
+    const shmrecord *slots;
+    uint64_t readindex;
+    uint64_t nlost;
+};
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef spectrum_h
+#define spectrum_h 1
+
+#include "TH1F.h"
+#include "TH1I.h"
+
+//1D spectrum of a module: TH1F as always, or TH1I for --histos-only, whose
+//integer bins keep counting exactly past 2^24 on long quick-look runs
+inline TH1 *makeSpectrum(bool exact, const char *name, const char *title,
+                         int nbins, double xlow, double xup)
+{
+    if (exact)
+        return new TH1I(name, title, nbins, xlow, xup);
+    return new TH1F(name, title, nbins, xlow, xup);
+}
+
+#endif
@@ -0,0 +1,40 @@
+
+#ifndef spoolqueue_h
+#define spoolqueue_h 1
+
+#include "TString.h"
+
+//Work queue in a spool directory shared by several converters (--queue).
+//
+//  DIR/pending/    one job file per listfile, holding its absolute path
+//  DIR/claimed/    jobs being converted, renamed to NAME@host.pid
+//  DIR/done/       finished jobs, with a line of who converted them
+//  DIR/failed/     jobs that could not be converted
+//
+//A job is claimed by renaming it out of pending/, which succeeds for one
+//process only, also between nodes sharing the filesystem. No locks or
+//servers are needed; jobs of a crashed worker stay in claimed/.
+class spoolqueue
+{
+  public:
+
+    spoolqueue(TString dir);
+   ~spoolqueue();
+
+  public:
+
+    int init();                         //create the directories, 0 on success
+    int enqueue(TString listfile);      //add a job, 0 on success
+    bool claim(TString &listfile);      //take the next job, 0 if none left
+    void finish(bool ok);               //move the claimed job to done/failed
+
+  private:
+
+    TString spooldir;
+    TString worker;         //host.pid
+    TString claimed;        //name of the claimed job in pending/
+    double starttime;       //of the claimed job
+    int njobs;              //jobs enqueued by this process
+};
+
+#endif
@@ -0,0 +1,21 @@
+
+#ifndef subeventdecoder_h
+#define subeventdecoder_h 1
+
+#include "listfile.hh"
+
+//Decoder of the data of one module type. process_listfile hands it the
+//whole subevent at once, so there is one virtual call per subevent and
+//the loop over the data words is compiled into each decoder.
+class subeventdecoder
+{
+  public:
+
+    virtual ~subeventdecoder() {}
+
+    //all words of one subevent, fill words included. Returns the number
+    //of data words, 0 if the subevent was empty.
+    virtual u32 decode(const u32 *data, u32 nwords) = 0;
+};
+
+#endif
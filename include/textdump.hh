@@ -0,0 +1,101 @@
+
+#ifndef textdump_h
+#define textdump_h 1
+
+#include "TString.h"
+#include "shmring.hh"
+#include "listfile.hh"
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+//Decoded events as text (--dump): CSV with one row per hit of an MDPP
+//module, or JSON lines with one object per event holding its subevent
+//words and the decoded values of its MDPP modules. The decoder only copies
+//each event into a chunk of binary records; full chunks are formatted by
+//a pool of threads and written in order, so there is no flush per line
+//and formatting does not slow the conversion down.
+class textdump
+{
+  public:
+
+    enum { CSV = 1, JSON = 2 };
+
+    textdump(TString filename, int format, int nthreads = 1);
+   ~textdump();
+
+  public:
+
+    //a module whose values are dumped, label as in the tree names. qdc
+    //adds ADC_short. Returns the index for module().
+    int addModule(const char *label, bool qdc);
+
+    void beginEvent(int event, int tick);
+    void subEvent(u32 moduleType, const u32 *data, u32 nwords);
+    void module(int index, const shmrecord *rec);  //after the subevents
+    void endEvent(u32 eventType, bool complete);
+    void finish();      //format and write the rest, close the file
+
+    uint64_t events() const { return nevents; }
+
+  private:
+
+    //an event in a chunk: a header of HeaderWords (event, tick, eventType,
+    //complete, words of the event) followed by its records
+    enum { HeaderWords = 5 };
+    enum { RecSubevent = 1, RecModule };    //record tags
+    enum { Free = 0, Filling, Queued, Formatting, Formatted };
+
+    static const size_t ChunkWords = 256*1024;
+
+    struct chunk
+    {
+        std::vector<uint32_t> raw;  //binary records of whole events
+        std::string text;
+        uint64_t seq;
+        int state;
+    };
+
+    struct moduleinfo
+    {
+        const char *label;
+        bool qdc;
+    };
+
+    void put(const void *data, size_t nwords)
+    {
+        const uint32_t *p = (const uint32_t *)data;
+        cur->raw.insert(cur->raw.end(), p, p+nwords);
+    }
+    void submit();      //queue the current chunk, take a free one
+    void worker();
+    void format(const std::vector<uint32_t> &raw, std::string &out) const;
+    void formatCSV(const uint32_t *ev, std::string &out) const;
+    void formatJSON(const uint32_t *ev, std::string &out) const;
+    void writeText(const std::string &text);
+
+    TString filename;
+    int fd;
+    int layout;         //CSV or JSON
+    bool failed;        //a write failed, the rest is dropped
+    std::vector<moduleinfo> modules;
+    uint64_t nevents;
+    size_t eventstart;  //raw index of the header of the current event
+    bool inEvent;       //beginEvent without endEvent yet
+
+    std::vector<chunk> chunks;
+    chunk *cur;         //filled by the decoder
+    uint64_t nextseq;   //sequence number of the next queued chunk
+    uint64_t nextwrite; //sequence number of the next chunk to write
+    bool finishing;
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::vector<std::thread> workers;
+};
+
+#endif
@@ -0,0 +1,77 @@
+
+#ifndef tickseries_h
+#define tickseries_h 1
+
+#include "TString.h"
+#include "matrix2d.hh"
+
+#include <cstdint>
+#include <vector>
+
+//Run quality series binned on the timeticks of the listfile, which mvme
+//writes once per second of run time: events, events with lost data and
+//events written per second, and the hits of each channel of a module per
+//second. Filled while converting and written as histograms to the
+//timeticks directory, so rate plots do not need a pass over the trees.
+class tickseries
+{
+  public:
+
+    tickseries(uint32_t maxseconds);    //longest series of hits
+   ~tickseries();
+
+  public:
+
+    int addModule(TString label, int nchn);     //returns the index for hits()
+    //hits of a module at the longest series, for --max-memory
+    static size_t maxBytes(int nchn, uint32_t maxseconds){ return (size_t)maxseconds*nchn*sizeof(uint32_t); }
+
+    void tick(){ ticks++; }     //one timetick section
+
+    //call once per event
+    void event(){ count(events); }
+    void lost(){ count(nlost); }        //event with lost data
+    void kept(){ count(nkept); }        //event written to the trees
+
+    //channels of a module in the current event, bit i for channel i
+    void hits(int module, uint32_t mask)
+    {
+        if (!mask)
+            return;
+        modules[module].used = 1;
+        for (; mask; mask&=mask-1)
+            modules[module].counts->fill(ticks-first, __builtin_ctz(mask));
+    }
+
+    void nextFile();    //--roll, new series from the current second
+    void write();       //histograms to the current directory
+
+  private:
+
+    struct module
+    {
+        TString label;
+        matrix2d *counts;   //seconds x channel
+        bool used;          //any hits in the series
+    };
+
+    void count(std::vector<uint32_t> &series)
+    {
+        uint32_t sec = ticks-first;
+        if (sec>=series.size())
+            series.resize(2*sec+64, 0);
+        series[sec]++;
+    }
+
+    void writeSeries(const std::vector<uint32_t> &series, const char *name, const char *title);
+
+    uint32_t ticks;     //timeticks since start of run
+    uint32_t first;     //second of the first bin
+    uint32_t maxseconds;
+    std::vector<uint32_t> events;
+    std::vector<uint32_t> nlost;
+    std::vector<uint32_t> nkept;
+    std::vector<module> modules;
+};
+
+#endif
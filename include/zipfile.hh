@@ -0,0 +1,48 @@
+
+#ifndef zipfile_h
+#define zipfile_h 1
+
+#include "TString.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+//Minimal zip archive reader used to unpack the mvme run archives
+//(run.mvmelst, analysis.analysis, messages.log) without calling unzip.
+//Supports stored and deflated entries and zip64 archives.
+class zipfile
+{
+  public:
+
+    zipfile(TString name);
+   ~zipfile();
+
+  public:
+
+    bool is_open() const { return fd>=0; }
+    int readDirectory();            //returns 0 on success
+    int extractAll(TString dir);    //same as "unzip -o -d dir", 0 on success
+
+  private:
+
+    struct entry
+    {
+        std::string name;
+        uint64_t offset;        //of the local file header
+        uint64_t csize;         //compressed size
+        uint64_t usize;         //uncompressed size
+        uint32_t crc;
+        uint16_t method;        //0 stored, 8 deflated
+    };
+
+    int extract(const entry &e, TString path);
+    bool readAt(uint64_t offset, void *dest, size_t nbytes);
+
+    TString filename;
+    int fd;
+    uint64_t filesize;
+    std::vector<entry> entries;
+};
+
+#endif
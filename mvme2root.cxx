@@ -19,251 +19,400 @@
  * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
  *
  */
+#include <cctype>
 #include <cerrno>
+#include <cmath>
 #include <cstdint>
+#include <cstdlib>
 #include <cstring>
+#include <ctime>
 #include <fstream>
+#include <unistd.h>
+#include <ftw.h>
+#include <sys/resource.h>
 #include <iostream>
 #include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
 
 #include "TString.h"
 #include "TFile.h"
-#include "mdpp16_SCP.hh"
-#include "mdpp16_QDC.hh"
-#include "logfile.hh"
+#include "TNamed.h"
 #include "TROOT.h"
-
-typedef uint8_t  u8;
-typedef uint16_t u16;
-typedef uint32_t u32;
-typedef uint64_t u64;
-
-typedef int8_t  s8;
-typedef int16_t s16;
-typedef int32_t s32;
-typedef int64_t s64;
+#include "listfile.hh"
+#include "mdpp_SCP.hh"
+#include "mdpp_QDC.hh"
+#include "logfile.hh"
+#include "listreader.hh"
+#include "shmring.hh"
+#include "arrowwriter.hh"
+#include "livehistos.hh"
+#include "zipfile.hh"
+#include "eventselector.hh"
+#include "spoolqueue.hh"
+#include "listscanner.hh"
+#include "eventstream.hh"
+#include "subeventdecoder.hh"
+#include "mxdc32.hh"
+#include "recalibrator.hh"
+#include "histmerger.hh"
+#include "eventsink.hh"
+#include "mvlcreader.hh"
+#include "tickseries.hh"
+#include "textdump.hh"
+#include "runcatalog.hh"
 
 using std::cout;
 using std::cerr;
 using std::endl;
 
-/*  ===== VERSION 0 =====
- *
- *  ------- Section (Event) Header ----------
- *  33222222222211111111110000000000
- *  10987654321098765432109876543210
- * +--------------------------------+
- * |ttt         eeeessssssssssssssss|
- * +--------------------------------+
- *
- * t =  3 bit section type
- * e =  4 bit event type (== event number/index) for event sections
- * s = 16 bit size in units of 32 bit words (fillwords added to data if needed) -> 256k section max size
- *
- * Section size is the number of following 32 bit words not including the header word itself.
-* Sections with SectionType_Event contain subevents with the following header:
-
- *  ------- Subevent (Module) Header --------
- *  33222222222211111111110000000000
- *  10987654321098765432109876543210
- * +--------------------------------+
- * |              mmmmmm  ssssssssss|
- * +--------------------------------+
- *
- * m =  6 bit module type (VMEModuleType enum from globals.h)
- * s = 10 bit size in units of 32 bit words
- *
- * The last word of each event section is the EndMarker (globals.h)
- *
-*/
-struct listfile_v0
+inline int bitExtractor(int word, int numbits, int position){
+    return (((1 << numbits) - 1) & (word >> position)); 
+}
+
+//command line options
+struct options
 {
-    static const int Version = 0;
-    static const int FirstSectionOffset = 0;
-
-    static const int SectionMaxWords  = 0xffff;
-    static const int SectionMaxSize   = SectionMaxWords * sizeof(u32);
-
-    static const int SectionTypeMask  = 0xe0000000; // 3 bit section type
-    static const int SectionTypeShift = 29;
-    static const int SectionSizeMask  = 0xffff;    // 16 bit section size in 32 bit words
-    static const int SectionSizeShift = 0;
-    static const int EventTypeMask  = 0xf0000;   // 4 bit event type
-    static const int EventTypeShift = 16;
-
-    // Subevent containing module data
-    static const int ModuleTypeMask  = 0x3f000; // 6 bit module type
-    static const int ModuleTypeShift = 12;
-
-    static const int SubEventMaxWords  = 0x3ff;
-    static const int SubEventMaxSize   = SubEventMaxWords * sizeof(u32);
-    static const int SubEventSizeMask  = 0x3ff; // 10 bit subevent size in 32 bit words
-    static const int SubEventSizeShift = 0;
+    bool verbose;       //print every value
+    bool tree;          //fill the MDPP16 trees
+    bool histosonly;    //--histos-only: no trees are made at all
+    TString shmname;    //publish events to this shared memory ring
+    u32 shmslots;       //number of records in the ring
+    shmring *shm;
+    int httpport;       //serve live histograms on this port
+    double httpinterval;    //seconds between histogram snapshots
+    livehistos *live;
+    eventselector *select;  //events to keep, 0 keeps all
+    TString mdpp32;     //firmware of MDPP-32 subevents, "scp" or "qdc"
+    bool psdsparse;     //QDC PSD branch as (nPSD, PSDchn, PSDval)
+    bool psdhist;       //QDC ADC_long vs PSD histograms
+    size_t maxmemory;   //memory budget in bytes, 0 no limit
+    size_t modulememory;    //share of the budget per module, 0 no limit
+    size_t readblock;   //listreader block size
+    int readdepth;      //listreader blocks in flight
+    int spectra;        //2D spectra to fill, Spectrum_* flags
+    uint32_t maxseconds;    //longest run time the hit rate series cover
+    bool split;         //one file per VME event type, filled in parallel
+    long rollevents;    //--roll: start a new root file after this many events,
+    Long64_t rollbytes; //bytes written
+    int rollseconds;    //or seconds of run time, 0 no limit
+    std::vector<u32> mvlcmodules[16];   //module types of each event, MVLC listfiles, over the MVMEConfig
+    int arrow;          //--arrow: MDPP columns as Arrow files, 0 none, 1 dense, 2 sparse
+    TString output;     //-o: root file name instead of the one from the listfile
+    int dump;           //--dump: decoded events as text, 0 none, textdump::CSV or JSON
+    int dumpthreads;    //threads formatting the dump
+    TString catalog;    //--catalog: run catalog with a line per root file
+
+    options() : verbose(0), tree(1), histosonly(0), shmslots(65536), shm(0),
+                httpport(0), httpinterval(1.), live(0), select(0),
+                psdsparse(0), psdhist(0), maxmemory(0), modulememory(0),
+                readblock(4*1024*1024), readdepth(8), spectra(0), maxseconds(7*86400),
+                split(0), rollevents(0), rollbytes(0), rollseconds(0), arrow(0),
+                dump(0), dumpthreads(1) {}
 };
 
-/*  ===== VERSION 1 =====
- *
- * Differences to version 0:
- * - Starts with the FourCC "MVME" followed by a 32 bit word containing the
- *   listfile version number.
- * - Larger section and subevent sizes: 16 -> 20 bits for sections and 10 -> 20
- *   bits for subevents.
- * - Module type is now 8 bit instead of 6.
- *
- *  ------- Section (Event) Header ----------
- *  33222222222211111111110000000000
- *  10987654321098765432109876543210
- * +--------------------------------+
- * |ttteeee     ssssssssssssssssssss|
- * +--------------------------------+
- *
- * t =  3 bit section type
- * e =  4 bit event type (== event number/index) for event sections
- * s = 20 bit size in units of 32 bit words (fillwords added to data if needed) -> 256k section max size
- *
- * Section size is the number of following 32 bit words not including the header word itself.
-
- * Sections with SectionType_Event contain subevents with the following header:
+//decode one data word of an MDPP with SCP or RCP firmware
+template<typename MOD>
+void decode_SCP(MOD &rootdata, u32 subEventData, bool optverbose)
+{
+    int sig = bitExtractor(subEventData, 4, 28);
+    if (sig==4){ //header
+        if (optverbose)
+            cout << "\tHeader" << endl;
+    }
+    else if (sig==1){//data
+        int chn = bitExtractor(subEventData, MOD::chn_bits, 16);
+        int data = bitExtractor(subEventData, 16, 0);
+        int ov = 0;
+        rootdata.setADC(chn, data);
+
+        if (chn<MOD::num_chn){
+            int pu = bitExtractor(subEventData, 1, MOD::pileup_bit);
+            ov = bitExtractor(subEventData, 1, MOD::overflow_bit);
+            rootdata.setPileup(chn, pu);
+            rootdata.setOverflow(chn, ov);
+        }
+        if (optverbose){
+            cout << "\tData" << endl;
+            cout << "\t" << ov << "\t" 
+                 << chn << "\t" << data << endl;
+        }
+    }
+    else if(sig==2){//extended time stamp
+        int extended = bitExtractor(subEventData, 16, 0);
+        rootdata.setExtendedTime(extended);
+        if (optverbose)
+            cout << "\tExtended time stamp:\t" << extended << endl;
+    }
+    else if(sig>=12){//end of event
+        int time = bitExtractor(subEventData, 30, 0);
+        rootdata.setTime(time);
+        if (optverbose){
+            cout << "\tEnd of event" << endl;
+            cout << "\tTime:\t" << time << endl;
+        }
+    }
+}
 
- *  ------- Subevent (Module) Header --------
- *  33222222222211111111110000000000
- *  10987654321098765432109876543210
- * +--------------------------------+
- * |mmmmmmmm    ssssssssssssssssssss|
- * +--------------------------------+
- *
- * m =  8 bit module type (VMEModuleType enum from globals.h)
- * s = 10 bit size in units of 32 bit words
- *
- * The last word of each event section is the EndMarker (globals.h)
- *
-*/
-struct listfile_v1
+//decode one data word of an MDPP with QDC firmware
+template<typename MOD>
+void decode_QDC(MOD &rootdata, u32 subEventData, bool optverbose)
 {
-    static const int Version = 1;
+    int sig = bitExtractor(subEventData, 4, 28);
+    if (sig==4){ //header
+        if (optverbose)
+            cout << "\tHeader" << endl;
+    }
+    else if (sig==1){//data
+        int chn = bitExtractor(subEventData, MOD::chn_bits, 16);
+        int data = bitExtractor(subEventData, 16, 0);
+        int ov = 0;
+        rootdata.setADC(chn, data);
+
+        if (chn<MOD::num_chn){
+            ov = bitExtractor(subEventData, 1, MOD::overflow_bit);
+            rootdata.setOverflow(chn, ov);
+        }
+        if (optverbose){
+            cout << "\tData" << endl;
+            cout << "\t" << ov << "\t" 
+                 << chn << "\t" << data << endl;
+        }
+    }
+    else if(sig==2){//extended time stamp
+        int extended = bitExtractor(subEventData, 16, 0);
+        rootdata.setExtendedTime(extended);
+        if (optverbose)
+            cout << "\tExtended time stamp:\t" << extended << endl;
+    }
+    else if(sig>=12){//end of event
+        int time = bitExtractor(subEventData, 30, 0);
+        rootdata.setTime(time);
+        if (optverbose){
+            cout << "\tEnd of event" << endl;
+            cout << "\tTime:\t" << time << endl;
+        }
+    }
+}
 
-    static const int FirstSectionOffset = 8;
+//an MDPP behind the subevent decoder interface: one virtual call per
+//subevent, DECODE (decode_SCP or decode_QDC) inlined for the words
+template<typename MOD, void (*DECODE)(MOD &, u32, bool)>
+class mdpp_decoder : public subeventdecoder
+{
+  public:
 
-    static const int SectionMaxWords  = 0xfffff;
-    static const int SectionMaxSize   = SectionMaxWords * sizeof(u32);
+    mdpp_decoder(MOD &rootdata_, bool verbose_) : rootdata(rootdata_), verbose(verbose_) {}
 
-    static const int SectionTypeMask  = 0xe0000000; // 3 bit section type
-    static const int SectionTypeShift = 29;
-    static const int SectionSizeMask  = 0x000fffff; // 20 bit section size in 32 bit words
-    static const int SectionSizeShift = 0;
-    static const int EventTypeMask    = 0x1e000000; // 4 bit event type
-    static const int EventTypeShift   = 25;
+    u32 decode(const u32 *data, u32 nwords)
+    {
+        u32 ndata = 0;
+        for (u32 i=0; i<nwords; ++i){
+            u32 subEventData = data[i];
+            if (verbose)
+                printf("    %2u = 0x%08x\n", i, subEventData);
+
+            if (subEventData == 0xffffffff){
+                if (verbose)
+                    cout << "\tFill" << endl;
+                continue;
+            }
+            DECODE(rootdata, subEventData, verbose);
+            ndata++;
+        }
+        return ndata;
+    }
 
-    // Subevent containing module data
-    static const int ModuleTypeMask  = 0xff000000;  // 8 bit module type
-    static const int ModuleTypeShift = 24;
+  private:
 
-    static const int SubEventMaxWords  = 0xfffff;
-    static const int SubEventMaxSize   = SubEventMaxWords * sizeof(u32);
-    static const int SubEventSizeMask  = 0x000fffff; // 20 bit subevent size in 32 bit words
-    static const int SubEventSizeShift = 0;
+    MOD &rootdata;
+    bool verbose;
 };
 
-namespace listfile
+//set up an MxDC-32 module, the three share one module's part of the
+//memory budget
+template<typename MOD>
+void setup_mxdc(MOD &rootdata, const options &opt)
 {
-    enum SectionType
-    {
-        /* The config section contains the mvmecfg as a json string padded with
-         * spaces to the next 32 bit boundary. If the config data size exceeds
-         * the maximum section size multiple config sections will be written at
-         * the start of the file. */
-        SectionType_Config      = 0,
-
-        /* Readout data generated by one VME Event. Contains Subevent Headers
-         * to split into VME Module data. */
-        SectionType_Event       = 1,
-
-        /* Last section written to a listfile before closing the file. Used for
-         * verification purposes. */
-        SectionType_End         = 2,
-
-        /* Marker section written once at the start of a run and then once per
-         * elapsed second. */
-        SectionType_Timetick    = 3,
-
-        /* Max section type possible. */
-        SectionType_Max         = 7
-    };
+    rootdata.setFillTree(opt.tree && !opt.split);
+    if (opt.histosonly)
+        rootdata.dropTree();
+    if (opt.modulememory>0)
+        rootdata.setMemoryBudget(opt.modulememory/3);
+    if (opt.live)
+        rootdata.attachLive(opt.live);
+    if (opt.select)
+        rootdata.registerVariables(*opt.select, MOD::label());
+}
 
-    enum VMEModuleType
-    {
-        Invalid         = 0,
-        MADC32          = 1,
-        MQDC32          = 2,
-        MTDC32          = 3,
-        MDPP16_SCP      = 4,
-        MDPP32          = 5,
-        MDI2            = 6,
-        MDPP16_RCP      = 7,
-        MDPP16_QDC      = 8,
-        VMMR            = 9,
-
-        MesytecCounter = 16,
-        VHS4030p = 21,
-    };
+//set up a module for the options of this run
+template<typename MOD>
+void setup_module(MOD &rootdata, const options &opt)
+{
+    rootdata.setFillTree(opt.tree && !opt.split);
+    if (opt.histosonly)
+        rootdata.dropTree();
+    if (opt.spectra)
+        rootdata.setSpectra(opt.spectra);
+    if (opt.modulememory>0)
+        rootdata.setMemoryBudget(opt.modulememory);
+    if (opt.live)
+        rootdata.attachLive(opt.live);
+    if (opt.select)
+        rootdata.registerVariables(*opt.select, MOD::label());
+}
 
-    static const std::map<VMEModuleType, const char *> VMEModuleTypeNames =
-    {
-        { VMEModuleType::MADC32,            "MADC-32" },
-        { VMEModuleType::MQDC32,            "MQDC-32" },
-        { VMEModuleType::MTDC32,            "MTDC-32" },
-        { VMEModuleType::MDPP16_SCP,        "MDPP-16_SCP" },
-        { VMEModuleType::MDPP32,            "MDPP-32" },
-        { VMEModuleType::MDI2,              "MDI-2" },
-        { VMEModuleType::MDPP16_RCP,        "MDPP-16_RCP" },
-        { VMEModuleType::MDPP16_QDC,        "MDPP-16_QDC" },
-        { VMEModuleType::VMMR,              "VMMR" },
-        { VMEModuleType::VHS4030p,          "iseg VHS4030p" },
-        { VMEModuleType::MesytecCounter,    "Mesytec Counter" },
-    };
+//hand the decoded event of a module to the online consumers
+template<typename MOD>
+void publish_event(const options &opt, MOD &rootdata, u32 module, u32 eventType, int counter)
+{
+    shmrecord *rec = opt.shm->claim();
+    rec->event = counter;
+    rec->module = module;
+    rec->eventType = eventType;
+    rootdata.fillRecord(rec);
+    opt.shm->publish(rec);
+}
 
-    const char *get_vme_module_name(VMEModuleType moduleType)
-    {
-        auto it = VMEModuleTypeNames.find(moduleType);
-        if (it != VMEModuleTypeNames.end())
-        {
-            return it->second;
-        }
+//--arrow: add the decoded event of a module to its columns
+template<typename MOD>
+void append_arrow(arrowwriter *arrow, MOD &rootdata, u32 eventType, int counter, int ticks)
+{
+    shmrecord rec;
+    rec.event = counter;
+    rec.eventType = eventType;
+    rootdata.fillRecord(&rec);
+    arrow->append(&rec, ticks);
+}
+
+//--dump: add the decoded values of a module to the event
+template<typename MOD>
+void dump_module(textdump *dump, int index, MOD &rootdata)
+{
+    shmrecord rec;
+    rootdata.fillRecord(&rec);
+    dump->module(index, &rec);
+}
+
+//energy calibration of a module, only the SCP firmware has one
+template<typename MOD>
+void write_calibration(MOD &)
+{
+
+}
+
+template<int NCHN>
+void write_calibration(mdpp_SCP<NCHN> &rootdata)
+{
+    rootdata.writeCalibration();
+}
+
+//write tree, calibration and histograms of a module at the end of the file
+template<typename MOD>
+void write_module(TFile *rootfile, MOD &rootdata, bool tree)
+{
+    TString histdir = Form("histos_%s", MOD::label());
+    rootfile->cd();
+    if (tree)
+        rootdata.writeTree();
+    write_calibration(rootdata);
+    rootfile->mkdir(histdir);
+    rootfile->cd(histdir);
+    rootdata.writeHistos();
+}
 
-        return "unknown";
+//--roll: what a part holds, as TNamed like the run start and stop times
+void write_part_info(int part, int firstevent, int lastevent, int firstsecond, int lastsecond)
+{
+    TNamed partN("part", Form("%i", part));
+    TNamed events("events", Form("%i-%i", firstevent, lastevent));
+    TNamed seconds("run_seconds", Form("%i-%i", firstsecond, lastsecond));
+    partN.Write();
+    events.Write();
+    seconds.Write();
+}
+
+//--roll: NAME_parts.C with a function of the same name that chains the
+//parts, rewritten after each part so it is usable if the run is cut short
+void write_part_index(TString base, const std::vector<TString> &parts)
+{
+    std::string dir = "";
+    std::string name = base.Data();
+    size_t slash = name.rfind('/');
+    if (slash!=std::string::npos){
+        dir = name.substr(0, slash+1);
+        name = name.substr(slash+1);
+    }
+    for (size_t i=0; i<name.size(); i++){
+        if (!isalnum((unsigned char)name[i]))
+            name[i] = '_';
     }
+    if (name.empty() || isdigit((unsigned char)name[0]))
+        name = "run_" + name;
+    name += "_parts";
+
+    std::string macro = dir + name + ".C";
+    std::ofstream out(macro.c_str());
+    if (!out.is_open()){
+        cerr << "Error opening " << macro << " for writing" << endl;
+        return;
+    }
+    //absolute paths, so the macro works from any directory
+    char *real = realpath(dir.empty() ? "." : dir.c_str(), 0);
+    std::string absdir = real ? std::string(real) + "/" : dir;
+    free(real);
+
+    out << "//parts written by mvme2root --roll, in order\n"
+        << "//root -l " << name << ".C or .L " << name << ".C and " << name << "(\"MDPP16_QDC\")\n"
+        << "TChain *" << name << "(const char *tree = \"MDPP16_SCP\")\n"
+        << "{\n"
+        << "    TChain *chain = new TChain(tree);\n";
+    for (size_t i=0; i<parts.size(); i++){
+        std::string part = parts[i].Data();
+        out << "    chain->Add(\"" << absdir << part.substr(part.rfind('/')+1) << "\");\n";
+    }
+    out << "    return chain;\n"
+        << "}\n";
+}
 
-} // end namespace listfile
+//hands the events of a listfile reader to the lambdas of process_listfile
+template<typename BEGIN, typename SUBEVENT, typename END, typename TICK>
+class lambdasink final : public eventsink
+{
+  public:
 
-inline int bitExtractor(int word, int numbits, int position){
-    return (((1 << numbits) - 1) & (word >> position)); 
+    lambdasink(BEGIN &b, SUBEVENT &s, END &e, TICK &t) : begin(b), sub(s), end(e), tick(t) {}
+
+    void beginEvent() { begin(); }
+    void subEvent(u32 moduleType, const u32 *data, u32 nwords) { sub(moduleType, data, nwords); }
+    void endEvent(u32 eventType, bool complete) { end(eventType, complete); }
+    void timetick() { tick(); }
+
+  private:
+
+    BEGIN &begin;
+    SUBEVENT &sub;
+    END &end;
+    TICK &tick;
+};
+
+template<typename BEGIN, typename SUBEVENT, typename END, typename TICK>
+lambdasink<BEGIN, SUBEVENT, END, TICK> make_sink(BEGIN &b, SUBEVENT &s, END &e, TICK &t)
+{
+    return lambdasink<BEGIN, SUBEVENT, END, TICK>(b, s, e, t);
 }
 
-template<typename LF>
-void process_listfile(std::ifstream &infile, TString filename, bool optverbose)
+//v0/v1 listfile: sections, the events with a header per subevent. SINK is
+//the lambdasink of process_listfile, its calls are inlined.
+template<typename LF, typename SINK>
+void read_sections(listreader &infile, bool optverbose, SINK &sink)
 {
     using namespace listfile;
 
     bool continueReading = true;
-    bool SCPon = 0;
-    bool QDCon = 0;
-    int counter = 0;
-    int pu = 0;
-    int ov = 0;
-    int chn = 0;
-    int data = 0;
-    int time = 0;
-    int extended = 0;
-    int sig = 0;
-    
-    TString rootfilename = filename;
-    rootfilename.ReplaceAll("mvmelst","root");
-    rootfilename.ReplaceAll("listfiles","data_root");
-    cout << "Root file name: " << rootfilename << endl;
-    TFile *rootfile = new TFile(rootfilename, "RECREATE");
-    logfile readlog(filename);
-    mdpp16_SCP rootdata_SCP(filename);
-    mdpp16_QDC rootdata_QDC(filename);
+    std::vector<char> scratch;  //subevents across a read block boundary
 
     while (continueReading)
     {
@@ -279,28 +428,12 @@ void process_listfile(std::ifstream &infile, TString filename, bool optverbose)
                 {
                     if (optverbose)
                         cout << "Config section of size " << sectionSize << endl;
-                    infile.seekg(sectionSize * sizeof(u32), std::ifstream::cur);
+                    infile.skip(sectionSize * sizeof(u32));
                 } break;
 
             case SectionType_Event:
                 {
-                    if (optverbose){
-                        cout << "Event " << counter << endl;
-                    }
-                    else{
-                        if (counter%10000==0){
-                            cout << '\r' << "Processing event " << counter;
-                        }
-                    }
-                    rootdata_SCP.initEvent();
-                    rootdata_QDC.initEvent();
-                    pu = 0;
-                    ov = 0;
-                    chn = 0;
-                    data = 0;
-                    time = 0;
-                    extended = 0;
-                    sig = 0;
+                    sink.beginEvent();
 
                     u32 eventType = (sectionHeader & LF::EventTypeMask) >> LF::EventTypeShift;
                     if (optverbose){
@@ -325,107 +458,11 @@ void process_listfile(std::ifstream &infile, TString filename, bool optverbose)
                                    subEventSize);
                         }
 
-                        for (u32 i=0; i<subEventSize; ++i)
-                        {
-                            u32 subEventData;
-                            infile.read((char *)&subEventData, sizeof(u32));
-
-                            if (optverbose)
-                                printf("    %2u = 0x%08x\n", i, subEventData);
-
-                            if (subEventData == 0xffffffff){
-                                if (optverbose)
-                                    cout << "\tFill" << endl;
-                            }
-                            else{
-                                //Check for MDPP-16 SCP/RCP
-                                if (moduleType==0) moduleType=4;
-                                if ((moduleType==4)||(moduleType==7)){
-                                    SCPon = 1;
-                                    sig = bitExtractor(subEventData, 4, 28);
-                                    if (sig==4){ //header
-                                        if (optverbose)
-                                            cout << "\tHeader" << endl;
-                                    }
-                                    else if (sig==1){//data
-                                        //MDPP16 with SCP or RCP firmware
-                                        chn = bitExtractor(subEventData, 6, 16);
-                                        data = bitExtractor(subEventData, 16, 0);
-                                        rootdata_SCP.setADC(chn, data);
-
-                                        if (chn<16){
-                                            pu = bitExtractor(subEventData, 1, 23);
-                                            ov = bitExtractor(subEventData, 1, 22);
-                                            rootdata_SCP.setPileup(chn, pu);
-                                            rootdata_SCP.setOverflow(chn, ov);
-                                        }
-                                        //if ((chn==32)||(chn==33)){
-                                        //    rootdata_SCP.setTrigger(chn%32, data);
-                                       // }
-                                        if (optverbose){
-                                            cout << "\tData" << endl;
-                                            cout << "\t" << ov << "\t" 
-                                                 << chn << "\t" << data << endl;
-                                        }
-                                    }
-                                    else if(sig==2){//extended time stamp
-                                        extended = bitExtractor(subEventData, 16, 0);
-                                        rootdata_SCP.setExtendedTime(extended);
-                                        if (optverbose)
-                                            cout << "\tExtended time stamp:\t" << extended << endl;
-                                    }
-                                    else if(sig>=12){//end of event
-                                        time = bitExtractor(subEventData, 30, 0);
-                                        rootdata_SCP.setTime(time);
-                                        if (optverbose){
-                                            cout << "\tEnd of event" << endl;
-                                            cout << "\tTime:\t" << time << endl;
-                                        }
-                                    }
-                                }
-                                //MDPP16 with QDC
-                                if (moduleType==8){
-                                    QDCon = 1;
-                                    sig = bitExtractor(subEventData, 4, 28);
-                                    if (sig==4){ //header
-                                        if (optverbose)
-                                            cout << "\tHeader" << endl;
-                                    }
-                                    else if (sig==1){//data
-                                        chn = bitExtractor(subEventData, 6, 16);
-                                        data = bitExtractor(subEventData, 16, 0);
-                                        rootdata_QDC.setADC(chn, data);
-
-                                        if (chn<16){
-                                            ov = bitExtractor(subEventData, 1, 22);
-                                            rootdata_QDC.setOverflow(chn, ov);
-                                        }
-                                        //if ((chn==32)||(chn==33)){
-                                        //    rootdata_QDC.setTrigger(chn%32, data);
-                                        //}
-                                    }
-                                    if (optverbose){
-                                        cout << "\tData" << endl;
-                                        cout << "\t" << ov << "\t" 
-                                             << chn << "\t" << data << endl;
-                                    }
-                                    else if(sig==2){//extended time stamp
-                                        extended = bitExtractor(subEventData, 16, 0);
-                                        rootdata_QDC.setExtendedTime(extended);
-                                        if (optverbose)
-                                            cout << "\tExtended time stamp:\t" << extended << endl;
-                                    }
-                                    else if(sig>=12){//end of event
-                                        time = bitExtractor(subEventData, 30, 0);
-                                        rootdata_QDC.setTime(time);
-                                        if (optverbose){
-                                            cout << "\tEnd of event" << endl;
-                                            cout << "\tTime:\t" << time << endl;
-                                        }
-                                    }
-                                }
-                            }
-                        }
+                        if (moduleType==0) moduleType=4;
+
+                        //the whole subevent in place
+                        const u32 *data = (const u32 *)infile.view(subEventSize * sizeof(u32), scratch);
+                        sink.subEvent(moduleType, data, subEventSize);
                         wordsLeft -= subEventSize;
                     }
 
@@ -433,13 +470,12 @@ void process_listfile(std::ifstream &infile, TString filename, bool optverbose)
                     infile.read((char *)&eventEndMarker, sizeof(u32));
                     if (optverbose)
                         printf("   eventEndMarker=0x%08x\n", eventEndMarker);
-                    rootdata_QDC.writeEvent();
-                    rootdata_SCP.writeEvent();
-                    counter++;
+                    sink.endEvent(eventType, 1);
                 } break;
 
             case SectionType_Timetick:
                 {
+                    sink.timetick();
                     if (optverbose)
                         printf("Timetick\n");
                 } break;
@@ -449,9 +485,9 @@ void process_listfile(std::ifstream &infile, TString filename, bool optverbose)
                     printf("\nFound Listfile End section\n");
                     continueReading = false;
 
-                    auto currentFilePos = infile.tellg();
-                    infile.seekg(0, std::ifstream::end);
-                    auto endFilePos = infile.tellg();
+                    auto currentFilePos = infile.tell();
+                    infile.drain();
+                    auto endFilePos = infile.size();
 
                     if (currentFilePos != endFilePos)
                     {
@@ -466,165 +502,1130 @@ void process_listfile(std::ifstream &infile, TString filename, bool optverbose)
                 {
                     printf("Warning: Unknown section type %u of size %u, skipping...\n",
                            sectionType, sectionSize);
-                    infile.seekg(sectionSize * sizeof(u32), std::ifstream::cur);
+                    infile.skip(sectionSize * sizeof(u32));
                 } break;
         }
     }
-    cout << counter << " events total" << endl;
+}
 
-    rootfile->cd();
-    if(SCPon){
-        rootdata_SCP.writeTree();
-        rootfile->mkdir("histos_SCP");
-        rootfile->cd("histos_SCP");
-        rootdata_SCP.writeHistos();
+//listname names the root file, filename is where the listfile is read from
+//(a zip is unpacked elsewhere), analysis.analysis and messages.log are
+//looked for next to it
+void process_listfile(listreader &infile, TString listname, TString filename, const options &opt)
+{
+    using namespace listfile;
+
+    //MVLC listfiles start with MVLC_USB or MVLC_ETH, mvme listfiles from
+    //version 1 and up with the fourCC MVME and the version
+    u32 fileVersion = 0;
+    char magic[mvlc::MagicSize] = {};
+    infile.peek(magic, mvlc::MagicSize);
+    int mvlcformat = mvlcreader::format(magic);
+
+    if (mvlcformat)
+    {
+        cout << "Detected " << TString(magic, mvlc::MagicSize).Data() << " listfile" << endl;
     }
-    rootfile->cd();
-    if(QDCon){
-        rootdata_QDC.writeTree();
-        rootfile->mkdir("histos_QDC");
-        rootfile->cd("histos_QDC");
-        rootdata_QDC.writeHistos();
+    else
+    {
+        static const char * const FourCC = "MVME";
+
+        if (std::strncmp(magic, FourCC, 4) == 0)
+        {
+            infile.skip(4);
+            infile.read(reinterpret_cast<char *>(&fileVersion), sizeof(fileVersion));
+        }
+
+        // Move to the start of the first section
+        auto firstSectionOffset = ((fileVersion == 0)
+                                   ? listfile_v0::FirstSectionOffset
+                                   : listfile_v1::FirstSectionOffset);
+
+        infile.skip(firstSectionOffset - infile.tell());
+
+        cout << "Detected listfile version " << fileVersion << endl;
+    }
+
+    bool optverbose = opt.verbose;
+    bool SCPon = 0;
+    bool QDCon = 0;
+    bool MDPP32on = 0;
+    bool MADCon = 0;
+    bool MQDCon = 0;
+    bool MTDCon = 0;
+    bool MDPP32warned = 0;
+    u32 SCPmodule = 0;  //module type of the SCP/QDC subevent in this event
+    u32 QDCmodule = 0;
+    u32 MDPP32module = 0;
+    int counter = 0;
+    Long64_t kept = 0;  //events written to the trees of this root file
+    Long64_t lost = 0;  //events of this root file with lost data
+
+    TString rootfilename = listname;
+    rootfilename.ReplaceAll("mvmelst","root");
+    rootfilename.ReplaceAll("listfiles","data_root");
+    if (!opt.output.IsNull())
+        rootfilename = opt.output;
+    //a listfile from stdin has no directory, analysis.analysis and
+    //messages.log are looked for next to the root file
+    if (filename == "-")
+        filename = rootfilename;
+    TString streambase = rootfilename;
+    if (streambase.EndsWith(".root"))
+        streambase.Remove(streambase.Length()-5);
+
+    //--roll: NAME_partNNN.root, each with its own trees and histograms
+    bool rolling = (opt.rollevents>0)||(opt.rollbytes>0)||(opt.rollseconds>0);
+    std::vector<TString> parts;
+    int part = 0;
+    int partevent = 0;      //first event of the part
+    int ticks = 0;          //seconds of run time
+    int partticks = 0;      //first second of the part
+    if (rolling)
+        rootfilename = Form("%s_part%03i.root", streambase.Data(), part);
+    cout << "Root file name: " << rootfilename << endl;
+    TFile *rootfile = new TFile(rootfilename, "RECREATE");
+    parts.push_back(rootfilename);
+
+    //--split-events: trees of each event type in NAME_evN.root
+    std::unique_ptr<eventstream> streams[16];
+    int mdpp32mode = (opt.mdpp32 == "scp") ? 1 : (opt.mdpp32 == "qdc") ? 2 : 0;
+    logfile readlog(filename);
+    mdpp16_SCP rootdata_SCP(filename);
+    mdpp16_QDC rootdata_QDC(filename, opt.psdsparse, opt.psdhist);
+
+    //the firmware of an MDPP-32 is not in the data, it is given with --mdpp32
+    mdpp32_SCP *rootdata_SCP32 = 0;
+    mdpp32_QDC *rootdata_QDC32 = 0;
+    if (opt.mdpp32 == "scp")
+        rootdata_SCP32 = new mdpp32_SCP(filename);
+    else if (opt.mdpp32 == "qdc")
+        rootdata_QDC32 = new mdpp32_QDC(filename, opt.psdsparse, opt.psdhist);
+    madc32 rootdata_MADC(optverbose);
+    mqdc32 rootdata_MQDC(optverbose);
+    mtdc32 rootdata_MTDC(optverbose);
+
+    //decoder of each module type, 0 for types that are skipped
+    mdpp_decoder<mdpp16_SCP, decode_SCP<mdpp16_SCP> > decoder_SCP(rootdata_SCP, optverbose);
+    mdpp_decoder<mdpp16_QDC, decode_QDC<mdpp16_QDC> > decoder_QDC(rootdata_QDC, optverbose);
+    std::unique_ptr<subeventdecoder> decoder_MDPP32;
+    if (rootdata_SCP32)
+        decoder_MDPP32.reset(new mdpp_decoder<mdpp32_SCP, decode_SCP<mdpp32_SCP> >(*rootdata_SCP32, optverbose));
+    if (rootdata_QDC32)
+        decoder_MDPP32.reset(new mdpp_decoder<mdpp32_QDC, decode_QDC<mdpp32_QDC> >(*rootdata_QDC32, optverbose));
+    subeventdecoder *decoders[256] = {0};
+    decoders[MADC32] = &rootdata_MADC;
+    decoders[MQDC32] = &rootdata_MQDC;
+    decoders[MTDC32] = &rootdata_MTDC;
+    decoders[MDPP16_SCP] = &decoder_SCP;
+    decoders[MDPP16_RCP] = &decoder_SCP;
+    decoders[MDPP16_QDC] = &decoder_QDC;
+    decoders[MDPP32] = decoder_MDPP32.get();
+
+    if (opt.select)
+        opt.select->clearVariables();
+    setup_module(rootdata_SCP, opt);
+    setup_module(rootdata_QDC, opt);
+    if (rootdata_SCP32)
+        setup_module(*rootdata_SCP32, opt);
+    if (rootdata_QDC32)
+        setup_module(*rootdata_QDC32, opt);
+    setup_mxdc(rootdata_MADC, opt);
+    setup_mxdc(rootdata_MQDC, opt);
+    setup_mxdc(rootdata_MTDC, opt);
+    if (opt.select){
+        if (opt.select->bind())
+            throw std::runtime_error("invalid selection");
+        opt.select->resetCounters();
+    }
+
+    //rates per timetick, written to the timeticks directory of each part
+    tickseries ticklog(opt.maxseconds);
+    int tick_SCP = ticklog.addModule(mdpp16_SCP::label(), mdpp16_SCP::num_chn);
+    int tick_QDC = ticklog.addModule(mdpp16_QDC::label(), mdpp16_QDC::num_chn);
+    int tick_MDPP32 = 0;
+    if (rootdata_SCP32)
+        tick_MDPP32 = ticklog.addModule(mdpp32_SCP::label(), mdpp32_SCP::num_chn);
+    if (rootdata_QDC32)
+        tick_MDPP32 = ticklog.addModule(mdpp32_QDC::label(), mdpp32_QDC::num_chn);
+    int tick_MADC = ticklog.addModule(madc32::label(), madc32::num_chn);
+    int tick_MQDC = ticklog.addModule(mqdc32::label(), mqdc32::num_chn);
+    int tick_MTDC = ticklog.addModule(mtdc32::label(), mtdc32::num_chn);
+
+    //--arrow: NAME_SCP.arrow, ... next to the root file of each part
+    std::unique_ptr<arrowwriter> arrow_SCP, arrow_QDC, arrow_MDPP32;
+    auto open_arrow = [&](){
+        if (!opt.arrow)
+            return;
+        TString base = rootfilename;
+        if (base.EndsWith(".root"))
+            base.Remove(base.Length()-5);
+        bool sparse = (opt.arrow==2);
+        arrow_SCP.reset(new arrowwriter(Form("%s_%s.arrow", base.Data(), mdpp16_SCP::label()), 16, 0, sparse));
+        arrow_QDC.reset(new arrowwriter(Form("%s_%s.arrow", base.Data(), mdpp16_QDC::label()), 16, 1, sparse));
+        if (rootdata_SCP32)
+            arrow_MDPP32.reset(new arrowwriter(Form("%s_%s.arrow", base.Data(), mdpp32_SCP::label()), 32, 0, sparse));
+        if (rootdata_QDC32)
+            arrow_MDPP32.reset(new arrowwriter(Form("%s_%s.arrow", base.Data(), mdpp32_QDC::label()), 32, 1, sparse));
+    };
+    open_arrow();
+
+    //--dump: NAME.csv or NAME.jsonl, one for the whole listfile
+    std::unique_ptr<textdump> dump;
+    int dump_SCP = 0, dump_QDC = 0, dump_MDPP32 = 0;
+    if (opt.dump){
+        const char *ext = (opt.dump==textdump::CSV) ? "csv" : "jsonl";
+        dump.reset(new textdump(Form("%s.%s", streambase.Data(), ext), opt.dump, opt.dumpthreads));
+        dump_SCP = dump->addModule(mdpp16_SCP::label(), 0);
+        dump_QDC = dump->addModule(mdpp16_QDC::label(), 1);
+        if (rootdata_SCP32)
+            dump_MDPP32 = dump->addModule(mdpp32_SCP::label(), 0);
+        if (rootdata_QDC32)
+            dump_MDPP32 = dump->addModule(mdpp32_QDC::label(), 1);
+    }
+
+    //--catalog: one line for the root file just closed
+    TString analysisname = filename;
+    analysisname.Remove(analysisname.Last('/')+1, analysisname.Sizeof());
+    analysisname.Append("analysis.analysis");
+    auto catalog_part = [&](){
+        runcatalog::entry e;
+        e.file = rootfilename;
+        e.listfile = listname;
+        e.part = part;
+        e.start = readlog.getStart();
+        e.stop = readlog.getStop();
+        e.seconds = ticks-partticks;
+        e.events = counter-partevent;
+        e.kept = kept;
+        e.lost = lost;
+        const char *names[] = {"SCP", "QDC", rootdata_QDC32 ? "QDC32" : "SCP32", "MADC32", "MQDC32", "MTDC32"};
+        bool on[] = {SCPon, QDCon, MDPP32on && (rootdata_SCP32 || rootdata_QDC32), MADCon, MQDCon, MTDCon};
+        for (int i=0; i<6; i++){
+            if (!on[i])
+                continue;
+            if (!e.modules.IsNull())
+                e.modules += "|";
+            e.modules += names[i];
+        }
+        e.calibrated = (access(analysisname.Data(), R_OK)==0);
+        e.converted = time(0);
+        runcatalog catalog(opt.catalog);
+        catalog.append(e);
+    };
+
+    //write and close the current root file, this deletes its trees and
+    //histograms
+    auto close_part = [&](){
+        if (opt.arrow){
+            arrow_SCP->finish();
+            arrow_QDC->finish();
+            if (arrow_MDPP32)
+                arrow_MDPP32->finish();
+        }
+        bool tree = opt.tree && !opt.split;
+        if(SCPon)
+            write_module(rootfile, rootdata_SCP, tree);
+        if(QDCon)
+            write_module(rootfile, rootdata_QDC, tree);
+        if(MDPP32on && rootdata_SCP32)
+            write_module(rootfile, *rootdata_SCP32, tree);
+        if(MDPP32on && rootdata_QDC32)
+            write_module(rootfile, *rootdata_QDC32, tree);
+        if(MADCon)
+            write_module(rootfile, rootdata_MADC, tree);
+        if(MQDCon)
+            write_module(rootfile, rootdata_MQDC, tree);
+        if(MTDCon)
+            write_module(rootfile, rootdata_MTDC, tree);
+        rootfile->mkdir("timeticks");
+        rootfile->cd("timeticks");
+        ticklog.write();
+        rootfile->cd();
+        if (rolling){
+            write_part_info(part, partevent, counter-1, partticks, ticks);
+            write_part_index(streambase, parts);
+        }
+        rootfile->Write();
+        rootfile->Close();
+        delete rootfile;
+        if (!opt.catalog.IsNull())
+            catalog_part();
+    };
+
+    auto begin_event = [&](){
+        //--roll: close the part before the event that is over a limit
+        if (rolling && (counter>partevent) &&
+            (((opt.rollevents>0)&&(counter-partevent>=opt.rollevents)) ||
+             ((opt.rollbytes>0)&&(rootfile->GetBytesWritten()>=opt.rollbytes)) ||
+             ((opt.rollseconds>0)&&(ticks-partticks>=opt.rollseconds))))
+        {
+            if (opt.live)
+                opt.live->detach();
+            close_part();
+            part++;
+            partevent = counter;
+            kept = 0;
+            lost = 0;
+            partticks = ticks;
+            rootfilename = Form("%s_part%03i.root", streambase.Data(), part);
+            cout << "\nRoot file name: " << rootfilename << endl;
+            rootfile = new TFile(rootfilename, "RECREATE");
+            parts.push_back(rootfilename);
+            open_arrow();
+            ticklog.nextFile();
+            rootfile->cd();
+            readlog.writeTimes();
+            rootdata_SCP.nextFile();
+            rootdata_QDC.nextFile();
+            if (rootdata_SCP32)
+                rootdata_SCP32->nextFile();
+            if (rootdata_QDC32)
+                rootdata_QDC32->nextFile();
+            rootdata_MADC.nextFile();
+            rootdata_MQDC.nextFile();
+            rootdata_MTDC.nextFile();
+            if (opt.live){
+                rootdata_SCP.attachLive(opt.live);
+                rootdata_QDC.attachLive(opt.live);
+                if (rootdata_SCP32)
+                    rootdata_SCP32->attachLive(opt.live);
+                if (rootdata_QDC32)
+                    rootdata_QDC32->attachLive(opt.live);
+                rootdata_MADC.attachLive(opt.live);
+                rootdata_MQDC.attachLive(opt.live);
+                rootdata_MTDC.attachLive(opt.live);
+            }
+        }
+
+        if (optverbose){
+            cout << "Event " << counter << endl;
+        }
+        else{
+            if (counter%10000==0){
+                cout << '\r' << "Processing event " << counter;
+            }
+        }
+        rootdata_SCP.initEvent();
+        rootdata_QDC.initEvent();
+        if (rootdata_SCP32)
+            rootdata_SCP32->initEvent();
+        if (rootdata_QDC32)
+            rootdata_QDC32->initEvent();
+        if (MADCon)
+            rootdata_MADC.initEvent();
+        if (MQDCon)
+            rootdata_MQDC.initEvent();
+        if (MTDCon)
+            rootdata_MTDC.initEvent();
+        SCPmodule = 0;
+        QDCmodule = 0;
+        MDPP32module = 0;
+        if (dump)
+            dump->beginEvent(counter, ticks);
+    };
+
+    auto sub_event = [&](u32 moduleType, const u32 *data, u32 nwords){
+        if (dump)
+            dump->subEvent(moduleType, data, nwords);
+        if ((moduleType==MDPP32)&&(!rootdata_SCP32)&&(!rootdata_QDC32)&&(!MDPP32warned)){
+            cout << "\nSkipping MDPP-32 data, give the firmware with --mdpp32 scp|qdc" << endl;
+            MDPP32warned = 1;
+        }
+
+        //the MxDC-32 trees are only filled once a module was seen,
+        //with empty entries for the events before
+        if ((moduleType==MADC32)&&(!MADCon)){
+            MADCon = 1;
+            rootdata_MADC.fillEmpty(kept);
+        }
+        else if ((moduleType==MQDC32)&&(!MQDCon)){
+            MQDCon = 1;
+            rootdata_MQDC.fillEmpty(kept);
+        }
+        else if ((moduleType==MTDC32)&&(!MTDCon)){
+            MTDCon = 1;
+            rootdata_MTDC.fillEmpty(kept);
+        }
+
+        subeventdecoder *decoder = decoders[moduleType & 0xff];
+        if (decoder){
+            if (decoder->decode(data, nwords)>0){
+                switch (moduleType){
+                    case MDPP16_SCP:
+                    case MDPP16_RCP:
+                        SCPon = 1;
+                        SCPmodule = moduleType;
+                        break;
+                    case MDPP16_QDC:
+                        QDCon = 1;
+                        QDCmodule = moduleType;
+                        break;
+                    case MDPP32:
+                        MDPP32on = 1;
+                        MDPP32module = moduleType;
+                        break;
+                }
+            }
+        }
+        else if (optverbose){
+            for (u32 i=0; i<nwords; ++i)
+                printf("    %2u = 0x%08x\n", i, data[i]);
+        }
+    };
+
+    auto end_event = [&](u32 eventType, bool complete){
+        //events with lost data are counted but not written
+        ticklog.event();
+        if (!complete){
+            ticklog.lost();
+            lost++;
+            if (dump)
+                dump->endEvent(eventType, 0);
+            counter++;
+            return;
+        }
+        rootdata_QDC.endEvent();
+        rootdata_SCP.endEvent();
+        if (rootdata_SCP32)
+            rootdata_SCP32->endEvent();
+        if (rootdata_QDC32)
+            rootdata_QDC32->endEvent();
+        if (MADCon)
+            rootdata_MADC.endEvent();
+        if (MQDCon)
+            rootdata_MQDC.endEvent();
+        if (MTDCon)
+            rootdata_MTDC.endEvent();
+        ticklog.hits(tick_SCP, rootdata_SCP.getHitmask());
+        ticklog.hits(tick_QDC, rootdata_QDC.getHitmask());
+        if (rootdata_SCP32)
+            ticklog.hits(tick_MDPP32, rootdata_SCP32->getHitmask());
+        if (rootdata_QDC32)
+            ticklog.hits(tick_MDPP32, rootdata_QDC32->getHitmask());
+        if (MADCon)
+            ticklog.hits(tick_MADC, rootdata_MADC.getHitmask());
+        if (MQDCon)
+            ticklog.hits(tick_MQDC, rootdata_MQDC.getHitmask());
+        if (MTDCon)
+            ticklog.hits(tick_MTDC, rootdata_MTDC.getHitmask());
+        if (dump){
+            if (SCPmodule)
+                dump_module(dump.get(), dump_SCP, rootdata_SCP);
+            if (QDCmodule)
+                dump_module(dump.get(), dump_QDC, rootdata_QDC);
+            if (MDPP32module && rootdata_SCP32)
+                dump_module(dump.get(), dump_MDPP32, *rootdata_SCP32);
+            if (MDPP32module && rootdata_QDC32)
+                dump_module(dump.get(), dump_MDPP32, *rootdata_QDC32);
+            dump->endEvent(eventType, 1);
+        }
+        if (opt.select && !opt.select->accept()){
+            if (opt.live)
+                opt.live->update();
+            counter++;
+            return;
+        }
+        rootdata_QDC.writeEvent();
+        rootdata_SCP.writeEvent();
+        if (rootdata_SCP32)
+            rootdata_SCP32->writeEvent();
+        if (rootdata_QDC32)
+            rootdata_QDC32->writeEvent();
+        if (MADCon)
+            rootdata_MADC.writeEvent();
+        if (MQDCon)
+            rootdata_MQDC.writeEvent();
+        if (MTDCon)
+            rootdata_MTDC.writeEvent();
+        kept++;
+        ticklog.kept();
+
+        //hand the event to the writer of its event type
+        if (opt.split){
+            std::unique_ptr<eventstream> &stream = streams[eventType];
+            if (!stream)
+                stream.reset(new eventstream(Form("%s_ev%u.root", streambase.Data(), eventType),
+                                             filename, opt.psdsparse, mdpp32mode,
+                                             rootdata_SCP, rootdata_SCP32));
+            shmrecord *rec = stream->claim();
+            rootdata_SCP.fillRecord(&rec[eventstream::SlotSCP]);
+            rootdata_QDC.fillRecord(&rec[eventstream::SlotQDC]);
+            if (rootdata_SCP32)
+                rootdata_SCP32->fillRecord(&rec[eventstream::SlotMDPP32]);
+            if (rootdata_QDC32)
+                rootdata_QDC32->fillRecord(&rec[eventstream::SlotMDPP32]);
+            //the MxDC-32 trees of the stream start with the module
+            if (MADCon)
+                rootdata_MADC.fillRecord(&rec[eventstream::SlotMADC]);
+            else
+                rec[eventstream::SlotMADC].module = 0;
+            if (MQDCon)
+                rootdata_MQDC.fillRecord(&rec[eventstream::SlotMQDC]);
+            else
+                rec[eventstream::SlotMQDC].module = 0;
+            if (MTDCon)
+                rootdata_MTDC.fillRecord(&rec[eventstream::SlotMTDC]);
+            else
+                rec[eventstream::SlotMTDC].module = 0;
+            stream->commit();
+        }
+
+        //publish to online consumers
+        if (opt.shm){
+            if (SCPmodule)
+                publish_event(opt, rootdata_SCP, SCPmodule, eventType, counter);
+            if (QDCmodule)
+                publish_event(opt, rootdata_QDC, QDCmodule, eventType, counter);
+            if (MDPP32module && rootdata_SCP32)
+                publish_event(opt, *rootdata_SCP32, MDPP32module, eventType, counter);
+            if (MDPP32module && rootdata_QDC32)
+                publish_event(opt, *rootdata_QDC32, MDPP32module, eventType, counter);
+        }
+        //columns for tools without ROOT
+        if (opt.arrow){
+            if (SCPmodule)
+                append_arrow(arrow_SCP.get(), rootdata_SCP, eventType, counter, ticks);
+            if (QDCmodule)
+                append_arrow(arrow_QDC.get(), rootdata_QDC, eventType, counter, ticks);
+            if (MDPP32module && rootdata_SCP32)
+                append_arrow(arrow_MDPP32.get(), *rootdata_SCP32, eventType, counter, ticks);
+            if (MDPP32module && rootdata_QDC32)
+                append_arrow(arrow_MDPP32.get(), *rootdata_QDC32, eventType, counter, ticks);
+        }
+        if (opt.live)
+            opt.live->update();
+        counter++;
+    };
+
+    auto timetick = [&](){
+        ticks++;
+        ticklog.tick();
+    };
+
+    auto sink = make_sink(begin_event, sub_event, end_event, timetick);
+    if (mvlcformat)
+    {
+        mvlcreader reader(infile, opt.mvlcmodules, optverbose);
+        reader.read(sink);
+    }
+    else if (fileVersion == 0)
+    {
+        read_sections<listfile_v0>(infile, optverbose, sink);
+    }
+    else
+    {
+        read_sections<listfile_v1>(infile, optverbose, sink);
     }
 
-    rootfile->Write();
-    rootfile->Close();
+    cout << counter << " events total" << endl;
+    if (opt.select)
+        opt.select->printCounters();
+    if (opt.live)
+        opt.live->detach();
+    close_part();
+    if (dump){
+        dump->finish();
+        cout << "Dumped " << dump->events() << " events" << endl;
+    }
+    for (int i=0; i<16; i++){
+        if (streams[i])
+            streams[i]->finish(SCPon, QDCon, MDPP32on);
+    }
+    delete rootdata_SCP32;
+    delete rootdata_QDC32;
 }
 
-void process_listfile(std::ifstream &infile, TString filename, bool optverbose)
+//peak resident memory of the process so far in bytes
+size_t peak_memory()
 {
-    u32 fileVersion = 0;
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return (size_t)usage.ru_maxrss*1024;
+}
 
-    // Read the fourCC that's at the start of listfiles from version 1 and up.
-    const size_t bytesToRead = 4;
-    char fourCC[bytesToRead] = {};
+//split --max-memory between the listreaders, the shared memory ring and
+//the modules. What is resident before the first file (mostly the ROOT
+//libraries) is taken off the top.
+void set_memory_budget(options &opt)
+{
+    const size_t MB = 1024*1024;
+    size_t baseline = peak_memory();
+    size_t avail = (opt.maxmemory>baseline) ? opt.maxmemory-baseline : 0;
 
-    infile.read(fourCC, bytesToRead);
-    static const char * const FourCC = "MVME";
+    if (!opt.shmname.IsNull()){
+        size_t ring = (size_t)opt.shmslots*sizeof(shmrecord);
+        avail = (avail>ring) ? avail-ring : 0;
+    }
 
-    if (std::strncmp(fourCC, FourCC, bytesToRead) == 0)
-    {
-        infile.read(reinterpret_cast<char *>(&fileVersion), sizeof(fileVersion));
+    //an eighth for reading, shared by the current and the prefetched file
+    opt.readdepth = 4;
+    opt.readblock = (avail/16/opt.readdepth) & ~(64*1024-1);
+    if (opt.readblock>4*MB) opt.readblock = 4*MB;
+    if (opt.readblock<256*1024) opt.readblock = 256*1024;
+    size_t readbytes = 2*opt.readdepth*opt.readblock;
+    avail = (avail>readbytes) ? avail-readbytes : 0;
+
+    //the hits per second of the timeticks, at their longest
+    size_t hitbytes = tickseries::maxBytes(16, opt.maxseconds)*2;
+    if (!opt.mdpp32.IsNull())
+        hitbytes += tickseries::maxBytes(32, opt.maxseconds);
+    avail = (avail>hitbytes) ? avail-hitbytes : 0;
+
+    //the rest is shared by the modules, the MADC-32, MQDC-32 and MTDC-32
+    //split one share between them
+    int nmodules = opt.mdpp32.IsNull() ? 3 : 4;
+    opt.modulememory = avail/nmodules;
+    if (opt.modulememory<8*MB){
+        cerr << "Warning: --max-memory " << opt.maxmemory/MB << " MB leaves only "
+             << avail/MB << " MB above the " << baseline/MB
+             << " MB already in use, the budget will likely be exceeded" << endl;
+        opt.modulememory = 8*MB;
     }
+    cout << "Memory budget: " << opt.maxmemory/MB << " MB, " << baseline/MB << " MB in use, "
+         << readbytes/MB << " MB for reading, " << hitbytes/MB << " MB for the hit rates, "
+         << opt.modulememory/MB << " MB per module ("
+         << opt.modulememory/3/MB << " MB per MxDC-32 module)" << endl;
+}
 
-    // Move to the start of the first section
-    auto firstSectionOffset = ((fileVersion == 0)
-                               ? listfile_v0::FirstSectionOffset
-                               : listfile_v1::FirstSectionOffset);
+//delete a directory and everything in it
+static int remove_entry(const char *path, const struct stat *, int, struct FTW *)
+{
+    return remove(path);
+}
 
-    infile.seekg(firstSectionOffset, std::ifstream::beg);
+void remove_dir(TString dir)
+{
+    if (nftw(dir.Data(), remove_entry, 16, FTW_DEPTH | FTW_PHYS)!=0)
+        cerr << "Error removing " << dir.Data() << ": " << std::strerror(errno) << endl;
+}
 
-    cout << "Detected listfile version " << fileVersion << endl;
+//convert one .mvmelst or .zip file, returns 0 on success. reader is the
+//reader prefetched for this file or 0; on return it is the one started for
+//next (the following file of the batch) or 0.
+int convert_file(TString arg, int fileindex, const options &opt, listreader *&reader, TString next)
+{
+    cout << "----- Processing " << arg.Data() << " -----" << endl;
+
+    TString filename = arg;
+    TString dir = arg;
+    int index = dir.Last('/');
+    dir.Remove(index+1,dir.Sizeof());
+
+    listreader *prefetched = reader;
+    reader = 0;
+
+    //Unzip if zipfile is given, into a directory of its own next to the
+    //zip, so workers converting zips of the same directory never share or
+    //delete each other's analysis.analysis and messages.log
+    TString listname = arg;
+    TString unzipdir;
+    if (filename.EndsWith(".zip")){
+        cout << "----- Unzipping file " << filename.Data() << " -----" << endl;
+        listname.Remove(listname.Length()-3);
+        listname.Append("mvmelst");
+        TString tmpl = dir + ".mvme2root_unzip_XXXXXX";
+        std::vector<char> path(tmpl.Data(), tmpl.Data()+tmpl.Length()+1);
+        if (!mkdtemp(path.data())){
+            cerr << "Error creating a directory to unzip " << arg.Data() << " into: "
+                 << std::strerror(errno) << endl;
+            delete prefetched;
+            return 1;
+        }
+        unzipdir = path.data();
+        unzipdir.Append("/");
+        zipfile zip(arg);
+        if ((!zip.is_open())||(zip.extractAll(unzipdir))){
+            cerr << "Error unzipping " << arg.Data() << endl;
+            remove_dir(unzipdir);
+            delete prefetched;
+            return 1;
+        }
+
+        //the unzipped mvmelst file, named like the zip
+        filename = unzipdir + listname(index+1, listname.Length());
+        cout << "----- Unzip " << filename.Data() << " complete -----" << endl;
+    }
+
+    //open mvmelst file for reading, reuse the reader prefetched
+    //during the previous file if there is one
+    listreader *infile = prefetched;
+    if (!infile)
+        infile = new listreader(filename, opt.readblock, opt.readdepth);
 
-    if (fileVersion == 0)
+    if (!infile->is_open())
     {
-        process_listfile<listfile_v0>(infile, filename, optverbose);
+        cerr << "Error opening " << filename.Data() << " for reading: " 
+             << std::strerror(errno) << endl;
+        delete infile;
+        if (!unzipdir.IsNull())
+            remove_dir(unzipdir);
+        return 1;
     }
-    else
+    infile->start();
+
+    //start reading the next listfile of the batch while this one is
+    //decoded. Zip files are only unpacked when their turn comes.
+    if ((!next.IsNull())&&(!next.EndsWith(".zip"))){
+        reader = new listreader(next, opt.readblock, opt.readdepth);
+        reader->start();
+    }
+
+    //process mvmelst file
+    if (opt.shm)
+        opt.shm->setFile(fileindex);
+    int ret = 0;
+    try
     {
-        process_listfile<listfile_v1>(infile, filename, optverbose);
+        process_listfile(*infile, listname, filename, opt);
     }
+    catch (const std::exception &e)
+    {
+        cerr << "Error processing listfile: " << e.what() << endl;
+        ret = 1;
+    }
+    delete infile;
+
+    //clean up the unzipped mvme files (save space), the zip is kept
+    if (!unzipdir.IsNull()){
+        cout << "Removing " << unzipdir.Data() << endl;
+        remove_dir(unzipdir);
+    }
+    if (ret)
+        return 1;
+
+    cout << "----- " << arg.Data() << " complete -----" << endl;
+    return 0;
 }
 
 int main(int argc, char *argv[])
 {
-    bool optverbose = 0;
+    options opt;
+    TString selection;
+    TString queuedir;   //--queue: take the listfiles from this spool directory
+    TString enqueuedir; //--enqueue: add the listfiles to this spool directory
+    bool scan = 0;      //--scan: only check the listfiles, no conversion
+    TString querycatalog;   //--query: print the lines of this catalog that match
+    TString recalibrate;    //--recalibrate: analysis.analysis for converted files
+    TString mergeout;   //--merge: campaign summary of converted files
     int startindex = 1;
 
-    if (argc<2)
+    //parse options
+    while ((startindex<argc)&&(argv[startindex][0]=='-')&&(argv[startindex][1]!=0))
+    {
+        TString arg = argv[startindex];
+        if (arg == "-v") //verbose option
+        {
+            opt.verbose = 1;
+        }
+        else if ((arg == "--shm")&&(startindex+1<argc))
+        {
+            opt.shmname = argv[++startindex];
+        }
+        else if ((arg == "--shm-slots")&&(startindex+1<argc))
+        {
+            long slots = atol(argv[++startindex]);
+            if ((slots<1)||(slots>(long)ShmMaxSlots))
+            {
+                cerr << "--shm-slots needs 1 to " << ShmMaxSlots << " slots" << endl;
+                return 1;
+            }
+            opt.shmslots = slots;
+        }
+        else if ((arg == "-o")&&(startindex+1<argc))
+        {
+            opt.output = argv[++startindex];
+        }
+        else if (arg == "--shm-only")
+        {
+            opt.tree = 0;
+        }
+        else if ((arg == "--arrow")&&(startindex+1<argc))
+        {
+            TString layout = argv[++startindex];
+            if (layout == "dense") opt.arrow = 1;
+            else if (layout == "sparse") opt.arrow = 2;
+            else
+            {
+                cerr << "--arrow needs dense or sparse" << endl;
+                return 1;
+            }
+        }
+        else if ((arg == "--dump")&&(startindex+1<argc))
+        {
+            TString layout = argv[++startindex];
+            if (layout == "csv") opt.dump = textdump::CSV;
+            else if (layout == "json") opt.dump = textdump::JSON;
+            else
+            {
+                cerr << "--dump needs csv or json" << endl;
+                return 1;
+            }
+        }
+        else if ((arg == "--dump-threads")&&(startindex+1<argc))
+        {
+            opt.dumpthreads = atoi(argv[++startindex]);
+        }
+        else if (arg == "--arrow-only")
+        {
+            opt.tree = 0;
+        }
+        else if (arg == "--histos-only")
+        {
+            opt.tree = 0;
+            opt.histosonly = 1;
+        }
+        else if ((arg == "--http")&&(startindex+1<argc))
+        {
+            opt.httpport = atoi(argv[++startindex]);
+        }
+        else if ((arg == "--http-interval")&&(startindex+1<argc))
+        {
+            opt.httpinterval = atof(argv[++startindex]);
+        }
+        else if ((arg == "--select")&&(startindex+1<argc))
+        {
+            selection = argv[++startindex];
+        }
+        else if ((arg == "--mdpp32")&&(startindex+1<argc))
+        {
+            opt.mdpp32 = argv[++startindex];
+            opt.mdpp32.ToLower();
+            if ((opt.mdpp32 != "scp")&&(opt.mdpp32 != "qdc"))
+            {
+                cerr << "--mdpp32 needs scp or qdc" << endl;
+                return 1;
+            }
+        }
+        else if (arg == "--psd-sparse")
+        {
+            opt.psdsparse = 1;
+        }
+        else if (arg == "--psd-hist")
+        {
+            opt.psdhist = 1;
+        }
+        else if ((arg == "--2d")&&(startindex+1<argc))
+        {
+            TString list = argv[++startindex];
+            TString name;
+            Ssiz_t from = 0;
+            while (list.Tokenize(name, from, ","))
+            {
+                if (name == "adc-tdc") opt.spectra |= Spectrum_ADC_TDC;
+                else if (name == "adc-chn") opt.spectra |= Spectrum_ADC_chn;
+                else if (name == "all") opt.spectra |= Spectrum_ADC_TDC | Spectrum_ADC_chn;
+                else if (name == "rate")
+                {
+                    cerr << "--2d rate is gone, the hits per second and channel are always written"
+                         << " as timeticks/hHits_<module>" << endl;
+                    return 1;
+                }
+                else
+                {
+                    cerr << "Unknown 2D spectrum " << name.Data() << ", use adc-tdc, adc-chn or all" << endl;
+                    return 1;
+                }
+            }
+        }
+        else if ((arg == "--max-run-seconds")&&(startindex+1<argc))
+        {
+            long seconds = atol(argv[++startindex]);
+            if ((seconds<1)||(seconds>100*86400))
+            {
+                cerr << "--max-run-seconds needs 1 to " << 100*86400 << " seconds" << endl;
+                return 1;
+            }
+            opt.maxseconds = seconds;
+        }
+        else if ((arg == "--mvlc-modules")&&(startindex+1<argc))
+        {
+            //[event:]type,type,... in readout order, event 0 if not given
+            TString list = argv[++startindex];
+            int event = 0;
+            Ssiz_t colon = list.First(':');
+            if (colon != kNPOS)
+            {
+                event = TString(list(0, colon)).Atoi();
+                list.Remove(0, colon+1);
+            }
+            if ((event<0)||(event>=16))
+            {
+                cerr << "--mvlc-modules: event " << event << " is not 0 to 15" << endl;
+                return 1;
+            }
+            opt.mvlcmodules[event].clear();
+            TString name;
+            Ssiz_t from = 0;
+            while (list.Tokenize(name, from, ","))
+            {
+                u32 type = mvlcreader::moduleType(name.Data());
+                if (type == 0)
+                {
+                    cerr << "Unknown module type " << name.Data() << " in --mvlc-modules, use e.g."
+                         << " mdpp16_scp, mdpp16_rcp, mdpp16_qdc, mdpp32, madc32, mqdc32 or mtdc32" << endl;
+                    return 1;
+                }
+                opt.mvlcmodules[event].push_back(type);
+            }
+        }
+        else if (arg == "--split-events")
+        {
+            opt.split = 1;
+        }
+        else if (arg == "--scan")
+        {
+            scan = 1;
+        }
+        else if ((arg == "--catalog")&&(startindex+1<argc))
+        {
+            opt.catalog = argv[++startindex];
+        }
+        else if ((arg == "--query")&&(startindex+1<argc))
+        {
+            querycatalog = argv[++startindex];
+        }
+        else if ((arg == "--recalibrate")&&(startindex+1<argc))
+        {
+            recalibrate = argv[++startindex];
+        }
+        else if ((arg == "--merge")&&(startindex+1<argc))
+        {
+            mergeout = argv[++startindex];
+        }
+        else if ((arg == "--queue")&&(startindex+1<argc))
+        {
+            queuedir = argv[++startindex];
+        }
+        else if ((arg == "--enqueue")&&(startindex+1<argc))
+        {
+            enqueuedir = argv[++startindex];
+        }
+        else if ((arg == "--max-memory")&&(startindex+1<argc))
+        {
+            opt.maxmemory = atof(argv[++startindex])*1024*1024;
+        }
+        else if ((arg == "--roll")&&(startindex+1<argc))
+        {
+            //events, or a size with MB/GB, or run time with s/min/h
+            char *unit;
+            double value = strtod(argv[++startindex], &unit);
+            TString u = unit;
+            u.ToLower();
+            if (value<=0) u = "?";
+            if ((u == "")&&(value!=floor(value))) u = "?";   //events are whole
+            if (u == "") opt.rollevents = value;
+            else if (u == "mb") opt.rollbytes = value*1024*1024;
+            else if (u == "gb") opt.rollbytes = value*1024*1024*1024;
+            else if (u == "s") opt.rollseconds = value;
+            else if (u == "min") opt.rollseconds = value*60;
+            else if (u == "h") opt.rollseconds = value*3600;
+            else
+            {
+                cerr << "--roll needs a whole number of events, a size in MB or GB,"
+                     << " or a time in s, min or h" << endl;
+                return 1;
+            }
+        }
+        else
+        {
+            cerr << "Unknown option " << arg.Data() << endl;
+            argc = 0;
+            break;
+        }
+        startindex++;
+    }
+
+    //listfiles are given unless they come from a queue
+    bool havefiles = (startindex<argc);
+    if ((argc==0)||(havefiles == !queuedir.IsNull()))
     {
         cerr << "Invalid number of arguments" << endl;
-        cerr << "Usage: " << argv[0] << " [-v] <listfiles>" << endl;
+        cerr << "Usage: " << argv[0] << " [-v] [-o file.root] [--shm name [--shm-slots n] [--shm-only]]"
+             << " [--arrow dense|sparse [--arrow-only]] [--dump csv|json [--dump-threads n]]"
+             << " [--histos-only]"
+             << " [--http port [--http-interval s]] [--select expr] [--mdpp32 scp|qdc]"
+             << " [--psd-sparse] [--psd-hist] [--max-memory MB] [--2d list] [--max-run-seconds s]"
+             << " [--split-events] [--roll n|MB|GB|s|min|h] [--mvlc-modules [event:]types]"
+             << " [--catalog file.csv]"
+             << " <listfiles or - for stdin>" << endl;
+        cerr << "       " << argv[0] << " --scan <listfiles or directories, not MVLC>" << endl;
+        cerr << "       " << argv[0] << " --query catalog.csv <expr>" << endl;
+        cerr << "       " << argv[0] << " --recalibrate analysis.analysis <root files>" << endl;
+        cerr << "       " << argv[0] << " --merge summary.root <root files>" << endl;
+        cerr << "       " << argv[0] << " --enqueue spooldir <listfiles>" << endl;
+        cerr << "       " << argv[0] << " [options] --queue spooldir" << endl;
         return 1;
     }
-    
-    if (!strcmp(argv[1], "-v")) //verbose option
+
+    //statistics only, nothing ROOT is created
+    if (scan)
     {
-        optverbose = 1;
-        startindex++;
+        std::vector<std::string> paths(argv+startindex, argv+argc);
+        return (listscanner::scanAll(paths)>0);
     }
 
-    //loop over all given files
-    for (int file=startindex; file<argc; file++){
-        cout << "----- Processing " << argv[file] << " -----" << endl;
-
-        TString filename = argv[file];
-        TString dir = argv[file];
-        int index = dir.Last('/');
-        dir.Remove(index+1,dir.Sizeof());
-
-        //Unzip if zipfile is given
-        TString zipfilename = argv[file];
-        TString zipcommand = ".! unzip -o " + zipfilename;
-        if (filename.EndsWith(".zip")){
-            cout << "----- Unzipping file " << filename.Data() << " -----" << endl;
-            if (dir.Sizeof()>1)
-                zipcommand.Append(" -d " + dir);
-            cout << zipcommand.Data() << endl;
-            gROOT->ProcessLine(zipcommand.Data());
-
-            //change filename to point to unzipped mvmelst file
-            filename.Remove(filename.Sizeof()-4, filename.Sizeof());
-            filename.Append("mvmelst");
-            cout << "----- Unzip " << filename.Data() << " complete -----" << endl;
-        }
-        else{
-            zipfilename = "";
-        }
-
-        //open mvmelst file for reading
-        std::ifstream infile(filename.Data(), std::ios::binary);
+    //runs of the catalog, the root files are not opened
+    if (!querycatalog.IsNull())
+    {
+        TString expr;
+        for (int i=startindex; i<argc; i++)
+            expr += TString(i>startindex ? " " : "") + argv[i];
+        runcatalog catalog(querycatalog);
+        return (catalog.query(expr)<0);
+    }
 
-        if (!infile.is_open())
-        {
-            cerr << "Error opening " << filename.Data() << " for reading: " 
-                 << std::strerror(errno) << endl;
-            cout << argc-file << " files were not converted." << endl;
+    //new energies for converted files, the listfiles are not needed
+    if (!recalibrate.IsNull())
+    {
+        recalibrator recal(recalibrate);
+        if (!recal.is_open())
             return 1;
-        }
+        int ret = 0;
+        for (int file=startindex; file<argc; file++)
+            ret |= recal.recalibrate(argv[file]);
+        return ret;
+    }
 
-        infile.exceptions(std::ifstream::badbit | std::ifstream::failbit | std::ifstream::eofbit);
+    //campaign sums of converted files, the trees are not read
+    if (!mergeout.IsNull())
+    {
+        histmerger merger;
+        std::vector<TString> files(argv+startindex, argv+argc);
+        return merger.merge(mergeout, files);
+    }
 
-        //process mvmelst file
-        try
-        {
-            process_listfile(infile, filename, optverbose);
-        }
-        catch (const std::exception &e)
-        {
-            cerr << "Error processing listfile: " << e.what() << endl;
-            cout << argc-file << " files were not converted." << endl;
+    //only add the files to the queue, workers started with --queue convert them
+    if (!enqueuedir.IsNull())
+    {
+        spoolqueue queue(enqueuedir);
+        if (queue.init())
             return 1;
-        }
+        int ret = 0;
+        for (int file=startindex; file<argc; file++)
+            ret |= queue.enqueue(argv[file]);
+        return ret;
+    }
+
+    if (!opt.tree && !opt.histosonly && opt.shmname.IsNull() && !opt.arrow)
+    {
+        cerr << "--shm-only needs --shm, --arrow-only needs --arrow" << endl;
+        return 1;
+    }
+
+    if (!opt.tree && opt.split)
+    {
+        cerr << "--split-events writes trees, it cannot be used with --shm-only, --arrow-only"
+             << " or --histos-only" << endl;
+        return 1;
+    }
 
-        //clean up mvme files (save space)
-        std::ifstream test_lstfile(filename.Data());
-        std::ifstream test_zipfile(zipfilename.Data());
-        if ((test_lstfile.is_open())&&(test_zipfile.is_open())){
+    if (opt.split && (opt.rollevents || opt.rollbytes || opt.rollseconds))
+    {
+        cerr << "--roll cannot be used with --split-events" << endl;
+        return 1;
+    }
+
+    //the writer threads of --split-events fill trees next to the main
+    //thread, ROOT has to know before it makes the first object
+    if (opt.split)
+        ROOT::EnableThreadSafety();
+
+    //-o names the output of one listfile, stdin has no name to derive it from
+    bool fromstdin = 0;
+    for (int file=startindex; file<argc; file++)
+        fromstdin |= (TString(argv[file]) == "-");
+    if ((!opt.output.IsNull()) && ((argc-startindex!=1)||(!queuedir.IsNull())))
+    {
+        cerr << "-o can only be used with a single listfile" << endl;
+        return 1;
+    }
+    if (fromstdin && opt.output.IsNull())
+    {
+        cerr << "A listfile from stdin (-) needs -o file.root" << endl;
+        return 1;
+    }
 
-            cout << "Removing mvmelst file, analysis.analysis, and messages.log" << endl;
+    if (opt.maxmemory>0)
+        set_memory_budget(opt);
 
-            //delete mvmelst file
-            TString rmmvmelst = ".! rm -f " + filename;
-            cout << rmmvmelst.Data() << endl;;
-            gROOT->ProcessLine(rmmvmelst.Data());
+    //event selection is parsed once for the whole batch
+    eventselector select;
+    if (!selection.IsNull())
+    {
+        if (select.parse(selection))
+            return 1;
+        opt.select = &select;
+    }
 
-            //delete analysis.analysis
-            TString rmanalysis = ".! rm -f " + dir + "analysis.analysis";
-            cout << rmanalysis.Data() << endl;;
-            gROOT->ProcessLine(rmanalysis.Data());
+    //shared memory ring for online consumers, kept for the whole batch
+    shmring *shm = 0;
+    if (!opt.shmname.IsNull())
+    {
+        shm = new shmring(opt.shmname, opt.shmslots);
+        if (!shm->is_open())
+            return 1;
+        opt.shm = shm;
+    }
 
-            //delete messages.log
-            TString rmlog = ".! rm -f " + dir + "messages.log";
-            cout << rmlog.Data() << endl;;
-            gROOT->ProcessLine(rmlog.Data());
+    //http server for live histograms, kept for the whole batch
+    livehistos *live = 0;
+    if (opt.httpport>0)
+    {
+        live = new livehistos(opt.httpport, opt.httpinterval);
+        opt.live = live;
+    }
 
+    //queue mode: convert jobs from the spool directory until none are left
+    if (!queuedir.IsNull())
+    {
+        spoolqueue queue(queuedir);
+        if (queue.init())
+        {
+            delete shm;
+            delete live;
+            return 1;
         }
+        int nfailed = 0;
+        int ndone = 0;
+        TString listfile;
+        while (queue.claim(listfile))
+        {
+            listreader *reader = 0;
+            bool ok = (convert_file(listfile, ndone+nfailed, opt, reader, "")==0);
+            queue.finish(ok);
+            if (ok) ndone++;
+            else nfailed++;
+        }
+        cout << "----- Queue empty, " << ndone << " files converted, "
+             << nfailed << " failed -----" << endl;
+        cout << "Peak memory use: " << peak_memory()/(1024*1024) << " MB" << endl;
+        delete shm;
+        delete live;
+        return (nfailed>0);
+    }
 
-        cout << "----- " << argv[file] << " complete -----" << endl;
+    listreader *reader = 0;     //prefetched next file of the batch
+
+    //loop over all given files
+    for (int file=startindex; file<argc; file++){
+        TString next = (file+1<argc) ? argv[file+1] : "";
+        if (convert_file(argv[file], file-startindex, opt, reader, next))
+        {
+            cout << argc-file << " files were not converted." << endl;
+            delete reader;
+            delete shm;
+            delete live;
+            return 1;
+        }
     }
     cout << "----- " << argc-startindex << " files converted -----" << endl;
-
+    cout << "Peak memory use: " << peak_memory()/(1024*1024) << " MB";
+    if (opt.maxmemory>0)
+        cout << " (budget " << opt.maxmemory/(1024*1024) << " MB)";
+    cout << endl;
+    delete shm;
+    delete live;
 
     return 0;
 }
@@ -0,0 +1,473 @@
+
+#include "arrowwriter.hh"
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+using std::cout;
+using std::cerr;
+using std::endl;
+
+//Minimal flatbuffer builder for the Arrow metadata (Schema.fbs,
+//Message.fbs, File.fbs). Like the flatbuffers library it builds back to
+//front: children are created before the tables that refer to them, and
+//positions are counted from the end of the buffer.
+class fbbuilder
+{
+  public:
+
+    fbbuilder() : minalign(1), tablestart(0) {}
+
+    uint32_t size() const { return buf.size(); }
+    const std::vector<char> &data() const { return buf; }
+
+    template<typename T> void prepend(T v){
+        align(sizeof(T), sizeof(T));
+        prependBytes(&v, sizeof(T));
+    }
+
+    //offset to an object created earlier
+    uint32_t offsetTo(uint32_t pos){
+        align(4, 4);
+        prepend<uint32_t>(size()+4-pos);
+        return size();
+    }
+
+    uint32_t string(const std::string &s){
+        align(s.size()+1, 4);
+        buf.insert(buf.begin(), 1, 0);
+        prependBytes(s.data(), s.size());
+        prepend<uint32_t>(s.size());
+        return size();
+    }
+
+    uint32_t offsetVector(const std::vector<uint32_t> &pos){
+        align(pos.size()*4, 4);
+        for (size_t i=pos.size(); i>0; i--)
+            offsetTo(pos[i-1]);
+        prepend<uint32_t>(pos.size());
+        return size();
+    }
+
+    uint32_t structVector(const void *data, size_t n, size_t structsize, size_t alignment){
+        align(n*structsize, 4);
+        align(n*structsize, alignment);
+        prependBytes(data, n*structsize);
+        prepend<uint32_t>(n);
+        return size();
+    }
+
+    void startTable(){
+        fields.clear();
+        tablestart = size();
+    }
+    template<typename T> void addScalar(int id, T v){
+        prepend(v);
+        fields.push_back(std::make_pair(id, size()));
+    }
+    void addOffset(int id, uint32_t pos){
+        offsetTo(pos);
+        fields.push_back(std::make_pair(id, size()));
+    }
+    uint32_t endTable(){
+        //the table starts with the offset to its vtable, which is put in
+        //front of it
+        prepend<int32_t>(0);
+        uint32_t table = size();
+        int nfields = 0;
+        for (size_t i=0; i<fields.size(); i++){
+            if (fields[i].first+1>nfields)
+                nfields = fields[i].first+1;
+        }
+        std::vector<uint16_t> vtable(2+nfields, 0);
+        vtable[0] = (2+nfields)*sizeof(uint16_t);
+        vtable[1] = table-tablestart;
+        for (size_t i=0; i<fields.size(); i++)
+            vtable[2+fields[i].first] = table-fields[i].second;
+        for (size_t i=vtable.size(); i>0; i--)
+            prepend<uint16_t>(vtable[i-1]);
+        int32_t soffset = size()-table;
+        memcpy(&buf[buf.size()-table], &soffset, sizeof(soffset));
+        return table;
+    }
+
+    void finish(uint32_t root){
+        align(4, minalign);
+        offsetTo(root);
+    }
+
+  private:
+
+    //pad so that size is a multiple of alignment after len more bytes
+    void align(size_t len, size_t alignment){
+        if (alignment>minalign)
+            minalign = alignment;
+        size_t pad = (alignment - (buf.size()+len) % alignment) % alignment;
+        buf.insert(buf.begin(), pad, 0);
+    }
+    void prependBytes(const void *p, size_t n){
+        buf.insert(buf.begin(), (const char *)p, (const char *)p+n);
+    }
+
+    std::vector<char> buf;
+    size_t minalign;
+    uint32_t tablestart;
+    std::vector<std::pair<int, uint32_t> > fields;
+};
+
+//flatbuffer enums and union ids of the Arrow format
+static const int16_t MetadataV5 = 4;
+static const uint8_t HeaderSchema = 1;
+static const uint8_t HeaderRecordBatch = 3;
+static const int16_t PrecisionDouble = 2;
+
+static const char ArrowMagic[8] = {'A','R','R','O','W','1',0,0};
+
+arrowwriter::arrowwriter(TString filename_, int num_chn_, bool qdc_, bool sparse_)
+{
+    filename = filename_;
+    num_chn = num_chn_;
+    qdc = qdc_;
+    sparse = sparse_;
+    filepos = 0;
+    nrows = 0;
+    nhits = 0;
+    nwritten = 0;
+    pileupmask = 0;
+    ADC = ADC_short = TDC = 0;
+    offsets = chn = 0;
+
+    //no reallocation once the column pointers are taken
+    fields.reserve(16);
+    size_t rows = BatchRows;
+    event = &addField(fields, "event", Int, 64, 0, rows*8).data;
+    eventType = &addField(fields, "eventType", Int, 8, 0, rows).data;
+    tick = &addField(fields, "tick", Int, 32, 0, rows*4).data;
+    seconds = &addField(fields, "seconds", FloatingPoint, PrecisionDouble, 0, rows*8).data;
+    time_stamp = &addField(fields, "time_stamp", Int, 32, 1, rows*4).data;
+    extendedtime = &addField(fields, "extendedtime", Int, 32, 1, rows*4).data;
+    hitmask = &addField(fields, "hitmask", Int, 32, 0, rows*4).data;
+    if (!qdc)
+        pileupmask = &addField(fields, "pileupmask", Int, 32, 0, rows*4).data;
+    overflowmask = &addField(fields, "overflowmask", Int, 32, 0, rows*4).data;
+    field &trigger = addField(fields, "Trigger", FixedSizeList, 0, 0, 0, ShmMaxTrigger);
+    Trigger = &addField(trigger.children, "item", Int, 16, 0, rows*ShmMaxTrigger*2).data;
+
+    if (!sparse){
+        field &adc = addField(fields, "ADC", FixedSizeList, 0, 0, 0, num_chn);
+        ADC = &addField(adc.children, "item", Int, 16, 0, rows*num_chn*2).data;
+        if (qdc){
+            field &adcshort = addField(fields, "ADC_short", FixedSizeList, 0, 0, 0, num_chn);
+            ADC_short = &addField(adcshort.children, "item", Int, 16, 0, rows*num_chn*2).data;
+        }
+        field &tdc = addField(fields, "TDC", FixedSizeList, 0, 0, 0, num_chn);
+        TDC = &addField(tdc.children, "item", Int, 16, 0, rows*num_chn*2).data;
+    }
+    else{
+        field &hits = addField(fields, "hits", List, 0, 0, (rows+1)*4);
+        field &hit = addField(hits.children, "item", Struct, 0, 0, 0);
+        chn = &addField(hit.children, "chn", Int, 8, 0, rows*num_chn).data;
+        ADC = &addField(hit.children, "ADC", Int, 16, 0, rows*num_chn*2).data;
+        if (qdc)
+            ADC_short = &addField(hit.children, "ADC_short", Int, 16, 0, rows*num_chn*2).data;
+        TDC = &addField(hit.children, "TDC", Int, 16, 0, rows*num_chn*2).data;
+        offsets = &hits.data;
+    }
+    clear();
+    file = 0;
+}
+
+arrowwriter::~arrowwriter()
+{
+    if (file)
+        fclose(file);
+}
+
+void arrowwriter::open()
+{
+    file = fopen(filename.Data(), "wb");
+    if (!file)
+        throw std::runtime_error(std::string("Error opening ") + filename.Data() + " for writing: " + std::strerror(errno));
+    cout << "\nArrow file name: " << filename.Data() << endl;
+
+    //magic, then the schema message of the stream
+    write(ArrowMagic, sizeof(ArrowMagic));
+    fbbuilder b;
+    uint32_t schema = buildSchema(b);
+    b.startTable();
+    b.addScalar<int16_t>(0, MetadataV5);
+    b.addScalar<uint8_t>(1, HeaderSchema);
+    b.addOffset(2, schema);
+    b.addScalar<int64_t>(3, 0);
+    b.finish(b.endTable());
+    writeMessage(b, std::vector<const colbuf *>(), 0);
+}
+
+arrowwriter::field &arrowwriter::addField(std::vector<field> &to, const char *name, int type, int bits,
+                                          bool is_signed, size_t capacity, int listsize)
+{
+    //the field vectors are complete before pointers to the buffers are
+    //taken, children are added right after their parent
+    to.push_back(field());
+    field &f = to.back();
+    f.name = name;
+    f.type = type;
+    f.bits = bits;
+    f.is_signed = is_signed;
+    f.listsize = listsize;
+    f.data.bytes.resize(capacity);
+    f.data.used = 0;
+    f.children.reserve(4);
+    return f;
+}
+
+void arrowwriter::clear()
+{
+    std::vector<field *> todo;
+    for (size_t i=0; i<fields.size(); i++)
+        todo.push_back(&fields[i]);
+    while (!todo.empty()){
+        field *f = todo.back();
+        todo.pop_back();
+        f->data.used = 0;
+        for (size_t i=0; i<f->children.size(); i++)
+            todo.push_back(&f->children[i]);
+    }
+    nrows = 0;
+    nhits = 0;
+    if (offsets)
+        offsets->push<int32_t>(0);
+}
+
+void arrowwriter::append(const shmrecord *rec, uint32_t ticks)
+{
+    if (!file)
+        open();
+    event->push<uint64_t>(rec->event);
+    eventType->push<uint8_t>(rec->eventType);
+    tick->push<uint32_t>(ticks);
+    seconds->push<double>(rec->seconds);
+    time_stamp->push<int32_t>(rec->time_stamp);
+    extendedtime->push<int32_t>(rec->extendedtime);
+    hitmask->push<uint32_t>(rec->hitmask);
+    if (pileupmask)
+        pileupmask->push<uint32_t>(rec->pileupmask);
+    overflowmask->push<uint32_t>(rec->overflowmask);
+    for (int i=0; i<ShmMaxTrigger; i++)
+        Trigger->push<uint16_t>(rec->Trigger[i]);
+
+    if (!sparse){
+        for (int i=0; i<num_chn; i++)
+            ADC->push<uint16_t>(rec->ADC[i]);
+        if (ADC_short){
+            for (int i=0; i<num_chn; i++)
+                ADC_short->push<uint16_t>(rec->ADC_short[i]);
+        }
+        for (int i=0; i<num_chn; i++)
+            TDC->push<uint16_t>(rec->TDC[i]);
+    }
+    else{
+        //channels with an ADC or a TDC value
+        for (int i=0; i<num_chn; i++){
+            if ((((rec->hitmask >> i) & 1)==0)&&(rec->TDC[i]==0))
+                continue;
+            chn->push<uint8_t>(i);
+            ADC->push<uint16_t>(rec->ADC[i]);
+            if (ADC_short)
+                ADC_short->push<uint16_t>(rec->ADC_short[i]);
+            TDC->push<uint16_t>(rec->TDC[i]);
+            nhits++;
+        }
+        offsets->push<int32_t>(nhits);
+    }
+
+    nrows++;
+    if (nrows==BatchRows)
+        writeBatch();
+}
+
+int64_t arrowwriter::length(const field &f) const
+{
+    switch (f.type){
+        case Int:
+            return f.data.used/(f.bits/8);
+        case FloatingPoint:
+            return f.data.used/sizeof(double);
+        case List:
+            return f.data.used/sizeof(int32_t)-1;
+        case FixedSizeList:
+            return length(f.children[0])/f.listsize;
+        default:
+            return length(f.children[0]);
+    }
+}
+
+uint32_t arrowwriter::buildField(fbbuilder &b, const field &f) const
+{
+    std::vector<uint32_t> kids;
+    for (size_t i=0; i<f.children.size(); i++)
+        kids.push_back(buildField(b, f.children[i]));
+    uint32_t children = b.offsetVector(kids);
+    uint32_t name = b.string(f.name);
+
+    b.startTable();
+    if (f.type==Int){
+        b.addScalar<int32_t>(0, f.bits);
+        b.addScalar<uint8_t>(1, f.is_signed);
+    }
+    else if (f.type==FloatingPoint){
+        b.addScalar<int16_t>(0, f.bits);
+    }
+    else if (f.type==FixedSizeList){
+        b.addScalar<int32_t>(0, f.listsize);
+    }
+    uint32_t type = b.endTable();
+
+    //no nulls are written
+    b.startTable();
+    b.addOffset(0, name);
+    b.addScalar<uint8_t>(1, 0);
+    b.addScalar<uint8_t>(2, f.type);
+    b.addOffset(3, type);
+    b.addOffset(5, children);
+    return b.endTable();
+}
+
+uint32_t arrowwriter::buildSchema(fbbuilder &b) const
+{
+    std::vector<uint32_t> pos;
+    for (size_t i=0; i<fields.size(); i++)
+        pos.push_back(buildField(b, fields[i]));
+    uint32_t list = b.offsetVector(pos);
+    b.startTable();
+    b.addScalar<int16_t>(0, 0);     //little endian
+    b.addOffset(1, list);
+    return b.endTable();
+}
+
+void arrowwriter::collect(const field &f, std::vector<int64_t> &nodes,
+                          std::vector<const colbuf *> &buffers) const
+{
+    //field nodes and buffers in depth first order, an empty validity
+    //buffer for every field
+    nodes.push_back(length(f));
+    nodes.push_back(0);
+    buffers.push_back(0);
+    if ((f.type==Int)||(f.type==FloatingPoint)||(f.type==List))
+        buffers.push_back(&f.data);
+    for (size_t i=0; i<f.children.size(); i++)
+        collect(f.children[i], nodes, buffers);
+}
+
+void arrowwriter::writeMessage(fbbuilder &b, const std::vector<const colbuf *> &buffers, int64_t bodylength)
+{
+    //continuation marker, metadata length and the flatbuffer, padded so
+    //the body starts on a 64 byte boundary
+    static const char zeros[64] = {0};
+    const std::vector<char> &meta = b.data();
+    int32_t metalength = meta.size();
+    metalength += (64 - (filepos+8+metalength) % 64) % 64;
+
+    block blk;
+    blk.offset = filepos;
+    blk.metalength = 8+metalength;
+    blk.pad = 0;
+    blk.bodylength = bodylength;
+
+    uint32_t marker = 0xffffffff;
+    write(&marker, sizeof(marker));
+    write(&metalength, sizeof(metalength));
+    write(meta.data(), meta.size());
+    write(zeros, metalength-meta.size());
+
+    for (size_t i=0; i<buffers.size(); i++){
+        if (!buffers[i])
+            continue;
+        write(buffers[i]->bytes.data(), buffers[i]->used);
+        write(zeros, (64 - buffers[i]->used % 64) % 64);
+    }
+    if (bodylength>0)
+        blocks.push_back(blk);
+}
+
+void arrowwriter::writeBatch()
+{
+    if (nrows==0)
+        return;
+
+    std::vector<int64_t> nodes;
+    std::vector<const colbuf *> buffers;
+    for (size_t i=0; i<fields.size(); i++)
+        collect(fields[i], nodes, buffers);
+
+    //offset and length of each buffer in the body
+    std::vector<int64_t> spans;
+    int64_t bodylength = 0;
+    for (size_t i=0; i<buffers.size(); i++){
+        int64_t n = buffers[i] ? buffers[i]->used : 0;
+        spans.push_back(bodylength);
+        spans.push_back(n);
+        bodylength += (n+63) & ~(int64_t)63;
+    }
+
+    fbbuilder b;
+    uint32_t bufvec = b.structVector(spans.data(), buffers.size(), 16, 8);
+    uint32_t nodevec = b.structVector(nodes.data(), nodes.size()/2, 16, 8);
+    b.startTable();
+    b.addScalar<int64_t>(0, nrows);
+    b.addOffset(1, nodevec);
+    b.addOffset(2, bufvec);
+    uint32_t batch = b.endTable();
+    b.startTable();
+    b.addScalar<int16_t>(0, MetadataV5);
+    b.addScalar<uint8_t>(1, HeaderRecordBatch);
+    b.addOffset(2, batch);
+    b.addScalar<int64_t>(3, bodylength);
+    b.finish(b.endTable());
+    writeMessage(b, buffers, bodylength);
+
+    nwritten += nrows;
+    clear();
+}
+
+void arrowwriter::finish()
+{
+    if (!file)
+        return;
+    writeBatch();
+
+    //end of stream marker, then the footer with the schema and the blocks
+    int32_t eos[2] = {-1, 0};
+    write(eos, sizeof(eos));
+
+    fbbuilder b;
+    uint32_t blockvec = b.structVector(blocks.data(), blocks.size(), sizeof(block), 8);
+    uint32_t schema = buildSchema(b);
+    b.startTable();
+    b.addScalar<int16_t>(0, MetadataV5);
+    b.addOffset(1, schema);
+    b.addOffset(3, blockvec);
+    b.finish(b.endTable());
+    const std::vector<char> &footer = b.data();
+    int32_t footerlength = footer.size();
+    write(footer.data(), footer.size());
+    write(&footerlength, sizeof(footerlength));
+    write(ArrowMagic, 6);
+
+    if (fclose(file)!=0){
+        file = 0;
+        throw std::runtime_error(std::string("Error writing ") + filename.Data() + ": " + std::strerror(errno));
+    }
+    file = 0;
+    cout << filename.Data() << ": " << nwritten << " events" << endl;
+}
+
+void arrowwriter::write(const void *data, size_t n)
+{
+    if (n==0)
+        return;
+    if (fwrite(data, 1, n, file)!=n)
+        throw std::runtime_error(std::string("Error writing ") + filename.Data() + ": " + std::strerror(errno));
+    filepos += n;
+}
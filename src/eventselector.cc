@@ -0,0 +1,403 @@
+
+#include "eventselector.hh"
+
+#include "TString.h"
+
+#include <stdlib.h>
+#include <cctype>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+using std::cout;
+using std::cerr;
+using std::endl;
+
+eventselector::eventselector()
+{
+    pos = 0;
+    depth = 0;
+    maxdepth = 0;
+    naccepted = 0;
+    nrejected = 0;
+}
+
+eventselector::~eventselector()
+{
+
+}
+
+int eventselector::parse(TString expr)
+{
+    text = expr.Data();
+    pos = 0;
+    depth = 0;
+    maxdepth = 0;
+    error = "";
+    program.clear();
+
+    bool ok = parseOr();
+    skipSpace();
+    if (ok && pos<text.size()){
+        error = "unexpected input";
+        ok = 0;
+    }
+    if (ok && maxdepth>MaxStack){
+        error = "expression too deep";
+        ok = 0;
+    }
+    if (!ok){
+        cerr << "Error in selection \"" << text << "\" at position " << pos
+             << ": " << error << endl;
+        program.clear();
+        return 1;
+    }
+    return 0;
+}
+
+void eventselector::addVariable(TString name, int type, const void *ptr, int size)
+{
+    variable var;
+    var.type = type;
+    var.ptr = ptr;
+    var.size = size;
+    variables[name.Data()] = var;
+
+    //the part after the module prefix works alone as long as it is unique
+    std::string full = name.Data();
+    size_t dot = full.find('.');
+    if (dot!=std::string::npos){
+        std::string shortname = full.substr(dot+1);
+        std::map<std::string, std::string>::iterator it = aliases.find(shortname);
+        if (it==aliases.end())
+            aliases[shortname] = full;
+        else if (it->second!=full)
+            it->second = "";
+    }
+}
+
+void eventselector::addVariable(TString name, const int *ptr, int size){
+    addVariable(name, LoadInt, ptr, size);
+}
+
+void eventselector::addVariable(TString name, const double *ptr, int size){
+    addVariable(name, LoadDouble, ptr, size);
+}
+
+void eventselector::addVariable(TString name, const bool *ptr, int size){
+    addVariable(name, LoadBool, ptr, size);
+}
+
+void eventselector::addVariable(TString name, const uint32_t *ptr, int size){
+    addVariable(name, LoadUInt, ptr, size);
+}
+
+void eventselector::clearVariables()
+{
+    variables.clear();
+    aliases.clear();
+}
+
+int eventselector::bind()
+{
+    for (size_t i=0; i<program.size(); i++){
+        instruction &ins = program[i];
+        if (ins.name.empty())
+            continue;
+
+        std::string name = ins.name;
+        if (variables.find(name)==variables.end()){
+            std::map<std::string, std::string>::iterator alias = aliases.find(name);
+            if ((alias!=aliases.end())&&(alias->second.empty())){
+                cerr << "Selection variable " << name << " is ambiguous, add the module prefix" << endl;
+                return 1;
+            }
+            if (alias!=aliases.end())
+                name = alias->second;
+        }
+        std::map<std::string, variable>::iterator it = variables.find(name);
+        if (it==variables.end()){
+            cerr << "Unknown selection variable " << name << endl;
+            return 1;
+        }
+        const variable &var = it->second;
+        if ((ins.index<0)&&(var.size>1)){
+            cerr << "Selection variable " << name << " needs an index [0-" << var.size-1 << "]" << endl;
+            return 1;
+        }
+        int index = (ins.index<0) ? 0 : ins.index;
+        if (index>=var.size){
+            cerr << "Index " << index << " out of range for " << name << endl;
+            return 1;
+        }
+
+        ins.op = var.type;
+        switch (var.type){
+            case LoadInt:    ins.ptr = (const int *)var.ptr + index; break;
+            case LoadDouble: ins.ptr = (const double *)var.ptr + index; break;
+            case LoadBool:   ins.ptr = (const bool *)var.ptr + index; break;
+            case LoadUInt:   ins.ptr = (const uint32_t *)var.ptr + index; break;
+        }
+    }
+    return 0;
+}
+
+bool eventselector::evaluate() const
+{
+    double stack[MaxStack];
+    int top = -1;
+    const instruction *ins = &program[0];
+    const instruction *end = ins+program.size();
+
+    for (; ins<end; ++ins){
+        switch (ins->op){
+            case Const:      stack[++top] = ins->value; break;
+            case LoadInt:    stack[++top] = *(const int *)ins->ptr; break;
+            case LoadDouble: stack[++top] = *(const double *)ins->ptr; break;
+            case LoadBool:   stack[++top] = *(const bool *)ins->ptr; break;
+            case LoadUInt:   stack[++top] = *(const uint32_t *)ins->ptr; break;
+            case Neg:        stack[top] = -stack[top]; break;
+            case Not:        stack[top] = (stack[top]==0); break;
+            case Mul:        top--; stack[top] = stack[top]*stack[top+1]; break;
+            case Div:        top--; stack[top] = stack[top]/stack[top+1]; break;
+            case Mod:        top--; stack[top] = std::fmod(stack[top], stack[top+1]); break;
+            case Add:        top--; stack[top] = stack[top]+stack[top+1]; break;
+            case Sub:        top--; stack[top] = stack[top]-stack[top+1]; break;
+            case Less:       top--; stack[top] = stack[top]<stack[top+1]; break;
+            case LessEq:     top--; stack[top] = stack[top]<=stack[top+1]; break;
+            case Greater:    top--; stack[top] = stack[top]>stack[top+1]; break;
+            case GreaterEq:  top--; stack[top] = stack[top]>=stack[top+1]; break;
+            case Equal:      top--; stack[top] = stack[top]==stack[top+1]; break;
+            case NotEqual:   top--; stack[top] = stack[top]!=stack[top+1]; break;
+            case BitAnd:     top--; stack[top] = (double)((int64_t)stack[top] & (int64_t)stack[top+1]); break;
+            case BitOr:      top--; stack[top] = (double)((int64_t)stack[top] | (int64_t)stack[top+1]); break;
+            case And:        top--; stack[top] = (stack[top]!=0)&&(stack[top+1]!=0); break;
+            case Or:         top--; stack[top] = (stack[top]!=0)||(stack[top+1]!=0); break;
+        }
+    }
+    return stack[0]!=0;
+}
+
+void eventselector::printCounters() const
+{
+    uint64_t total = naccepted+nrejected;
+    cout << "Selection: " << naccepted << " events accepted, " << nrejected << " rejected";
+    if (total>0)
+        cout << " (" << 100.*naccepted/total << "% accepted)";
+    cout << endl;
+}
+
+void eventselector::resetCounters()
+{
+    naccepted = 0;
+    nrejected = 0;
+}
+
+//parser
+
+void eventselector::emit(int op)
+{
+    instruction ins;
+    ins.op = op;
+    ins.value = 0;
+    ins.ptr = 0;
+    ins.index = -1;
+    program.push_back(ins);
+
+    //track the stack depth the program needs
+    if (op!=Neg && op!=Not)
+        depth += (op==Const) ? 1 : -1;
+    if (depth>maxdepth)
+        maxdepth = depth;
+}
+
+void eventselector::skipSpace()
+{
+    while (pos<text.size() && isspace((unsigned char)text[pos]))
+        pos++;
+}
+
+bool eventselector::match(const char *token)
+{
+    skipSpace();
+    size_t len = strlen(token);
+    if (text.compare(pos, len, token)!=0)
+        return 0;
+    //do not take "<" out of "<=", "&" out of "&&" and so on
+    if ((len==1)&&(pos+1<text.size())){
+        char next = text[pos+1];
+        if ((token[0]=='<' || token[0]=='>' || token[0]=='!' || token[0]=='=') && next=='=')
+            return 0;
+        if ((token[0]=='&' && next=='&')||(token[0]=='|' && next=='|'))
+            return 0;
+    }
+    pos += len;
+    return 1;
+}
+
+bool eventselector::parseOr()
+{
+    if (!parseAnd()) return 0;
+    while (match("||")){
+        if (!parseAnd()) return 0;
+        emit(Or);
+    }
+    return 1;
+}
+
+bool eventselector::parseAnd()
+{
+    if (!parseBitOr()) return 0;
+    while (match("&&")){
+        if (!parseBitOr()) return 0;
+        emit(And);
+    }
+    return 1;
+}
+
+bool eventselector::parseBitOr()
+{
+    if (!parseBitAnd()) return 0;
+    while (match("|")){
+        if (!parseBitAnd()) return 0;
+        emit(BitOr);
+    }
+    return 1;
+}
+
+bool eventselector::parseBitAnd()
+{
+    if (!parseCompare()) return 0;
+    while (match("&")){
+        if (!parseCompare()) return 0;
+        emit(BitAnd);
+    }
+    return 1;
+}
+
+bool eventselector::parseCompare()
+{
+    if (!parseSum()) return 0;
+    while (1){
+        int op;
+        if (match("<=")) op = LessEq;
+        else if (match(">=")) op = GreaterEq;
+        else if (match("==")) op = Equal;
+        else if (match("!=")) op = NotEqual;
+        else if (match("<")) op = Less;
+        else if (match(">")) op = Greater;
+        else return 1;
+        if (!parseSum()) return 0;
+        emit(op);
+    }
+}
+
+bool eventselector::parseSum()
+{
+    if (!parseProduct()) return 0;
+    while (1){
+        int op;
+        if (match("+")) op = Add;
+        else if (match("-")) op = Sub;
+        else return 1;
+        if (!parseProduct()) return 0;
+        emit(op);
+    }
+}
+
+bool eventselector::parseProduct()
+{
+    if (!parseUnary()) return 0;
+    while (1){
+        int op;
+        if (match("*")) op = Mul;
+        else if (match("/")) op = Div;
+        else if (match("%")) op = Mod;
+        else return 1;
+        if (!parseUnary()) return 0;
+        emit(op);
+    }
+}
+
+bool eventselector::parseUnary()
+{
+    if (match("!")){
+        if (!parseUnary()) return 0;
+        emit(Not);
+        return 1;
+    }
+    if (match("-")){
+        if (!parseUnary()) return 0;
+        emit(Neg);
+        return 1;
+    }
+    return parsePrimary();
+}
+
+bool eventselector::parsePrimary()
+{
+    skipSpace();
+    if (pos>=text.size()){
+        error = "unexpected end of expression";
+        return 0;
+    }
+
+    if (match("(")){
+        if (!parseOr()) return 0;
+        if (!match(")")){
+            error = "missing )";
+            return 0;
+        }
+        return 1;
+    }
+
+    char c = text[pos];
+    if (isdigit((unsigned char)c) || c=='.'){
+        const char *start = text.c_str()+pos;
+        char *stop;
+        double value;
+        if ((c=='0')&&(pos+1<text.size())&&(text[pos+1]=='x' || text[pos+1]=='X'))
+            value = strtoull(start, &stop, 16);
+        else
+            value = strtod(start, &stop);
+        if (stop==start){
+            error = "bad number";
+            return 0;
+        }
+        pos += stop-start;
+        emit(Const);
+        program.back().value = value;
+        return 1;
+    }
+
+    if (isalpha((unsigned char)c) || c=='_'){
+        size_t start = pos;
+        while (pos<text.size() && (isalnum((unsigned char)text[pos]) || text[pos]=='_' || text[pos]=='.'))
+            pos++;
+        std::string name = text.substr(start, pos-start);
+        int index = -1;
+        if (match("[")){
+            skipSpace();
+            const char *istart = text.c_str()+pos;
+            char *istop;
+            long value = strtol(istart, &istop, 10);
+            if ((istop==istart)||(value<0)){
+                error = "bad index";
+                return 0;
+            }
+            pos += istop-istart;
+            if (!match("]")){
+                error = "missing ]";
+                return 0;
+            }
+            index = value;
+        }
+        //loads count like constants for the stack depth
+        emit(Const);
+        program.back().name = name;
+        program.back().index = index;
+        return 1;
+    }
+
+    error = "unexpected character";
+    return 0;
+}
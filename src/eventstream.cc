@@ -0,0 +1,161 @@
+
+#include "eventstream.hh"
+
+#include "TString.h"
+#include "TFile.h"
+
+#include <iostream>
+using std::cout;
+using std::cerr;
+using std::endl;
+
+eventstream::eventstream(TString rootfilename, TString listfilename, bool psdsparse, int mdpp32,
+                         const mdpp16_SCP &scp, const mdpp32_SCP *scp32)
+{
+    //the trees are made in the directory that is current
+    TDirectory *previous = gDirectory;
+    rootfile = new TFile(rootfilename, "RECREATE");
+    rootfile->cd();
+    rootdata_SCP = new mdpp16_SCP(listfilename, 0);
+    rootdata_SCP->copyCalibration(scp);
+    rootdata_QDC = new mdpp16_QDC(listfilename, psdsparse, 0, 0);
+    rootdata_SCP32 = 0;
+    rootdata_QDC32 = 0;
+    if (mdpp32==1){
+        rootdata_SCP32 = new mdpp32_SCP(listfilename, 0);
+        if (scp32)
+            rootdata_SCP32->copyCalibration(*scp32);
+    }
+    if (mdpp32==2)
+        rootdata_QDC32 = new mdpp32_QDC(listfilename, psdsparse, 0, 0);
+    rootdata_MADC = new madc32(0, 0);
+    rootdata_MQDC = new mqdc32(0, 0);
+    rootdata_MTDC = new mtdc32(0, 0);
+    MADCon = 0;
+    MQDCon = 0;
+    MTDCon = 0;
+    if (previous)
+        previous->cd();
+
+    slots = new shmrecord[QueueSize*SlotRecords];
+    head = 0;
+    tail = 0;
+    finishing = 0;
+    thread = std::thread(&eventstream::writer, this);
+}
+
+eventstream::~eventstream()
+{
+    if (thread.joinable())
+        finish(0, 0, 0);
+    delete rootdata_SCP;
+    delete rootdata_QDC;
+    delete rootdata_SCP32;
+    delete rootdata_QDC32;
+    delete rootdata_MADC;
+    delete rootdata_MQDC;
+    delete rootdata_MTDC;
+    delete[] slots;
+    delete rootfile;
+}
+
+shmrecord *eventstream::claim()
+{
+    std::unique_lock<std::mutex> lock(mtx);
+    while (head-tail>=(uint64_t)QueueSize)
+        cv.wait(lock);
+    return &slots[(head%QueueSize)*SlotRecords];
+}
+
+void eventstream::commit()
+{
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        head++;
+    }
+    cv.notify_all();
+}
+
+void eventstream::writer()
+{
+    std::unique_lock<std::mutex> lock(mtx);
+    while (1){
+        while ((tail==head)&&(!finishing))
+            cv.wait(lock);
+        if (tail==head)
+            break;
+
+        //fill everything that is queued without holding the lock
+        uint64_t last = head;
+        lock.unlock();
+        for (uint64_t i=tail; i<last; i++){
+            const shmrecord *rec = &slots[(i%QueueSize)*SlotRecords];
+            rootdata_SCP->loadRecord(&rec[SlotSCP]);
+            rootdata_SCP->writeEvent();
+            rootdata_QDC->loadRecord(&rec[SlotQDC]);
+            rootdata_QDC->writeEvent();
+            if (rootdata_SCP32){
+                rootdata_SCP32->loadRecord(&rec[SlotMDPP32]);
+                rootdata_SCP32->writeEvent();
+            }
+            if (rootdata_QDC32){
+                rootdata_QDC32->loadRecord(&rec[SlotMDPP32]);
+                rootdata_QDC32->writeEvent();
+            }
+            writeMxDC(*rootdata_MADC, MADCon, &rec[SlotMADC], i);
+            writeMxDC(*rootdata_MQDC, MQDCon, &rec[SlotMQDC], i);
+            writeMxDC(*rootdata_MTDC, MTDCon, &rec[SlotMTDC], i);
+        }
+        lock.lock();
+        tail = last;
+        cv.notify_all();
+    }
+}
+
+template<typename MOD>
+void eventstream::writeMxDC(MOD &rootdata, bool &on, const shmrecord *rec, uint64_t entry)
+{
+    if ((!on)&&(rec->module)){
+        on = 1;
+        rootdata.fillEmpty(entry);
+    }
+    if (on){
+        rootdata.loadRecord(rec);
+        rootdata.writeEvent();
+    }
+}
+
+void eventstream::finish(bool SCPon, bool QDCon, bool MDPP32on)
+{
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        finishing = 1;
+    }
+    cv.notify_all();
+    thread.join();
+
+    TDirectory *previous = gDirectory;
+    rootfile->cd();
+    if (SCPon){
+        rootdata_SCP->writeTree();
+        rootdata_SCP->writeCalibration();
+    }
+    if (QDCon)
+        rootdata_QDC->writeTree();
+    if (MDPP32on && rootdata_SCP32){
+        rootdata_SCP32->writeTree();
+        rootdata_SCP32->writeCalibration();
+    }
+    if (MDPP32on && rootdata_QDC32)
+        rootdata_QDC32->writeTree();
+    if (MADCon)
+        rootdata_MADC->writeTree();
+    if (MQDCon)
+        rootdata_MQDC->writeTree();
+    if (MTDCon)
+        rootdata_MTDC->writeTree();
+    rootfile->Close();
+    cout << rootfile->GetName() << ": " << head << " events" << endl;
+    if (previous)
+        previous->cd();
+}
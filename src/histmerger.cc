@@ -0,0 +1,309 @@
+
+#include "histmerger.hh"
+
+#include "TFile.h"
+#include "TDirectory.h"
+#include "TKey.h"
+#include "TList.h"
+#include "TIter.h"
+#include "TH1.h"
+#include "TNamed.h"
+#include "TVectorD.h"
+#include "TDatime.h"
+#include "TTree.h"
+#include "TROOT.h"
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <set>
+#include <thread>
+using std::cout;
+using std::cerr;
+using std::endl;
+
+histmerger::histmerger(int nthreads_)
+{
+    ROOT::EnableThreadSafety();
+    //histograms read from the files belong to the thread that reads them
+    TH1::AddDirectory(0);
+
+    nthreads = nthreads_;
+    if (nthreads<=0)
+        nthreads = std::thread::hardware_concurrency();
+    if (nthreads<1)
+        nthreads = 1;
+}
+
+histmerger::~histmerger()
+{
+
+}
+
+bool histmerger::sameBinning(TH1 *a, TH1 *b)
+{
+    return (a->GetNbinsX()==b->GetNbinsX()) && (a->GetNbinsY()==b->GetNbinsY()) &&
+           (a->GetXaxis()->GetXmin()==b->GetXaxis()->GetXmin()) &&
+           (a->GetXaxis()->GetXmax()==b->GetXaxis()->GetXmax());
+}
+
+bool histmerger::readFile(TString name, partial &sum, runinfo &run)
+{
+    run.file = name;
+    run.ok = 0;
+    run.timed = 0;
+    run.start = 0;
+    run.stop = 0;
+    run.seconds = 0;
+
+    TFile *in = TFile::Open(name);
+    if ((!in)||(in->IsZombie())){
+        cerr << "Error opening " << name.Data() << " for reading" << endl;
+        delete in;
+        return 0;
+    }
+
+    //only the histos_* directories, a name is read once if it has cycles
+    std::set<std::string> seen;
+    TIter next(in->GetListOfKeys());
+    while (TKey *key = (TKey *)next()){
+        TString dirname = key->GetName();
+        if ((!dirname.BeginsWith("histos_"))||(!seen.insert(dirname.Data()).second))
+            continue;
+        TDirectory *dir = dynamic_cast<TDirectory *>(in->Get(dirname));
+        if (!dir)
+            continue;
+
+        std::set<std::string> seenhist;
+        TIter hnext(dir->GetListOfKeys());
+        while (TKey *hkey = (TKey *)hnext()){
+            if (!seenhist.insert(hkey->GetName()).second)
+                continue;
+            TObject *obj = hkey->ReadObj();
+            TH1 *h = dynamic_cast<TH1 *>(obj);
+            if (!h){
+                delete obj;
+                continue;
+            }
+            std::string id = std::string(dirname.Data()) + "/" + hkey->GetName();
+            std::map<std::string, TH1 *>::iterator it = sum.histos.find(id);
+            if (it == sum.histos.end()){
+                h->SetDirectory(0);
+                sum.histos[id] = h;
+                sum.order.push_back(id);
+                continue;
+            }
+            if (sameBinning(it->second, h))
+                it->second->Add(h);
+            else
+                sum.nskipped++;
+            delete h;
+        }
+    }
+
+    //calibration of the SCP trees
+    const char *vectors[] = {"m[16]", "b[16]", "m[32]", "b[32]"};
+    for (int i=0; i<4; i++){
+        TVectorD *v = dynamic_cast<TVectorD *>(in->Get(vectors[i]));
+        if (!v)
+            continue;
+        std::vector<double> &values = run.calibration[vectors[i]];
+        for (int k=0; k<v->GetNrows(); k++)
+            values.push_back((*v)[k]);
+        delete v;
+    }
+
+    //run times from messages.log, a --roll part only covers run_seconds
+    TNamed *start = dynamic_cast<TNamed *>(in->Get("start_time"));
+    TNamed *stop = dynamic_cast<TNamed *>(in->Get("stop_time"));
+    TNamed *part = dynamic_cast<TNamed *>(in->Get("run_seconds"));
+    if (start && stop){
+        run.timed = 1;
+        run.start = TDatime(start->GetTitle()).Convert();
+        run.stop = TDatime(stop->GetTitle()).Convert();
+        run.seconds = (run.stop>run.start) ? run.stop-run.start : 0;
+    }
+    int first, last;
+    if (part && (sscanf(part->GetTitle(), "%d-%d", &first, &last)==2)){
+        run.timed = 1;
+        run.seconds = last-first;
+    }
+    delete start;
+    delete stop;
+    delete part;
+
+    in->Close();
+    delete in;
+    run.ok = 1;
+    return 1;
+}
+
+void histmerger::readShare(const std::vector<TString> &files, size_t first, size_t last,
+                           partial &sum, std::vector<runinfo> &runs)
+{
+    for (size_t i=first; i<last; i++)
+        readFile(files[i], sum, runs[i]);
+}
+
+void histmerger::add(partial &into, partial &from)
+{
+    //from is emptied, its histograms are added or moved to into
+    for (size_t i=0; i<from.order.size(); i++){
+        const std::string &id = from.order[i];
+        TH1 *h = from.histos[id];
+        std::map<std::string, TH1 *>::iterator it = into.histos.find(id);
+        if (it == into.histos.end()){
+            into.histos[id] = h;
+            into.order.push_back(id);
+            continue;
+        }
+        if (sameBinning(it->second, h))
+            it->second->Add(h);
+        else
+            into.nskipped++;
+        delete h;
+    }
+    into.nskipped += from.nskipped;
+    from.histos.clear();
+    from.order.clear();
+}
+
+int histmerger::merge(TString outname, const std::vector<TString> &files)
+{
+    size_t nfiles = files.size();
+    int nparts = ((size_t)nthreads<nfiles) ? nthreads : (int)nfiles;
+    if (nparts<1){
+        cerr << "No root files to merge" << endl;
+        return 1;
+    }
+
+    //each thread sums a contiguous share, so the first file sets the order
+    std::vector<partial> sums(nparts);
+    std::vector<runinfo> runs(nfiles);
+    std::vector<std::thread> workers;
+    for (int t=0; t<nparts; t++){
+        size_t first = nfiles*t/nparts;
+        size_t last = nfiles*(t+1)/nparts;
+        workers.push_back(std::thread(&histmerger::readShare, this, std::cref(files),
+                                      first, last, std::ref(sums[t]), std::ref(runs)));
+    }
+    for (size_t t=0; t<workers.size(); t++)
+        workers[t].join();
+
+    //tree reduction of the partial sums into sums[0]
+    for (int stride=1; stride<nparts; stride*=2){
+        workers.clear();
+        for (int t=0; t+stride<nparts; t+=2*stride)
+            workers.push_back(std::thread(&histmerger::add, std::ref(sums[t]), std::ref(sums[t+stride])));
+        for (size_t t=0; t<workers.size(); t++)
+            workers[t].join();
+    }
+    partial &sum = sums[0];
+
+    int nfailed = 0;
+    int ntimed = 0;
+    int ncalchanged = 0;
+    long livetime = 0;
+    UInt_t first = 0, last = 0;
+    const runinfo *reference = 0;   //calibration written to the summary
+    for (size_t i=0; i<nfiles; i++){
+        const runinfo &run = runs[i];
+        if (!run.ok){
+            nfailed++;
+            continue;
+        }
+        if (!reference)
+            reference = &run;
+        else if (run.calibration != reference->calibration)
+            ncalchanged++;
+        if (run.timed){
+            ntimed++;
+            livetime += run.seconds;
+            if ((run.start>0)&&((first==0)||(run.start<first))) first = run.start;
+            if (run.stop>last) last = run.stop;
+        }
+    }
+
+    TFile *out = new TFile(outname, "RECREATE");
+    if (out->IsZombie()){
+        cerr << "Error opening " << outname.Data() << " for writing" << endl;
+        delete out;
+        return 1;
+    }
+
+    //summed histograms in the directories they came from
+    std::set<std::string> dirs;
+    for (size_t i=0; i<sum.order.size(); i++){
+        const std::string &id = sum.order[i];
+        std::string dirname = id.substr(0, id.find('/'));
+        std::string histname = id.substr(id.find('/')+1);
+        if (dirs.insert(dirname).second)
+            out->mkdir(dirname.c_str());
+        out->cd(dirname.c_str());
+        sum.histos[id]->Write(histname.c_str());
+        delete sum.histos[id];
+    }
+
+    out->cd();
+    if (reference){
+        std::map<std::string, std::vector<double> >::const_iterator it;
+        for (it = reference->calibration.begin(); it != reference->calibration.end(); ++it){
+            TVectorD v(it->second.size());
+            for (size_t k=0; k<it->second.size(); k++)
+                v[k] = it->second[k];
+            v.Write(it->first.c_str());
+        }
+    }
+
+    //campaign times like the run start and stop times of a single file
+    if (ntimed>0){
+        TDatime start, stop;
+        start.Set(first);
+        stop.Set(last);
+        TNamed startT("start_time", start.AsSQLString());
+        TNamed stopT("stop_time", stop.AsSQLString());
+        startT.Write();
+        stopT.Write();
+    }
+    TNamed live("livetime_seconds", Form("%li", livetime));
+    live.Write();
+
+    //one entry per merged file
+    char file[1024];
+    UInt_t runstart, runstop;
+    Long64_t seconds;
+    TTree *runtree = new TTree("runs", "merged files");
+    runtree->Branch("file", file, "file/C");
+    runtree->Branch("start", &runstart, "start/i");
+    runtree->Branch("stop", &runstop, "stop/i");
+    runtree->Branch("seconds", &seconds, "seconds/L");
+    for (size_t i=0; i<nfiles; i++){
+        if (!runs[i].ok)
+            continue;
+        snprintf(file, sizeof(file), "%s", runs[i].file.Data());
+        runstart = runs[i].start;
+        runstop = runs[i].stop;
+        seconds = runs[i].seconds;
+        runtree->Fill();
+    }
+    runtree->Write();
+
+    out->Close();
+    delete out;
+
+    cout << outname.Data() << ": " << nfiles-nfailed << " files, " << sum.order.size()
+         << " histograms, livetime " << livetime << " s (" << livetime/3600 << " h "
+         << (livetime%3600)/60 << " min)" << endl;
+    if (ntimed<(int)(nfiles-nfailed))
+        cout << "Warning: " << nfiles-nfailed-ntimed << " files have no start_time/stop_time,"
+             << " they are not in the livetime" << endl;
+    if (ncalchanged>0)
+        cout << "Warning: " << ncalchanged << " files have another calibration than "
+             << reference->file.Data() << ", whose calibration is written" << endl;
+    if (sum.nskipped>0)
+        cout << "Warning: " << sum.nskipped << " histograms with other binning than the first"
+             << " file were left out" << endl;
+    if (nfailed>0)
+        cerr << nfailed << " files could not be read" << endl;
+    return (nfailed>0);
+}
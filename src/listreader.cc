@@ -0,0 +1,370 @@
+
+#include "listreader.hh"
+
+#include "TString.h"
+
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <iostream>
+using std::cout;
+using std::cerr;
+using std::endl;
+
+//read len bytes at offset, retrying short reads. Returns bytes read or -errno.
+static ssize_t pread_full(int fd, char *buf, size_t len, uint64_t offset)
+{
+    size_t done = 0;
+    while (done<len){
+        ssize_t n = pread(fd, buf+done, len-done, offset+done);
+        if (n<0){
+            if (errno==EINTR) continue;
+            return -errno;
+        }
+        if (n==0) break;
+        done += n;
+    }
+    return done;
+}
+
+//read up to len bytes of a stream, retrying short reads. Returns bytes
+//read, less than len only at the end, or -errno.
+static ssize_t read_full(int fd, char *buf, size_t len)
+{
+    size_t done = 0;
+    while (done<len){
+        ssize_t n = read(fd, buf+done, len-done);
+        if (n<0){
+            if (errno==EINTR) continue;
+            return -errno;
+        }
+        if (n==0) break;
+        done += n;
+    }
+    return done;
+}
+
+listreader::listreader(TString name, size_t blocksize_, int depth_)
+{
+    filename = name;
+    blocksize = blocksize_;
+    depth = depth_;
+    started = 0;
+    streamed = 0;
+    filesize = 0;
+    nblocks = 0;
+    curdata = 0;
+    curlen = 0;
+    curpos = 0;
+    curoffset = 0;
+    nextindex = 0;
+#ifdef USE_URING
+    inflight = 0;
+#endif
+    uringON = 0;
+    nextsubmit = 0;
+    stopping = 0;
+
+    if (filename == "-")
+        fd = dup(STDIN_FILENO);
+    else
+        fd = open(filename.Data(), O_RDONLY | O_CLOEXEC);
+    if (fd<0)
+        return;
+
+    //a stream's length is only known when its end is read
+    struct stat st;
+    if (fstat(fd, &st)==0)
+        streamed = !S_ISREG(st.st_mode);
+    if (streamed){
+        nblocks = UINT64_MAX;
+    }
+    else{
+        filesize = st.st_size;
+        nblocks = (filesize+blocksize-1)/blocksize;
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
+
+    //page aligned buffers, one per read in flight. Without them the file
+    //counts as not opened, with errno ENOMEM
+    blocks.resize(depth);
+    for (int i=0; i<depth; i++){
+        void *mem = 0;
+        int ret = posix_memalign(&mem, 4096, blocksize);
+        if (ret!=0){
+            for (int k=0; k<i; k++)
+                free(blocks[k].data);
+            blocks.clear();
+            close(fd);
+            fd = -1;
+            errno = ret;
+            return;
+        }
+        blocks[i].data = (char *)mem;
+        blocks[i].len = 0;
+        blocks[i].index = 0;
+        blocks[i].state = Free;
+        blocks[i].error = 0;
+    }
+}
+
+listreader::~listreader()
+{
+#ifdef USE_URING
+    if (uringON){
+        //wait for outstanding reads before the buffers go away
+        while (inflight>0){
+            struct io_uring_cqe *cqe;
+            if (io_uring_wait_cqe(&ring, &cqe)<0)
+                break;
+            io_uring_cqe_seen(&ring, cqe);
+            inflight--;
+        }
+        io_uring_queue_exit(&ring);
+    }
+#endif
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        stopping = 1;
+    }
+    cv.notify_all();
+    for (size_t i=0; i<workers.size(); i++)
+        workers[i].join();
+    for (size_t i=0; i<blocks.size(); i++)
+        free(blocks[i].data);
+    if (fd>=0)
+        close(fd);
+}
+
+void listreader::start()
+{
+    //start reading ahead. Called early for the next file of a batch so its
+    //first blocks are in memory when the current file is done.
+    if (started || fd<0)
+        return;
+    started = 1;
+
+#ifdef USE_URING
+    uringON = (!streamed)&&(io_uring_queue_init(depth, &ring, 0)==0);
+    if ((!uringON)&&(!streamed))
+        cerr << "io_uring unavailable, reading " << filename.Data() << " with threads" << endl;
+    if (uringON){
+        for (uint64_t k=0; (k<(uint64_t)depth)&&(k<nblocks); k++)
+            submit_block(k);
+        return;
+    }
+#endif
+    //the blocks of a stream have to be read in order, by one thread
+    int nthreads = streamed ? 1 : (depth<4) ? depth : 4;
+    for (int i=0; i<nthreads; i++)
+        workers.push_back(std::thread(&listreader::worker, this));
+}
+
+//read block index synchronously, returns bytes read or -errno. A stream
+//ends with its first block that is not full, the caller sets nblocks then.
+ssize_t listreader::read_block(char *buf, uint64_t index)
+{
+    if (streamed)
+        return read_full(fd, buf, blocksize);
+    uint64_t offset = index*blocksize;
+    size_t len = (filesize-offset<blocksize) ? filesize-offset : blocksize;
+    return pread_full(fd, buf, len, offset);
+}
+
+#ifdef USE_URING
+void listreader::submit_block(uint64_t index)
+{
+    block &blk = blocks[index%depth];
+    uint64_t offset = index*blocksize;
+    size_t len = (filesize-offset<blocksize) ? filesize-offset : blocksize;
+    blk.index = index;
+    blk.error = 0;
+
+    struct io_uring_sqe *sqe = io_uring_get_sqe(&ring);
+    io_uring_prep_read(sqe, fd, blk.data, len, offset);
+    io_uring_sqe_set_data(sqe, (void *)(uintptr_t)index);
+    io_uring_submit(&ring);
+    blk.state = Reading;
+    inflight++;
+}
+#endif
+
+void listreader::worker()
+{
+    std::unique_lock<std::mutex> lock(mtx);
+    while (1){
+        while (!stopping && !((nextsubmit<nblocks)&&(blocks[nextsubmit%depth].state==Free)))
+            cv.wait(lock);
+        if (stopping)
+            return;
+
+        uint64_t index = nextsubmit++;
+        block &blk = blocks[index%depth];
+        blk.state = Reading;
+        blk.index = index;
+        lock.unlock();
+
+        ssize_t n = read_block(blk.data, index);
+
+        lock.lock();
+        if (streamed && (n<(ssize_t)blocksize))
+            nblocks = index + ((n!=0) ? 1 : 0);
+        blk.len = (n<0) ? 0 : n;
+        blk.error = (n<0) ? -n : 0;
+        blk.state = Ready;
+        cv.notify_all();
+    }
+}
+
+void listreader::release_block(uint64_t index)
+{
+#ifdef USE_URING
+    if (uringON){
+        blocks[index%depth].state = Free;
+        if (index+depth<nblocks)
+            submit_block(index+depth);
+        return;
+    }
+#endif
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        blocks[index%depth].state = Free;
+    }
+    cv.notify_all();
+}
+
+bool listreader::next_block()
+{
+    //hand the current block back and wait for the next one
+    if (curdata)
+        release_block(nextindex-1);
+    curdata = 0;
+    curoffset += curlen;
+    curlen = 0;
+    curpos = 0;
+    if (!started)
+        start();
+
+    block &blk = blocks[nextindex%depth];
+#ifdef USE_URING
+    if (uringON && (nextindex>=nblocks))
+        return 0;
+    while (uringON && !((blk.state==Ready)&&(blk.index==nextindex))){
+        struct io_uring_cqe *cqe;
+        int ret = io_uring_wait_cqe(&ring, &cqe);
+        if (ret<0)
+            throw std::runtime_error(std::string("io_uring wait failed: ") + std::strerror(-ret));
+        uint64_t index = (uint64_t)(uintptr_t)io_uring_cqe_get_data(cqe);
+        block &done = blocks[index%depth];
+        if (cqe->res<0){
+            done.len = 0;
+            done.error = -cqe->res;
+        }
+        else{
+            done.len = cqe->res;
+            //complete short reads synchronously
+            uint64_t offset = index*blocksize;
+            size_t len = (filesize-offset<blocksize) ? filesize-offset : blocksize;
+            if (done.len<len){
+                ssize_t n = pread_full(fd, done.data+done.len, len-done.len, offset+done.len);
+                if (n<0) done.error = -n;
+                else done.len += n;
+            }
+        }
+        done.state = Ready;
+        io_uring_cqe_seen(&ring, cqe);
+        inflight--;
+    }
+#endif
+    if (!uringON){
+        //nblocks of a stream is set by the worker that reads its end
+        std::unique_lock<std::mutex> lock(mtx);
+        while ((nextindex<nblocks)&&!((blk.state==Ready)&&(blk.index==nextindex)))
+            cv.wait(lock);
+        if (nextindex>=nblocks)
+            return 0;
+    }
+    if (blk.error)
+        throw std::runtime_error(std::string("Error reading ") + filename.Data()
+                                 + ": " + std::strerror(blk.error));
+
+    curdata = blk.data;
+    curlen = blk.len;
+    curoffset = nextindex*blocksize;
+    nextindex++;
+    if (streamed)
+        filesize = curoffset+curlen;
+    return 1;
+}
+
+void listreader::read_slow(char *dest, size_t nbytes)
+{
+    while (nbytes>0){
+        size_t avail = curlen-curpos;
+        size_t n = (nbytes<avail) ? nbytes : avail;
+        std::memcpy(dest, curdata+curpos, n);
+        curpos += n;
+        dest += n;
+        nbytes -= n;
+        if ((nbytes>0)&&(!next_block()))
+            throw std::runtime_error(std::string("Unexpected end of file ") + filename.Data());
+    }
+}
+
+const char *listreader::viewBlock(size_t maxbytes, size_t &nbytes)
+{
+    if ((curpos==curlen)&&(!next_block())){
+        nbytes = 0;
+        return 0;
+    }
+    nbytes = curlen-curpos;
+    if (nbytes>maxbytes)
+        nbytes = maxbytes;
+    const char *p = curdata+curpos;
+    curpos += nbytes;
+    return p;
+}
+
+void listreader::peek(char *dest, size_t nbytes)
+{
+    if ((curpos==curlen)&&(!next_block()))
+        throw std::runtime_error(std::string("Unexpected end of file ") + filename.Data());
+    if (curpos+nbytes>curlen)
+        throw std::runtime_error("listreader::peek across block boundary");
+    std::memcpy(dest, curdata+curpos, nbytes);
+}
+
+void listreader::skip(uint64_t nbytes)
+{
+    while (nbytes>0){
+        size_t avail = curlen-curpos;
+        if (nbytes<=avail){
+            curpos += nbytes;
+            return;
+        }
+        nbytes -= avail;
+        curpos = curlen;
+        if (!next_block())
+            throw std::runtime_error(std::string("Unexpected end of file ") + filename.Data());
+    }
+}
+
+bool listreader::more(size_t nbytes)
+{
+    if (!streamed)
+        return tell()+nbytes<=filesize;
+    //a full block of a stream may be followed by more
+    if ((curpos==curlen)&&(!next_block()))
+        return 0;
+    return (curpos+nbytes<=curlen)||(curlen==blocksize);
+}
+
+void listreader::drain()
+{
+    if (streamed)
+        while (next_block());
+}
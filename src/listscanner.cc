@@ -0,0 +1,281 @@
+
+#include "listscanner.hh"
+
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <cerrno>
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <sstream>
+#include <thread>
+using std::cout;
+using std::cerr;
+using std::endl;
+
+listscanner::listscanner(std::string name)
+{
+    filename = name;
+    filesize = 0;
+    version = 0;
+    endsection = 0;
+    bytesafterend = 0;
+    truncated = 0;
+    nevents = 0;
+    nconfig = 0;
+    ntimeticks = 0;
+    nunknown = 0;
+    nfill = 0;
+    memset(eventtypes, 0, sizeof(eventtypes));
+    memset(modules, 0, sizeof(modules));
+}
+
+listscanner::~listscanner()
+{
+
+}
+
+int listscanner::scan()
+{
+    int fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd<0){
+        error = std::strerror(errno);
+        return 1;
+    }
+    struct stat st;
+    if (fstat(fd, &st)!=0){
+        error = std::strerror(errno);
+        close(fd);
+        return 1;
+    }
+    filesize = st.st_size;
+    if (filesize<8){
+        error = "file too short";
+        close(fd);
+        return 1;
+    }
+
+    void *map = mmap(0, filesize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map==MAP_FAILED){
+        error = std::strerror(errno);
+        return 1;
+    }
+    madvise(map, filesize, MADV_SEQUENTIAL);
+
+    const char *bytes = (const char *)map;
+    const u32 *end = (const u32 *)(bytes + (filesize & ~(uint64_t)3));
+    //MVLC frames are not walked here, convert those files to check them
+    if (std::strncmp(bytes, "MVLC", 4)==0){
+        error = "MVLC listfile, not supported by --scan";
+        munmap(map, filesize);
+        return 1;
+    }
+    if (std::strncmp(bytes, "MVME", 4)==0){
+        memcpy(&version, bytes+4, sizeof(version));
+        walk<listfile_v1>((const u32 *)(bytes+listfile_v1::FirstSectionOffset), end);
+    }
+    else{
+        walk<listfile_v0>((const u32 *)(bytes+listfile_v0::FirstSectionOffset), end);
+    }
+    munmap(map, filesize);
+
+    if (error.empty() && truncated)
+        error = "truncated section";
+    if (error.empty() && !endsection)
+        error = "no End section";
+    return !error.empty();
+}
+
+template<typename LF>
+void listscanner::walk(const u32 *p, const u32 *end)
+{
+    using namespace listfile;
+
+    while (p<end){
+        u32 sectionHeader = *p++;
+        u32 sectionType = (sectionHeader & LF::SectionTypeMask) >> LF::SectionTypeShift;
+        u32 sectionSize = (sectionHeader & LF::SectionSizeMask) >> LF::SectionSizeShift;
+        if (sectionSize>(u32)(end-p)){
+            truncated = 1;
+            return;
+        }
+        const u32 *next = p+sectionSize;
+
+        switch (sectionType){
+            case SectionType_Config:
+                nconfig++;
+                break;
+
+            case SectionType_Event:
+                {
+                    nevents++;
+                    eventtypes[(sectionHeader & LF::EventTypeMask) >> LF::EventTypeShift]++;
+
+                    //subevents, the last word is the end marker
+                    const u32 *q = p;
+                    while (q+1<next){
+                        u32 subEventHeader = *q++;
+                        u32 moduleType = (subEventHeader & LF::ModuleTypeMask) >> LF::ModuleTypeShift;
+                        u32 subEventSize = (subEventHeader & LF::SubEventSizeMask) >> LF::SubEventSizeShift;
+                        if (subEventSize>(u32)(next-q)){
+                            if (error.empty())
+                                error = "subevent larger than its event";
+                            break;
+                        }
+                        modules[moduleType & 0xff]++;
+                        uint64_t fill = 0;
+                        for (u32 i=0; i<subEventSize; i++)
+                            fill += (q[i]==0xffffffff);
+                        nfill += fill;
+                        q += subEventSize;
+                    }
+                } break;
+
+            case SectionType_Timetick:
+                ntimeticks++;
+                break;
+
+            case SectionType_End:
+                //everything behind the End section, including a partial word
+                endsection = 1;
+                bytesafterend = (end-next)*sizeof(u32) + (filesize & 3);
+                return;
+
+            default:
+                nunknown++;
+                break;
+        }
+        p = next;
+    }
+}
+
+//minimal escaping for file names in JSON strings
+static std::string quote(const std::string &s)
+{
+    std::string out = "\"";
+    for (size_t i=0; i<s.size(); i++){
+        char c = s[i];
+        if (c=='"' || c=='\\'){
+            out += '\\';
+            out += c;
+        }
+        else if ((unsigned char)c<0x20){
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\u%04x", c);
+            out += buf;
+        }
+        else{
+            out += c;
+        }
+    }
+    return out+"\"";
+}
+
+std::string listscanner::json() const
+{
+    std::ostringstream out;
+    out << "{\"file\":" << quote(filename)
+        << ",\"ok\":" << (error.empty() ? "true" : "false");
+    if (!error.empty())
+        out << ",\"error\":" << quote(error);
+    out << ",\"size\":" << filesize
+        << ",\"version\":" << version
+        << ",\"end_section\":" << (endsection ? "true" : "false")
+        << ",\"bytes_after_end\":" << bytesafterend
+        << ",\"truncated\":" << (truncated ? "true" : "false")
+        << ",\"events\":" << nevents
+        << ",\"config_sections\":" << nconfig
+        << ",\"timeticks\":" << ntimeticks
+        << ",\"unknown_sections\":" << nunknown
+        << ",\"fill_words\":" << nfill;
+
+    out << ",\"event_types\":{";
+    bool first = 1;
+    for (int i=0; i<16; i++){
+        if (!eventtypes[i]) continue;
+        out << (first ? "" : ",") << "\"" << i << "\":" << eventtypes[i];
+        first = 0;
+    }
+    out << "},\"modules\":{";
+    first = 1;
+    for (int i=0; i<256; i++){
+        if (!modules[i]) continue;
+        std::string name = listfile::get_vme_module_name((listfile::VMEModuleType)i);
+        if (name=="unknown")
+            name = "type " + std::to_string(i);
+        out << (first ? "" : ",") << quote(name) << ":" << modules[i];
+        first = 0;
+    }
+    out << "}}";
+    return out.str();
+}
+
+int listscanner::scanAll(const std::vector<std::string> &paths, int nthreads)
+{
+    //expand directories
+    std::vector<std::string> files;
+    for (size_t i=0; i<paths.size(); i++){
+        struct stat st;
+        if ((stat(paths[i].c_str(), &st)!=0)||(!S_ISDIR(st.st_mode))){
+            files.push_back(paths[i]);
+            continue;
+        }
+        std::vector<std::string> found;
+        DIR *dir = opendir(paths[i].c_str());
+        if (!dir){
+            files.push_back(paths[i]);  //reported as not readable
+            continue;
+        }
+        std::string prefix = paths[i];
+        if (prefix[prefix.size()-1]!='/')
+            prefix += '/';
+        while (struct dirent *ent = readdir(dir)){
+            std::string name = ent->d_name;
+            if ((name.size()>8)&&(name.compare(name.size()-8, 8, ".mvmelst")==0))
+                found.push_back(prefix+name);
+        }
+        closedir(dir);
+        std::sort(found.begin(), found.end());
+        files.insert(files.end(), found.begin(), found.end());
+    }
+
+    //each thread takes the next file until all are done
+    std::vector<listscanner *> scanners(files.size());
+    std::vector<int> status(files.size());
+    std::atomic<size_t> nextfile(0);
+    if (nthreads<=0)
+        nthreads = std::thread::hardware_concurrency();
+    if (nthreads<1)
+        nthreads = 1;
+    if ((size_t)nthreads>files.size())
+        nthreads = files.size();
+
+    std::vector<std::thread> threads;
+    for (int t=0; t<nthreads; t++){
+        threads.push_back(std::thread([&](){
+            size_t i;
+            while ((i = nextfile++)<files.size()){
+                scanners[i] = new listscanner(files[i]);
+                status[i] = scanners[i]->scan();
+            }
+        }));
+    }
+    for (size_t t=0; t<threads.size(); t++)
+        threads[t].join();
+
+    int nbad = 0;
+    for (size_t i=0; i<files.size(); i++){
+        cout << scanners[i]->json() << "\n";
+        nbad += status[i];
+        delete scanners[i];
+    }
+    cout.flush();
+    return nbad;
+}
@@ -0,0 +1,181 @@
+
+#include "livehistos.hh"
+
+#include "TString.h"
+#include "TH1F.h"
+#include "TH1I.h"
+#include "TROOT.h"
+#ifdef USE_HTTP
+#include "THttpServer.h"
+#endif
+
+#include <stdlib.h>
+#include <cstring>
+#include <iostream>
+using std::cout;
+using std::cerr;
+using std::endl;
+
+livehistos::livehistos(int port, double interval_s)
+{
+    calls = 0;
+    interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                   std::chrono::duration<double>(interval_s));
+    lastsnap = std::chrono::steady_clock::now();
+    pending = 0;
+    server = 0;
+    running = 0;
+    started = 0;
+    stopping = false;
+
+#ifdef USE_HTTP
+    //the server is created inside its thread, THttpServer only processes
+    //requests in the thread that made it
+    ROOT::EnableThreadSafety();
+    thread = std::thread(&livehistos::serve, this, port);
+    std::unique_lock<std::mutex> lock(mtx);
+    while (!started)
+        cv.wait(lock);
+    if (running)
+        cout << "Serving live histograms on http://localhost:" << port << endl;
+    else
+        cerr << "Could not start http server on port " << port << endl;
+#else
+    cerr << "mvme2root was built without ROOT http support, --http ignored" << endl;
+#endif
+}
+
+livehistos::~livehistos()
+{
+    stopping = true;
+    if (thread.joinable())
+        thread.join();
+    for (size_t i=0; i<snap.size(); i++)
+        delete snap[i];
+}
+
+void livehistos::serve(int port)
+{
+#ifdef USE_HTTP
+    {
+        //the engine is created on its own so a port that cannot be bound
+        //is noticed, the constructor does not tell
+        std::lock_guard<std::mutex> lock(mtx);
+        server = new THttpServer("");
+        running = server->CreateEngine(Form("http:127.0.0.1:%i", port));
+        if (running){
+            server->SetReadOnly(kTRUE);
+            server->SetTimer(0, kTRUE);     //requests are processed below
+        }
+        else{
+            delete server;
+            server = 0;
+        }
+        started = 1;
+    }
+    cv.notify_all();
+    if (!running)
+        return;
+
+    while (!stopping){
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            server->ProcessRequests();
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+
+    std::lock_guard<std::mutex> lock(mtx);
+    delete server;
+    server = 0;
+#endif
+}
+
+void livehistos::attach(const char *folder, TH1 *hist)
+{
+    if (!running)
+        return;
+    std::lock_guard<std::mutex> lock(mtx);
+
+    //keep the snapshot of an earlier file of the batch if there is one
+    for (size_t i=0; i<snap.size(); i++){
+        if ((folders[i] == folder)&&(!strcmp(snap[i]->GetName(), hist->GetName()))){
+            //SetBins reallocates the contents if the binning changed
+            live[i] = hist;
+            snap[i]->SetBins(hist->GetNbinsX(), hist->GetXaxis()->GetXmin(),
+                             hist->GetXaxis()->GetXmax());
+            return;
+        }
+    }
+
+    TH1 *copy = (TH1 *)hist->Clone();
+    copy->SetDirectory(0);
+    live.push_back(hist);
+    snap.push_back(copy);
+    folders.push_back(folder);
+#ifdef USE_HTTP
+    server->Register(Form("/%s", folder), copy);
+#endif
+}
+
+void livehistos::detach()
+{
+    if (!running)
+        return;
+
+    //final state of the file, wait for the server this time
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        for (size_t i=0; i<live.size(); i++)
+            copyContents(i);
+    }
+    for (size_t i=0; i<live.size(); i++)
+        live[i] = 0;
+    pending = 0;
+}
+
+void livehistos::poll()
+{
+    if (!running)
+        return;
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if (pending || (now-lastsnap>=interval)){
+        pending = !snapshot();
+        if (!pending)
+            lastsnap = now;
+    }
+}
+
+bool livehistos::snapshot()
+{
+    //copy the live contents, give up if the server is answering a request
+    std::unique_lock<std::mutex> lock(mtx, std::try_to_lock);
+    if (!lock.owns_lock())
+        return 0;
+    for (size_t i=0; i<live.size(); i++)
+        copyContents(i);
+    return 1;
+}
+
+//bins of a TH1F or a TH1I (--histos-only), both 4 bytes wide
+static char *binArray(TH1 *h, int &n)
+{
+    if (TH1I *hi = dynamic_cast<TH1I *>(h)){
+        n = hi->GetSize();
+        return (char *)hi->GetArray();
+    }
+    TH1F *hf = static_cast<TH1F *>(h);
+    n = hf->GetSize();
+    return (char *)hf->GetArray();
+}
+
+void livehistos::copyContents(size_t i)
+{
+    //never more than the snapshot holds, even if the binning differs
+    if (!live[i])
+        return;
+    int nlive, nsnap;
+    char *from = binArray(live[i], nlive);
+    char *to = binArray(snap[i], nsnap);
+    memcpy(to, from, ((nlive<nsnap) ? nlive : nsnap)*sizeof(float));
+}
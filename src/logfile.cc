@@ -21,6 +21,7 @@ logfile::logfile(TString name)
     //initialize variables
     start_time = TDatime();
     stop_time = TDatime();
+    found = 0;
 
     readLog();
 
@@ -51,6 +52,7 @@ int logfile::readLog(){
     }
     else{
         cout << "Found " << log_filename.Data() << endl;
+        found = 1;
     }
     
     //read file and extract start/stop date and time
@@ -73,10 +75,16 @@ int logfile::readLog(){
         }
     }while(!(infile.eof()));
 
+    writeTimes();
+
+    return 0;
+}
+
+void logfile::writeTimes(){
+    if (!found)
+        return;
     TNamed startT("start_time",start_time.AsSQLString());
     TNamed stopT("stop_time",stop_time.AsSQLString());
     startT.Write();
     stopT.Write();
-
-    return 0;
 }
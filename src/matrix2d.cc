@@ -0,0 +1,80 @@
+
+#include "matrix2d.hh"
+
+#include "TString.h"
+#include "TH2I.h"
+
+#include <algorithm>
+
+matrix2d::matrix2d(int nx_, int xshift_, int ny_, int yshift_, bool growx_, uint32_t maxnx_)
+{
+    nx = nx_;
+    maxnx = growx_ ? maxnx_ : nx;
+    if (maxnx<1)
+        maxnx = 1;
+    if (nx>maxnx)
+        nx = maxnx;
+    nout = 0;
+    ny = ny_;
+    xshift = xshift_;
+    yshift = yshift_;
+    growx = growx_;
+    counts.assign((size_t)nx*ny, 0);
+}
+
+matrix2d::~matrix2d()
+{
+
+}
+
+void matrix2d::grow(uint32_t n)
+{
+    //double, so a long run does not reallocate every bin
+    uint64_t newnx = nx ? nx : 1;
+    while (newnx<n)
+        newnx *= 2;
+    if (newnx>maxnx)
+        newnx = maxnx;
+    counts.resize((size_t)newnx*ny, 0);
+    nx = newnx;
+}
+
+void matrix2d::reset()
+{
+    std::fill(counts.begin(), counts.end(), 0);
+    nout = 0;
+}
+
+TH2I *matrix2d::makeHist(TString name, TString title) const
+{
+    //trim unused bins at the end of a growing axis
+    uint32_t usedx = nx;
+    if (growx){
+        while ((usedx>0)&&(counts.size()>0)){
+            bool empty = 1;
+            for (uint32_t y=0; y<ny; y++)
+                empty &= (counts[(size_t)(usedx-1)*ny+y]==0);
+            if (!empty)
+                break;
+            usedx--;
+        }
+        if (usedx==0)
+            usedx = 1;
+    }
+
+    TH2I *hist = new TH2I(name, title, usedx, 0, (double)usedx*(1<<xshift),
+                          ny, 0, (double)ny*(1<<yshift));
+    hist->SetDirectory(0);      //written and deleted by the caller
+    double entries = 0;
+    for (uint32_t x=0; x<usedx; x++){
+        const uint32_t *col = &counts[(size_t)x*ny];
+        for (uint32_t y=0; y<ny; y++){
+            if (col[y]){
+                hist->SetBinContent(x+1, y+1, col[y]);
+                entries += col[y];
+            }
+        }
+    }
+    hist->SetEntries(entries);
+    return hist;
+}
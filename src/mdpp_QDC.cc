@@ -0,0 +1,512 @@
+
+#include "mdpp_QDC.hh"
+#include "livehistos.hh"
+#include "eventselector.hh"
+
+#include "TTree.h"
+#include "TString.h"
+#include "TDatime.h"
+
+#include <stdlib.h>
+#include <cerrno>
+#include <iostream>
+#include <fstream>
+using std::cout;
+using std::cerr;
+using std::endl;
+
+template<int NCHN>
+mdpp_QDC<NCHN>::mdpp_QDC(TString name, bool sparse, bool hist, bool histos)
+{
+    filename = name;
+    psdsparse = sparse;
+    psdhist = hist;
+
+    //initialize variables
+    fillON = 1;
+    treeON = 1;
+    histsON = histos;
+    nPSD = 0;
+    histshift = 0;
+    treebytes = 0;
+    spectra = 0;
+    mADC_chn = 0;
+    for (int i=0; i<num_chn; i++){
+        mADC_TDC[i] = 0;
+        hADC_long[i] = 0;
+        hADC_short[i] = 0;
+        hTDC[i] = 0;
+        hPSD[i] = 0;
+        hLongPSD[i] = 0;
+    }
+    longdirty = allmask;
+    shortdirty = allmask;
+    tdcdirty = allmask;
+    extendedON = 0;
+    time_stamp = 0;
+    extendedtime = 0;
+    hitmask = 0;
+    mult = 0;
+    initEvent();
+
+    makeTree();
+    if (histsON)
+        makeHistos();
+}
+
+template<int NCHN>
+void mdpp_QDC<NCHN>::makeTree()
+{
+    //tree in the current directory
+    roottree = new TTree(Form("MDPP%i_QDC", num_chn), Form("MDPP%i data", num_chn));
+
+    roottree->Branch(Form("ADC_short[%i]", num_chn), &ADC_short, Form("ADC_short[%i]/I", num_chn));
+    roottree->Branch(Form("ADC_long[%i]", num_chn), &ADC_long, Form("ADC_long[%i]/I", num_chn));
+    roottree->Branch(Form("TDC[%i]", num_chn), &TDC, Form("TDC[%i]/I", num_chn));
+    roottree->Branch(Form("overflow[%i]", num_chn), &overflow, Form("overflow[%i]/O", num_chn));
+    roottree->Branch(Form("Trigger[%i]", num_trigger), &Trigger, Form("Trigger[%i]/I", num_trigger));
+    roottree->Branch("time_stamp", &time_stamp);
+    roottree->Branch("extendedtime", &extendedtime);
+    roottree->Branch("seconds", &seconds);
+    if (psdsparse){
+        roottree->Branch("nPSD", &nPSD, "nPSD/I");
+        roottree->Branch("PSDchn", PSDchn, "PSDchn[nPSD]/I");
+        roottree->Branch("PSDval", PSDval, "PSDval[nPSD]/D");
+    }
+    else{
+        roottree->Branch(Form("PSD[%i]", num_chn), &PSD, Form("PSD[%i]/D", num_chn));
+    }
+    if (treebytes>0)
+        configureTree();
+}
+
+template<int NCHN>
+void mdpp_QDC<NCHN>::makeHistos()
+{
+    //create histograms, MDPP-32 names get a prefix so they do not replace
+    //the MDPP-16 ones in memory
+    TString hp = (num_chn==16) ? "" : Form("%s_", label());
+    int nbins = (16*4096) >> histshift;
+    for (int i=0; i<num_chn; i++){
+        hADC_long[i] = makeSpectrum(!treeON, Form("%shADC_long%i", hp.Data(), i), Form("hADC_long%i", i), 4096, 0, 4096);
+        hADC_short[i] = makeSpectrum(!treeON, Form("%shADC_short%i", hp.Data(), i), Form("hADC_short%i", i), 4096, 0, 4096);
+        hTDC[i] = makeSpectrum(!treeON, Form("%shTDC_QDC%i", hp.Data(), i), Form("hTDC%i", i), nbins, 0, 16*4096);
+        hPSD[i]  = makeSpectrum(!treeON, Form("%shPSD%i", hp.Data(), i), Form("hPSD%i", i), 4096, -4.096, 4.096);
+        hLongPSD[i] = 0;
+        //PSD is negative when the short integral is over the long one
+        //(noise, pileup), those go below 0 instead of into the underflow
+        if (psdhist)
+            hLongPSD[i] = new TH2F(Form("%shLongPSD%i", hp.Data(), i), Form("hLongPSD%i", i),
+                                   512, 0, 4096, 1024, -1.024, 1.024);
+    }
+}
+
+template<int NCHN>
+void mdpp_QDC<NCHN>::nextFile()
+{
+    //closing the previous file deleted its tree and histograms, start new
+    //ones in the current directory
+    if (treeON)
+        makeTree();
+    if (histsON)
+        makeHistos();
+    for (int i=0; i<num_chn; i++){
+        if (mADC_TDC[i])
+            mADC_TDC[i]->reset();
+    }
+    if (mADC_chn)
+        mADC_chn->reset();
+}
+
+template<int NCHN>
+mdpp_QDC<NCHN>::~mdpp_QDC()
+{
+    for (int i=0; i<num_chn; i++){
+        delete mADC_TDC[i];
+    }
+    delete mADC_chn;
+}
+
+template<int NCHN>
+void mdpp_QDC<NCHN>::initEvent()
+{
+    //call at start of event
+    lasttime = time_stamp;
+    time_stamp = 0;
+    seconds = 0;
+    for (int i=0; i<num_trigger; i++){
+        Trigger[i] = 0;
+    }
+    //only the channels the last event set
+    for (uint32_t mask=longdirty; mask; mask&=mask-1){
+        int i = __builtin_ctz(mask);
+        ADC_long[i] = 0;
+        overflow[i] = 0;
+    }
+    for (uint32_t mask=shortdirty; mask; mask&=mask-1)
+        ADC_short[__builtin_ctz(mask)] = 0;
+    for (uint32_t mask=tdcdirty; mask; mask&=mask-1)
+        TDC[__builtin_ctz(mask)] = 0;
+    longdirty = 0;
+    shortdirty = 0;
+    tdcdirty = 0;
+}
+
+template<int NCHN>
+void mdpp_QDC<NCHN>::endEvent()
+{
+    //call at end of event
+    if ((time_stamp<lasttime)&&(extendedON==0))
+        extendedtime++;
+
+    //Calculated values
+    seconds = extendedtime*67.108864 + time_stamp/16000000.;
+    hitmask = 0;
+    for (int i=0; i<num_chn; i++){
+        hitmask |= (uint32_t)(ADC_long[i]>0) << i;
+    }
+    mult = __builtin_popcount(hitmask);
+
+    computePSD();
+
+    //histograms for the fired channels only
+    for (uint32_t mask=hitmask; mask; mask&=mask-1){
+        int i = __builtin_ctz(mask);
+        hPSD[i]->Fill(PSD[i]);
+        if (hLongPSD[i])
+            hLongPSD[i]->Fill(ADC_long[i], PSD[i]);
+    }
+
+    //2D spectra, fired channels only
+    if (spectra){
+        for (uint32_t mask=hitmask; mask; mask&=mask-1){
+            int i = __builtin_ctz(mask);
+            if (mADC_TDC[i])
+                mADC_TDC[i]->fill(TDC[i], ADC_long[i]);
+            if (mADC_chn)
+                mADC_chn->fill(i, ADC_long[i]);
+        }
+    }
+}
+
+template<int NCHN>
+void mdpp_QDC<NCHN>::computePSD()
+{
+    //PSD only where there is a long integral. No branches in the loop, the
+    //denominator is 1 for empty channels, so it vectorizes and never divides
+    //by zero
+    for (int i=0; i<num_chn; i++){
+        bool valid = ADC_long[i]>0;
+        double along = ADC_long[i];
+        PSD[i] = valid*(along-ADC_short[i])/(along+!valid);
+    }
+    if (psdsparse){
+        nPSD = 0;
+        for (int i=0; i<num_chn; i++){
+            PSDchn[nPSD] = i;
+            PSDval[nPSD] = PSD[i];
+            nPSD += ADC_long[i]>0;
+        }
+    }
+}
+
+template<int NCHN>
+void mdpp_QDC<NCHN>::writeEvent()
+{
+    //call after endEvent for events that are kept
+    if (fillON)
+        roottree->Fill();
+}
+
+template<int NCHN>
+void mdpp_QDC<NCHN>::writeTree()
+{
+    //call at end of file
+    roottree->Write();
+    
+}
+
+template<int NCHN>
+void mdpp_QDC<NCHN>::writeHistos()
+{
+    for (int i=0; i<num_chn; i++){
+        hADC_short[i]->Write(Form("hADC_short%i", i));
+        hADC_long[i]->Write(Form("hADC_long%i", i));
+        hTDC[i]->Write(Form("hTDC%i", i));
+        hPSD[i]->Write(Form("hPSD%i", i));
+        if (hLongPSD[i])
+            hLongPSD[i]->Write(Form("hLongPSD%i", i));
+    }
+
+    //2D spectra, converted once from the accumulators
+    for (int i=0; i<num_chn; i++){
+        if (mADC_TDC[i]){
+            TH2I *h = mADC_TDC[i]->makeHist(Form("hADC_long_TDC%i", i), Form("ADC_long vs TDC %i;TDC;ADC_long", i));
+            h->Write();
+            delete h;
+        }
+    }
+    if (mADC_chn){
+        TH2I *h = mADC_chn->makeHist("hADC_long_chn", "ADC_long vs channel;channel;ADC_long");
+        h->Write();
+        delete h;
+    }
+}
+
+
+template<int NCHN>
+void mdpp_QDC<NCHN>::fillRecord(shmrecord *rec)
+{
+    //copy the current event into a shared memory record
+    rec->num_chn = num_chn;
+    rec->time_stamp = time_stamp;
+    rec->extendedtime = extendedtime;
+    rec->seconds = seconds;
+    rec->hitmask = hitmask;
+    rec->pileupmask = 0;
+    rec->overflowmask = 0;
+    for (int i=0; i<num_chn; i++){
+        rec->ADC[i] = ADC_long[i];
+        rec->ADC_short[i] = ADC_short[i];
+        rec->TDC[i] = TDC[i];
+        rec->overflowmask |= (uint32_t)overflow[i] << i;
+    }
+    for (int i=0; i<num_trigger; i++){
+        rec->Trigger[i] = Trigger[i];
+    }
+}
+
+
+template<int NCHN>
+void mdpp_QDC<NCHN>::loadRecord(const shmrecord *rec)
+{
+    //restore an event copied with fillRecord, for the --split-events writers
+    time_stamp = rec->time_stamp;
+    extendedtime = rec->extendedtime;
+    seconds = rec->seconds;
+    hitmask = rec->hitmask;
+    mult = __builtin_popcount(hitmask);
+    longdirty = allmask;
+    shortdirty = allmask;
+    tdcdirty = allmask;
+    for (int i=0; i<num_chn; i++){
+        ADC_long[i] = rec->ADC[i];
+        ADC_short[i] = rec->ADC_short[i];
+        TDC[i] = rec->TDC[i];
+        overflow[i] = (rec->overflowmask >> i) & 1;
+    }
+    for (int i=0; i<num_trigger; i++){
+        Trigger[i] = rec->Trigger[i];
+    }
+    computePSD();
+}
+
+
+template<int NCHN>
+void mdpp_QDC<NCHN>::attachLive(livehistos *live)
+{
+    for (int i=0; i<num_chn; i++){
+        live->attach(label(), hADC_long[i]);
+        live->attach(label(), hADC_short[i]);
+        live->attach(label(), hTDC[i]);
+        live->attach(label(), hPSD[i]);
+    }
+}
+
+
+template<int NCHN>
+void mdpp_QDC<NCHN>::registerVariables(eventselector &sel, const char *prefix)
+{
+    sel.addVariable(Form("%s.ADC_long", prefix), ADC_long, num_chn);
+    sel.addVariable(Form("%s.ADC_short", prefix), ADC_short, num_chn);
+    sel.addVariable(Form("%s.TDC", prefix), TDC, num_chn);
+    sel.addVariable(Form("%s.PSD", prefix), PSD, num_chn);
+    sel.addVariable(Form("%s.overflow", prefix), overflow, num_chn);
+    sel.addVariable(Form("%s.Trigger", prefix), Trigger, num_trigger);
+    sel.addVariable(Form("%s.time_stamp", prefix), &time_stamp);
+    sel.addVariable(Form("%s.extendedtime", prefix), &extendedtime);
+    sel.addVariable(Form("%s.seconds", prefix), &seconds);
+    sel.addVariable(Form("%s.mask", prefix), &hitmask);
+    sel.addVariable(Form("%s.mult", prefix), &mult);
+}
+
+
+template<int NCHN>
+void mdpp_QDC<NCHN>::printValues()
+{
+    
+    cout << "Chn \t ADC \t TDC" << endl;
+    for (int i=0; i<num_chn; i++){
+        cout << "-- " << i << " --" << endl;
+        cout << "ADC short: " << ADC_short[i] << "\tADC_long: " << ADC_long[i] << "\tTDC: " << TDC[i] << endl;
+        cout << "Overflow/underflow flag:\t" << overflow[i] << endl;
+    }
+    for (int i=0; i<num_trigger; i++){
+        cout << "Trigger " << i << ":\t" << Trigger[i] << endl;
+    }
+    cout << "Time:\t" <<time_stamp << endl;
+    cout << "Extended time:\t" << extendedtime << endl;
+
+}
+
+//setters
+template<int NCHN>
+void mdpp_QDC<NCHN>::setADC(int chn, int value){ 
+    if (chn<num_chn){
+        ADC_long[chn%num_chn] = value; 
+        longdirty |= 1u << chn;
+        hADC_long[chn%num_chn]->AddBinContent(value);
+    }
+    else if(chn<2*num_chn){
+        TDC[chn%num_chn] = value;
+        tdcdirty |= 1u << (chn%num_chn);
+        hTDC[chn%num_chn]->AddBinContent(value>>histshift);
+    }
+    else if(chn<3*num_chn){
+        Trigger[chn%num_trigger] = value;
+    }
+    else if(chn<4*num_chn){
+        ADC_short[chn%num_chn] = value; 
+        shortdirty |= 1u << (chn%num_chn);
+        hADC_short[chn%num_chn]->AddBinContent(value);
+    }
+}
+
+template<int NCHN>
+void mdpp_QDC<NCHN>::setADC_short(int chn, int value){ 
+    ADC_short[chn%num_chn] = value; 
+    shortdirty |= 1u << (chn%num_chn);
+    hADC_short[chn%num_chn]->AddBinContent(value);
+}
+
+template<int NCHN>
+void mdpp_QDC<NCHN>::setADC_long(int chn, int value){ 
+    ADC_long[chn%num_chn] = value; 
+    longdirty |= 1u << (chn%num_chn);
+    hADC_long[chn%num_chn]->AddBinContent(value);
+}
+
+template<int NCHN>
+void mdpp_QDC<NCHN>::setTDC(int chn, int value){
+    TDC[chn%num_chn] = value; 
+    tdcdirty |= 1u << (chn%num_chn);
+    hTDC[chn%num_chn]->AddBinContent(value>>histshift);
+}
+
+template<int NCHN>
+void mdpp_QDC<NCHN>::setTrigger(int chn, int value){
+    Trigger[chn%num_trigger] = value; 
+}
+
+template<int NCHN>
+void mdpp_QDC<NCHN>::setTime(int value){
+    time_stamp = value;
+}
+
+template<int NCHN>
+void mdpp_QDC<NCHN>::setExtendedTime(int value){
+    extendedON = 1;
+    extendedtime = value; 
+}
+
+template<int NCHN>
+void mdpp_QDC<NCHN>::setOverflow(int chn, bool value){
+    overflow[chn%num_chn] = value;
+    longdirty |= 1u << (chn%num_chn);
+}
+
+template<int NCHN>
+void mdpp_QDC<NCHN>::setFillTree(bool value){
+    fillON = value;
+}
+
+template<int NCHN>
+void mdpp_QDC<NCHN>::dropTree(){
+    //the tree was made in the constructor, nextFile makes no new one
+    fillON = 0;
+    treeON = 0;
+    delete roottree;
+    roottree = 0;
+
+    //the spectra again, as TH1I
+    if (histsON){
+        for (int i=0; i<num_chn; i++){
+            delete hADC_long[i];
+            delete hADC_short[i];
+            delete hTDC[i];
+            delete hPSD[i];
+            delete hLongPSD[i];
+        }
+        makeHistos();
+    }
+}
+
+template<int NCHN>
+void mdpp_QDC<NCHN>::setMemoryBudget(size_t bytes){
+    //the --2d accumulators first
+    size_t matrixbytes = spectraBytes();
+    if (matrixbytes>bytes/2)
+        cout << "Memory budget: " << label() << " --2d spectra need " << matrixbytes/(1024*1024)
+             << " MB of the " << bytes/(1024*1024) << " MB" << endl;
+    bytes = (bytes>matrixbytes) ? bytes-matrixbytes : 0;
+
+    //half for the spectra (all without a tree): the 4k bin ones are kept,
+    //the 64k bin TDC spectra are halved until everything fits
+    size_t spectrabytes = treeON ? bytes/2 : bytes;
+    size_t fixed = 3*num_chn*(4096+2)*sizeof(float);
+    if (hLongPSD[0])
+        fixed += num_chn*(512+2)*(1024+2)*sizeof(float);
+    int nbins = 16*4096;
+    while ((nbins>4096)&&(fixed+num_chn*(nbins+2)*sizeof(float)>spectrabytes)){
+        nbins /= 2;
+        histshift++;
+    }
+    if (histshift>0){
+        for (int i=0; i<num_chn; i++)
+            hTDC[i]->SetBins(nbins, 0, 16*4096);
+        cout << "Memory budget: " << label() << " TDC spectra reduced to " << nbins << " bins" << endl;
+    }
+
+    //half for the tree
+    if (treeON){
+        treebytes = bytes/2;
+        configureTree();
+    }
+}
+
+template<int NCHN>
+void mdpp_QDC<NCHN>::configureTree(){
+    //small baskets, flushed to the file before treebytes are buffered
+    int nbranches = roottree->GetListOfBranches()->GetEntriesFast();
+    Long64_t basket = treebytes/(4*nbranches);
+    if (basket>32000) basket = 32000;
+    if (basket<4096) basket = 4096;
+    roottree->SetBasketSize("*", basket);
+    roottree->SetAutoFlush(-treebytes/2);
+}
+
+template<int NCHN>
+void mdpp_QDC<NCHN>::setSpectra(int which){
+    spectra = which;
+    if (which & Spectrum_ADC_TDC){
+        for (int i=0; i<num_chn; i++)
+            mADC_TDC[i] = new matrix2d(512, 7, 512, 7);
+    }
+    if (which & Spectrum_ADC_chn)
+        mADC_chn = new matrix2d(num_chn, 0, 4096, 4);
+}
+
+template<int NCHN>
+size_t mdpp_QDC<NCHN>::spectraBytes() const{
+    size_t n = 0;
+    for (int i=0; i<num_chn; i++){
+        if (mADC_TDC[i])
+            n += mADC_TDC[i]->maxBytes();
+    }
+    if (mADC_chn)
+        n += mADC_chn->maxBytes();
+    return n;
+}
+
+template class mdpp_QDC<16>;
+template class mdpp_QDC<32>;
@@ -0,0 +1,558 @@
+
+#include "mdpp_SCP.hh"
+#include "livehistos.hh"
+#include "eventselector.hh"
+
+#include "TTree.h"
+#include "TString.h"
+#include "TDatime.h"
+
+#include <stdlib.h>
+#include <cerrno>
+#include <iostream>
+#include <fstream>
+using std::cout;
+using std::cerr;
+using std::endl;
+
+template<int NCHN>
+mdpp_SCP<NCHN>::mdpp_SCP(TString name, bool histos)
+{
+    filename = name;
+
+    //initialize variables
+    fillON = 1;
+    treeON = 1;
+    histsON = histos;
+    extendedON = 0;
+    time_stamp = 0;
+    extendedtime = 0;
+    hitmask = 0;
+    mult = 0;
+    histshift = 0;
+    treebytes = 0;
+    spectra = 0;
+    mADC_chn = 0;
+    for (int i=0; i<num_chn; i++){
+        mADC_TDC[i] = 0;
+        hADC[i] = 0;
+        hTDC[i] = 0;
+        hEn[i] = 0;
+    }
+    adcdirty = allmask;
+    tdcdirty = allmask;
+    b.ResizeTo(num_chn);
+    m.ResizeTo(num_chn);
+    for (int i=0; i<num_chn; i++){
+        b[i] = 0;
+        m[i] = 1;
+        min[i] = 0;
+        max[i] = 16*4096;
+    }
+    initEvent();
+
+    if (histsON)
+        readAnalysis();
+
+    makeTree();
+    if (histsON)
+        makeHistos();
+}
+
+template<int NCHN>
+void mdpp_SCP<NCHN>::makeTree()
+{
+    //tree in the current directory
+    roottree = new TTree(Form("MDPP%i_SCP", num_chn), Form("MDPP%i data", num_chn));
+
+    roottree->Branch(Form("ADC[%i]", num_chn), &ADC, Form("ADC[%i]/I", num_chn));
+    roottree->Branch(Form("TDC[%i]", num_chn), &TDC, Form("TDC[%i]/I", num_chn));
+    roottree->Branch("time_stamp", &time_stamp);
+    roottree->Branch("extendedtime", &extendedtime);
+    roottree->Branch(Form("overflow[%i]", num_chn), &overflow, Form("overflow[%i]/O", num_chn));
+    roottree->Branch(Form("pileup[%i]", num_chn), &pileup, Form("pileup[%i]/O", num_chn));
+    roottree->Branch(Form("Trigger[%i]", num_trigger), &Trigger, Form("Trigger[%i]/I", num_trigger));
+    roottree->Branch("seconds", &seconds);
+    if (treebytes>0)
+        configureTree();
+}
+
+template<int NCHN>
+void mdpp_SCP<NCHN>::makeHistos()
+{
+    //create histograms, MDPP-32 names get a prefix so they do not replace
+    //the MDPP-16 ones in memory
+    TString hp = (num_chn==16) ? "" : Form("%s_", label());
+    int nbins = (16*4096) >> histshift;
+    for (int i=0; i<num_chn; i++){
+        hADC[i] = makeSpectrum(!treeON, Form("%shADC%i", hp.Data(), i), Form("hADC%i", i), nbins, 0, 16*4096);
+        hTDC[i] = makeSpectrum(!treeON, Form("%shTDC_SCP%i", hp.Data(), i), Form("hTDC%i", i), nbins, 0, 16*4096);
+        hEn[i]  = makeSpectrum(!treeON, Form("%shEn%i", hp.Data(), i),  Form("hEn%i", i),  nbins, min[i], max[i]);
+    }
+}
+
+template<int NCHN>
+void mdpp_SCP<NCHN>::nextFile()
+{
+    //closing the previous file deleted its tree and histograms, start new
+    //ones in the current directory
+    if (treeON)
+        makeTree();
+    if (histsON)
+        makeHistos();
+    for (int i=0; i<num_chn; i++){
+        if (mADC_TDC[i])
+            mADC_TDC[i]->reset();
+    }
+    if (mADC_chn)
+        mADC_chn->reset();
+}
+
+template<int NCHN>
+mdpp_SCP<NCHN>::~mdpp_SCP()
+{
+    for (int i=0; i<num_chn; i++){
+        delete mADC_TDC[i];
+    }
+    delete mADC_chn;
+}
+
+template<int NCHN>
+void mdpp_SCP<NCHN>::initEvent()
+{
+    //call at start of event
+    lasttime = time_stamp;
+    time_stamp = 0;
+    seconds = 0;
+    for (int i=0; i<num_trigger; i++){
+        Trigger[i] = 0;
+    }
+    //only the channels the last event set
+    for (uint32_t mask=adcdirty; mask; mask&=mask-1){
+        int i = __builtin_ctz(mask);
+        ADC[i] = 0;
+        pileup[i] = 0;
+        overflow[i] = 0;
+    }
+    for (uint32_t mask=tdcdirty; mask; mask&=mask-1)
+        TDC[__builtin_ctz(mask)] = 0;
+    adcdirty = 0;
+    tdcdirty = 0;
+}
+
+template<int NCHN>
+void mdpp_SCP<NCHN>::endEvent()
+{
+    //call at end of event
+    if ((time_stamp<lasttime)&&(extendedON==0))
+        extendedtime++;
+    seconds = extendedtime*67.108864 + time_stamp/16000000.;
+
+    hitmask = 0;
+    for (int i=0; i<num_chn; i++){
+        hitmask |= (uint32_t)(ADC[i]!=0) << i;
+    }
+    mult = __builtin_popcount(hitmask);
+    //2D spectra, fired channels only
+    if (spectra){
+        for (uint32_t mask=hitmask; mask; mask&=mask-1){
+            int i = __builtin_ctz(mask);
+            if (mADC_TDC[i])
+                mADC_TDC[i]->fill(TDC[i], ADC[i]);
+            if (mADC_chn)
+                mADC_chn->fill(i, ADC[i]);
+        }
+    }
+}
+
+template<int NCHN>
+void mdpp_SCP<NCHN>::writeEvent()
+{
+    //call after endEvent for events that are kept
+    if (fillON)
+        roottree->Fill();
+}
+
+template<int NCHN>
+void mdpp_SCP<NCHN>::writeTree()
+{
+    //call at end of file
+    roottree->Write();
+}
+
+template<int NCHN>
+void mdpp_SCP<NCHN>::writeCalibration()
+{
+    //also without tree, --merge and --recalibrate look for them
+    m.Write(Form("m[%i]", num_chn));
+    b.Write(Form("b[%i]", num_chn));
+}
+
+template<int NCHN>
+void mdpp_SCP<NCHN>::writeHistos()
+{
+    for (int i=0; i<num_chn; i++){
+        hADC[i]->Write(Form("hADC%i", i));
+        hTDC[i]->Write(Form("hTDC%i", i));
+        hEn[i]->Write(Form("hEn%i", i));
+    }
+
+    //2D spectra, converted once from the accumulators
+    for (int i=0; i<num_chn; i++){
+        if (mADC_TDC[i]){
+            TH2I *h = mADC_TDC[i]->makeHist(Form("hADC_TDC%i", i), Form("ADC vs TDC %i;TDC;ADC", i));
+            h->Write();
+            delete h;
+        }
+    }
+    if (mADC_chn){
+        TH2I *h = mADC_chn->makeHist("hADC_chn", "ADC vs channel;channel;ADC");
+        h->Write();
+        delete h;
+    }
+}
+
+
+template<int NCHN>
+void mdpp_SCP<NCHN>::fillRecord(shmrecord *rec)
+{
+    //copy the current event into a shared memory record
+    rec->num_chn = num_chn;
+    rec->time_stamp = time_stamp;
+    rec->extendedtime = extendedtime;
+    rec->seconds = seconds;
+    rec->hitmask = hitmask;
+    rec->pileupmask = 0;
+    rec->overflowmask = 0;
+    for (int i=0; i<num_chn; i++){
+        rec->ADC[i] = ADC[i];
+        rec->ADC_short[i] = 0;
+        rec->TDC[i] = TDC[i];
+        rec->pileupmask |= (uint32_t)pileup[i] << i;
+        rec->overflowmask |= (uint32_t)overflow[i] << i;
+    }
+    for (int i=0; i<num_trigger; i++){
+        rec->Trigger[i] = Trigger[i];
+    }
+}
+
+
+template<int NCHN>
+void mdpp_SCP<NCHN>::loadRecord(const shmrecord *rec)
+{
+    //restore an event copied with fillRecord, for the --split-events writers
+    time_stamp = rec->time_stamp;
+    extendedtime = rec->extendedtime;
+    seconds = rec->seconds;
+    hitmask = rec->hitmask;
+    mult = __builtin_popcount(hitmask);
+    adcdirty = allmask;
+    tdcdirty = allmask;
+    for (int i=0; i<num_chn; i++){
+        ADC[i] = rec->ADC[i];
+        TDC[i] = rec->TDC[i];
+        pileup[i] = (rec->pileupmask >> i) & 1;
+        overflow[i] = (rec->overflowmask >> i) & 1;
+    }
+    for (int i=0; i<num_trigger; i++){
+        Trigger[i] = rec->Trigger[i];
+    }
+}
+
+
+template<int NCHN>
+void mdpp_SCP<NCHN>::attachLive(livehistos *live)
+{
+    for (int i=0; i<num_chn; i++){
+        live->attach(label(), hADC[i]);
+        live->attach(label(), hTDC[i]);
+        live->attach(label(), hEn[i]);
+    }
+}
+
+
+template<int NCHN>
+void mdpp_SCP<NCHN>::registerVariables(eventselector &sel, const char *prefix)
+{
+    sel.addVariable(Form("%s.ADC", prefix), ADC, num_chn);
+    sel.addVariable(Form("%s.TDC", prefix), TDC, num_chn);
+    sel.addVariable(Form("%s.pileup", prefix), pileup, num_chn);
+    sel.addVariable(Form("%s.overflow", prefix), overflow, num_chn);
+    sel.addVariable(Form("%s.Trigger", prefix), Trigger, num_trigger);
+    sel.addVariable(Form("%s.time_stamp", prefix), &time_stamp);
+    sel.addVariable(Form("%s.extendedtime", prefix), &extendedtime);
+    sel.addVariable(Form("%s.seconds", prefix), &seconds);
+    sel.addVariable(Form("%s.mask", prefix), &hitmask);
+    sel.addVariable(Form("%s.mult", prefix), &mult);
+}
+
+
+template<int NCHN>
+void mdpp_SCP<NCHN>::printValues()
+{
+    
+    cout << "Chn \t ADC \t TDC" << endl;
+    for (int i=0; i<num_chn; i++){
+        cout << "-- Channel " << i << " --" << endl;
+        cout << "ADC: " << ADC[i] << "\tTDC: " << TDC[i] << endl;
+        cout << "Pileup flag:\t" << pileup[i] << endl;
+        cout << "Overflow/underflow flag:\t" << overflow[i] << endl;
+    }
+    for (int i=0; i<num_trigger; i++){
+        cout << "Trigger " << i << ":\t" << Trigger[i] << endl;
+    }
+    cout << "Time:\t" <<time_stamp << endl;
+    cout << "Extended time:\t" << extendedtime << endl;
+
+}
+
+template<int NCHN>
+int mdpp_SCP<NCHN>::readAnalysis(){
+    
+    //open analysis.analysis
+    TString analysis_filename = filename;
+    int index = analysis_filename.Last('/');
+    analysis_filename.Remove(index+1,analysis_filename.Sizeof());
+    analysis_filename.Append("analysis.analysis");
+    if (readCalibration(analysis_filename, min, max))
+        return 1;
+
+    //linear calibration parameters
+    for (int i=0; i<num_chn; i++){
+        b[i] = min[i];
+        m[i] = (max[i]-min[i])/65536.;
+    }
+
+    return 0;
+}
+
+template<int NCHN>
+void mdpp_SCP<NCHN>::copyCalibration(const mdpp_SCP &other){
+    m = other.m;
+    b = other.b;
+    for (int i=0; i<num_chn; i++){
+        min[i] = other.min[i];
+        max[i] = other.max[i];
+    }
+}
+
+template<int NCHN>
+int mdpp_SCP<NCHN>::readCalibration(TString analysis_filename, double *min, double *max){
+
+    //variables
+    char line[200];
+    TString sLine;
+
+    std::ifstream infile(analysis_filename.Data());
+    if (!infile.is_open())
+    {
+        cerr << "Error opening " << analysis_filename.Data() 
+             << " for reading" << endl;
+        return 1;
+    }
+    else{
+        cout << "Found " << analysis_filename.Data() << endl;
+    } //read file
+    bool foundCal = 0;
+    do{
+        infile.getline(line,200);
+        sLine = line;
+        //search for amplitude calibration
+        if (sLine.Contains("\"analysis::CalibrationMinMax\"")){
+            //forward to calibrations 
+            int maxitr = 7;
+            int itr = 0;
+            do{
+                infile.getline(line,200);
+                sLine = line;
+                itr++;
+            }while((itr<maxitr)&&(!(sLine.Contains("\"calibrations\":"))));
+            //get calibration for each chn
+            for (int i=0; i<num_chn; i++){
+
+                for (int j=0; j<4; j++){
+                    infile.getline(line,200); 
+                    sLine = line;
+                    sLine.ReplaceAll(" ","");
+                    sLine.ReplaceAll("\"","");
+                    sLine.ReplaceAll(":","");
+                    sLine.ReplaceAll(",","");
+
+                    if (sLine.Contains("unitMax")){
+                        sLine.ReplaceAll("unitMax","");
+                        max[i] = sLine.Atof();
+                    }
+                    else if (sLine.Contains("unitMin")){
+                        sLine.ReplaceAll("unitMin","");
+                        min[i] = sLine.Atof();
+                    }
+                    else if (sLine.Contains("]")){
+                        i=num_chn;
+                        j=4;
+                    }
+                }
+            }
+            itr=0;
+            do{
+                infile.getline(line,200);
+                sLine = line;
+                if (sLine.Contains("amplitude")){
+                    cout << "Found ADC calibration" << endl;
+                    foundCal=1;
+                }
+                itr++;
+            }while((itr<maxitr)&&(!(sLine.Contains("name"))));
+        }
+    }while(!(foundCal||infile.eof()));
+
+    return 0;
+}
+
+
+//setters
+template<int NCHN>
+void mdpp_SCP<NCHN>::setADC(int chn, int value){ 
+    if (chn<num_chn){
+        ADC[chn] = value; 
+        adcdirty |= 1u << chn;
+        hADC[chn%num_chn]->AddBinContent(value>>histshift);
+        hEn[chn%num_chn]->AddBinContent(value>>histshift);
+    }
+    else if(chn<2*num_chn){
+        TDC[chn%num_chn] = value;
+        tdcdirty |= 1u << (chn%num_chn);
+        hTDC[chn%num_chn]->AddBinContent(value>>histshift);
+    }
+    else if(chn<3*num_chn){
+        Trigger[chn%num_trigger] = value; 
+    }
+}
+
+template<int NCHN>
+void mdpp_SCP<NCHN>::setTDC(int chn, int value){
+    TDC[chn%num_chn] = value; 
+    tdcdirty |= 1u << (chn%num_chn);
+    hTDC[chn%num_chn]->AddBinContent(value>>histshift);
+}
+
+template<int NCHN>
+void mdpp_SCP<NCHN>::setTrigger(int chn, int value){
+    Trigger[chn%num_trigger] = value; 
+}
+
+template<int NCHN>
+void mdpp_SCP<NCHN>::setTime(int value){
+    time_stamp = value;
+}
+
+template<int NCHN>
+void mdpp_SCP<NCHN>::setExtendedTime(int value){
+    extendedON = 1;
+    extendedtime = value; 
+}
+
+template<int NCHN>
+void mdpp_SCP<NCHN>::setPileup(int chn, bool value){
+    pileup[chn%num_chn] = value;
+    adcdirty |= 1u << (chn%num_chn);
+}
+
+template<int NCHN>
+void mdpp_SCP<NCHN>::setOverflow(int chn, bool value){
+    overflow[chn%num_chn] = value;
+    adcdirty |= 1u << (chn%num_chn);
+}
+
+template<int NCHN>
+void mdpp_SCP<NCHN>::setFillTree(bool value){
+    fillON = value;
+}
+
+template<int NCHN>
+void mdpp_SCP<NCHN>::dropTree(){
+    //the tree was made in the constructor, nextFile makes no new one
+    fillON = 0;
+    treeON = 0;
+    delete roottree;
+    roottree = 0;
+
+    //the spectra again, as TH1I
+    if (histsON){
+        for (int i=0; i<num_chn; i++){
+            delete hADC[i];
+            delete hTDC[i];
+            delete hEn[i];
+        }
+        makeHistos();
+    }
+}
+
+template<int NCHN>
+void mdpp_SCP<NCHN>::setMemoryBudget(size_t bytes){
+    //the --2d accumulators first
+    size_t matrixbytes = spectraBytes();
+    if (matrixbytes>bytes/2)
+        cout << "Memory budget: " << label() << " --2d spectra need " << matrixbytes/(1024*1024)
+             << " MB of the " << bytes/(1024*1024) << " MB" << endl;
+    bytes = (bytes>matrixbytes) ? bytes-matrixbytes : 0;
+
+    //half for the spectra (all without a tree): halve the 64k bins until
+    //the histograms fit
+    size_t spectrabytes = treeON ? bytes/2 : bytes;
+    int nbins = 16*4096;
+    while ((nbins>4096)&&(3*num_chn*(nbins+2)*sizeof(float)>spectrabytes)){
+        nbins /= 2;
+        histshift++;
+    }
+    if (histshift>0){
+        for (int i=0; i<num_chn; i++){
+            hADC[i]->SetBins(nbins, 0, 16*4096);
+            hTDC[i]->SetBins(nbins, 0, 16*4096);
+            hEn[i]->SetBins(nbins, min[i], max[i]);
+        }
+        cout << "Memory budget: " << label() << " spectra reduced to " << nbins << " bins" << endl;
+    }
+
+    //half for the tree
+    if (treeON){
+        treebytes = bytes/2;
+        configureTree();
+    }
+}
+
+template<int NCHN>
+void mdpp_SCP<NCHN>::configureTree(){
+    //small baskets, flushed to the file before treebytes are buffered
+    int nbranches = roottree->GetListOfBranches()->GetEntriesFast();
+    Long64_t basket = treebytes/(4*nbranches);
+    if (basket>32000) basket = 32000;
+    if (basket<4096) basket = 4096;
+    roottree->SetBasketSize("*", basket);
+    roottree->SetAutoFlush(-treebytes/2);
+}
+
+template<int NCHN>
+void mdpp_SCP<NCHN>::setSpectra(int which){
+    spectra = which;
+    if (which & Spectrum_ADC_TDC){
+        for (int i=0; i<num_chn; i++)
+            mADC_TDC[i] = new matrix2d(512, 7, 512, 7);
+    }
+    if (which & Spectrum_ADC_chn)
+        mADC_chn = new matrix2d(num_chn, 0, 4096, 4);
+}
+
+template<int NCHN>
+size_t mdpp_SCP<NCHN>::spectraBytes() const{
+    size_t n = 0;
+    for (int i=0; i<num_chn; i++){
+        if (mADC_TDC[i])
+            n += mADC_TDC[i]->maxBytes();
+    }
+    if (mADC_chn)
+        n += mADC_chn->maxBytes();
+    return n;
+}
+
+template class mdpp_SCP<16>;
+template class mdpp_SCP<32>;
@@ -0,0 +1,633 @@
+
+#include "mvlcreader.hh"
+#include "listreader.hh"
+
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+using std::cout;
+using std::cerr;
+using std::endl;
+
+using namespace mvlc;
+
+namespace
+{
+
+//just enough JSON for the module lists of the MVMEConfig system event
+struct jsonscan
+{
+    const char *p;
+    const char *end;
+
+    void ws()
+    {
+        while ((p<end)&&std::isspace((unsigned char)*p))
+            p++;
+    }
+    bool is(char c)
+    {
+        ws();
+        if ((p<end)&&(*p==c)){
+            p++;
+            return 1;
+        }
+        return 0;
+    }
+    bool text(std::string &s)
+    {
+        //escapes are kept as the escaped character, enough for type names
+        s.clear();
+        if (!is('"'))
+            return 0;
+        while (p<end){
+            char c = *p++;
+            if (c=='"')
+                return 1;
+            if ((c=='\\')&&(p<end))
+                c = *p++;
+            s += c;
+        }
+        return 0;
+    }
+    //{"key": value, ...}, member(key) reads the value
+    template<class F> bool object(F member)
+    {
+        if (!is('{'))
+            return 0;
+        if (is('}'))
+            return 1;
+        do{
+            std::string key;
+            if (!(text(key) && is(':') && member(key)))
+                return 0;
+        }while (is(','));
+        return is('}');
+    }
+    //[value, ...], element(i) reads value i
+    template<class F> bool array(F element)
+    {
+        if (!is('['))
+            return 0;
+        if (is(']'))
+            return 1;
+        size_t i = 0;
+        do{
+            if (!element(i++))
+                return 0;
+        }while (is(','));
+        return is(']');
+    }
+    //skips any value
+    bool value()
+    {
+        ws();
+        if (p==end)
+            return 0;
+        if (*p=='{')
+            return object([this](const std::string &) { return value(); });
+        if (*p=='[')
+            return array([this](size_t) { return value(); });
+        if (*p=='"'){
+            std::string s;
+            return text(s);
+        }
+        //number, true, false or null; the padding of the event is 0
+        const char *start = p;
+        while ((p<end)&&(std::strchr(",}] \t\r\n", *p)==0))
+            p++;
+        return p>start;
+    }
+    bool boolean(bool &b)
+    {
+        ws();
+        const char *start = p;
+        if (!value())
+            return 0;
+        b = (p-start==4)&&(std::strncmp(start, "true", 4)==0);
+        return 1;
+    }
+};
+
+}
+
+mvlcreader::mvlcreader(listreader &infile_, const std::vector<u32> *modules_, bool verbose_)
+    : infile(infile_)
+{
+    for (int i=0; i<16; i++){
+        modules[i] = modules_[i];
+        given[i] = !modules_[i].empty();
+    }
+    verbose = verbose_;
+    fileformat = 0;
+
+    skipWords = 0;
+    inEvent = 0;
+    eventIndex = 0;
+    stackLeft = 0;
+    stackContinue = 0;
+    blockLeft = 0;
+    blockContinue = 0;
+    module = -1;
+    currentType = 0;
+    pendingTicks = 0;
+
+    inConfig = 0;
+    sysContinue = 0;
+    configFound = 0;
+
+    endoffile = 0;
+    eofoffset = 0;
+    nevents = 0;
+    nlostpackets = 0;
+    ndropped = 0;
+    nunknown = 0;
+    extrawarned = 0;
+}
+
+mvlcreader::~mvlcreader()
+{
+
+}
+
+int mvlcreader::format(const char *magic)
+{
+    if (std::strncmp(magic, "MVLC_USB", MagicSize)==0)
+        return USB;
+    if (std::strncmp(magic, "MVLC_ETH", MagicSize)==0)
+        return ETH;
+    return 0;
+}
+
+u32 mvlcreader::moduleType(const char *name)
+{
+    //compare without case and dashes, mdpp16_scp matches MDPP-16_SCP
+    auto simplify = [](const char *s){
+        std::string r;
+        for (; *s; s++){
+            if (*s!='-')
+                r += std::tolower(*s);
+        }
+        return r;
+    };
+    std::string wanted = simplify(name);
+    for (auto it = listfile::VMEModuleTypeNames.begin(); it != listfile::VMEModuleTypeNames.end(); ++it){
+        if (simplify(it->second) == wanted)
+            return it->first;
+    }
+    //mvme names the MDPP-32 firmwares mdpp32_scp, mdpp32_qdc, ...
+    if (wanted.compare(0, 6, "mdpp32")==0)
+        return listfile::VMEModuleType::MDPP32;
+    return 0;
+}
+
+void mvlcreader::read(eventsink &sink)
+{
+    char magic[MagicSize];
+    infile.read(magic, MagicSize);
+    fileformat = format(magic);
+
+    if (fileformat==ETH)
+        readETH(sink);
+    else
+        readUSB(sink);
+
+    if (inEvent){
+        cout << "\nWarning: last event is incomplete" << endl;
+        finishEvent(sink, 0);
+    }
+    if (endoffile){
+        printf("\nFound MVLC EndOfFile system event\n");
+        infile.drain();
+        if (eofoffset != infile.size())
+            cout << "Warning: " << (infile.size() - eofoffset)
+                 << " bytes left after EndOfFile system event" << endl;
+    }
+    else{
+        cout << "\nWarning: no EndOfFile system event, the listfile is incomplete" << endl;
+    }
+    if (!configFound){
+        bool any = 0;
+        for (int i=0; i<16; i++)
+            any |= given[i];
+        if (!any)
+            cout << "Warning: no module list in an MVMEConfig system event, the module data was skipped;"
+                 << " give the modules with --mvlc-modules" << endl;
+    }
+    if (nlostpackets>0)
+        cout << "Warning: " << nlostpackets << " ETH packets lost" << endl;
+    if (ndropped>0)
+        cout << "Warning: " << ndropped << " events with lost data were skipped" << endl;
+    if (nunknown>0)
+        cout << "Warning: " << nunknown << " words outside of frames were skipped" << endl;
+}
+
+void mvlcreader::readUSB(eventsink &sink)
+{
+    //the buffers are a plain stream of frames, parsed as the read blocks
+    //come in
+    while (1){
+        size_t nbytes;
+        const u32 *data = (const u32 *)infile.viewBlock(1024*1024, nbytes);
+        if (nbytes<sizeof(u32))
+            break;
+        uint64_t chunkoffset = infile.tell()-nbytes;
+        size_t used = parse(data, nbytes/sizeof(u32), sink);
+        if (endoffile && (skipWords==0)){
+            eofoffset = chunkoffset + used*sizeof(u32);
+            break;
+        }
+    }
+}
+
+void mvlcreader::readETH(eventsink &sink)
+{
+    u32 lastPacket = 0;
+    bool first = 1;
+    bool lost = 0;      //skip to the next frame header after lost packets
+
+    while ((!endoffile)&&(infile.more(sizeof(u32)))){
+        u32 header0;
+        infile.read((char *)&header0, sizeof(u32));
+
+        //system events are written between the packets
+        if ((header0 >> FrameTypeShift)==SystemEvent){
+            systemEvent(header0, sink);
+            u32 length = header0 & FrameLengthMask;
+            if (inConfig){
+                std::vector<u32> words(length);
+                infile.read((char *)words.data(), length * sizeof(u32));
+                systemData(words.data(), length);
+            }
+            else{
+                infile.skip(length * sizeof(u32));
+            }
+            systemEnd();
+            eofoffset = infile.tell();
+            continue;
+        }
+
+        u32 header1;
+        infile.read((char *)&header1, sizeof(u32));
+        u32 channel = (header0 & PacketChannelMask) >> PacketChannelShift;
+        u32 packet = (header0 & PacketNumberMask) >> PacketNumberShift;
+        u32 nwords = header0 & PacketWordsMask;
+        u32 nextHeader = header1 & NextHeaderMask;
+
+        if (verbose)
+            printf("ETH packet: header0=0x%08x, header1=0x%08x, channel=%u, packet=%u, words=%u\n",
+                   header0, header1, channel, packet, nwords);
+
+        if (channel!=DataChannel){
+            infile.skip(nwords * sizeof(u32));
+            continue;
+        }
+
+        //a frame cut by lost packets cannot be finished, parsing goes on
+        //at the first frame header of the next packet that has one
+        if ((!first)&&(packet != ((lastPacket+1) & (PacketNumberMask >> PacketNumberShift)))){
+            nlostpackets += (packet - lastPacket - 1) & (PacketNumberMask >> PacketNumberShift);
+            if (inEvent)
+                finishEvent(sink, 0);
+            skipWords = 0;
+            stackLeft = 0;
+            stackContinue = 0;
+            blockLeft = 0;
+            lost = 1;
+        }
+        first = 0;
+        lastPacket = packet;
+
+        u32 start = 0;
+        if (lost){
+            if ((nextHeader==NoHeaderPointer)||(nextHeader>=nwords)){
+                infile.skip(nwords * sizeof(u32));
+                continue;
+            }
+            start = nextHeader;
+            lost = 0;
+            infile.skip(start * sizeof(u32));
+        }
+
+        //the packet data in place, in two pieces if it crosses a read block
+        size_t left = (size_t)(nwords-start) * sizeof(u32);
+        while (left>0){
+            size_t nbytes;
+            const u32 *data = (const u32 *)infile.viewBlock(left, nbytes);
+            if (nbytes==0)
+                throw std::runtime_error("Unexpected end of file in ETH packet");
+            parse(data, nbytes/sizeof(u32), sink);
+            left -= nbytes;
+        }
+    }
+}
+
+size_t mvlcreader::parse(const u32 *data, size_t nwords, eventsink &sink)
+{
+    //returns the number of words used, less than nwords only after the
+    //EndOfFile system event
+    const u32 *p = data;
+    const u32 *end = data+nwords;
+
+    while (p<end){
+        if (skipWords>0){
+            u32 n = (skipWords < (u32)(end-p)) ? skipWords : (u32)(end-p);
+            if (inConfig)
+                systemData(p, n);
+            p += n;
+            skipWords -= n;
+            if (skipWords==0)
+                systemEnd();
+            if ((skipWords==0)&&endoffile)
+                break;
+            continue;
+        }
+
+        //module data in place
+        if (blockLeft>0){
+            u32 n = (blockLeft < (u32)(end-p)) ? blockLeft : (u32)(end-p);
+            pieces.push_back({currentType, p, 0, n});
+            p += n;
+            blockLeft -= n;
+            stackLeft -= n;
+            if ((stackLeft==0)&&(!stackContinue))
+                finishEvent(sink, 1);
+            continue;
+        }
+
+        u32 word = *p++;
+        u32 type = (word & FrameTypeMask) >> FrameTypeShift;
+        u32 flags = (word & FrameFlagsMask) >> FrameFlagsShift;
+        u32 length = word & FrameLengthMask;
+
+        //inside a stack frame: block reads and the words of single reads
+        if (stackLeft>0){
+            stackLeft--;
+            if (type==BlockRead){
+                if (length>stackLeft){
+                    //corrupt frame, drop the event
+                    nunknown += stackLeft;
+                    skipWords = stackLeft;
+                    stackLeft = 0;
+                    stackContinue = 0;
+                    finishEvent(sink, 0);
+                    continue;
+                }
+                if (!blockContinue){
+                    module++;
+                    const std::vector<u32> &types = modules[eventIndex];
+                    if ((size_t)module < types.size()){
+                        currentType = types[module];
+                    }
+                    else{
+                        currentType = 0;
+                        if (!extrawarned){
+                            cout << "\nWarning: event " << eventIndex << " has more block reads than its "
+                                 << types.size() << " modules in the MVMEConfig or --mvlc-modules" << endl;
+                            extrawarned = 1;
+                        }
+                    }
+                }
+                blockLeft = length;
+                blockContinue = flags & Continue;
+                if (verbose){
+                    printf("  Block read: header=0x%08x, module %d, moduleType=%u (%s), length=%u%s\n",
+                           word, module, currentType,
+                           listfile::get_vme_module_name((listfile::VMEModuleType)currentType),
+                           length, blockContinue ? ", continued" : "");
+                }
+            }
+            else if (verbose){
+                printf("  Single read: 0x%08x\n", word);
+            }
+            if ((stackLeft==0)&&(blockLeft==0)&&(!stackContinue))
+                finishEvent(sink, 1);
+            continue;
+        }
+
+        switch (type){
+            case StackFrame:
+                {
+                    u32 stack = (word & StackNumMask) >> StackNumShift;
+                    if (inEvent)
+                        finishEvent(sink, 0);
+                    //stack 0 is for commands, not readout
+                    if (stack==0){
+                        skipWords = length;
+                        break;
+                    }
+                    eventIndex = stack-1;
+                    inEvent = 1;
+                    module = -1;
+                    blockContinue = 0;
+                    stackLeft = length;
+                    stackContinue = flags & Continue;
+                    if (verbose){
+                        printf("Stack frame: header=0x%08x, eventType=%u, length=%u%s\n",
+                               word, eventIndex, length, stackContinue ? ", continued" : "");
+                    }
+                    if ((stackLeft==0)&&(!stackContinue))
+                        finishEvent(sink, 1);
+                } break;
+
+            case StackContinuation:
+                {
+                    if (!(inEvent && stackContinue)){
+                        skipWords = length;
+                        nunknown += length+1;
+                        break;
+                    }
+                    stackLeft = length;
+                    stackContinue = flags & Continue;
+                    if (verbose){
+                        printf("Stack continuation: header=0x%08x, length=%u%s\n",
+                               word, length, stackContinue ? ", continued" : "");
+                    }
+                    if ((stackLeft==0)&&(!stackContinue))
+                        finishEvent(sink, 1);
+                } break;
+
+            case SystemEvent:
+                {
+                    systemEvent(word, sink);
+                    skipWords = length;
+                    if (length==0)
+                        systemEnd();
+                    if (endoffile && (length==0)){
+                        keepPieces();
+                        return p-data;
+                    }
+                } break;
+
+            case SuperFrame:
+            case StackError:
+                {
+                    skipWords = length;
+                } break;
+
+            default:
+                {
+                    //not a frame header, look at the next word
+                    nunknown++;
+                } break;
+        }
+    }
+    keepPieces();
+    return p-data;
+}
+
+void mvlcreader::systemEvent(u32 header, eventsink &sink)
+{
+    u32 subtype = (header & SystemSubtypeMask) >> SystemSubtypeShift;
+
+    //the MVMEConfig is collected over its frames until one without Continue
+    if (subtype==MVMEConfig){
+        if (!(inConfig || sysContinue))
+            config.clear();
+        inConfig = 1;
+    }
+    else{
+        inConfig = 0;
+    }
+    sysContinue = (header & FrameFlagsMask) >> FrameFlagsShift & Continue;
+
+    switch (subtype){
+        case UnixTimetick:
+            //in the order of the original readout, after the open event
+            if (inEvent)
+                pendingTicks++;
+            else
+                sink.timetick();
+            if (verbose)
+                printf("Timetick\n");
+            break;
+
+        case EndOfFile:
+            endoffile = 1;
+            break;
+
+        default:
+            if (verbose)
+                printf("System event: header=0x%08x, subtype=0x%02x, length=%u\n",
+                       header, subtype, header & FrameLengthMask);
+            break;
+    }
+}
+
+void mvlcreader::systemData(const u32 *data, u32 nwords)
+{
+    config.append((const char *)data, nwords * sizeof(u32));
+}
+
+void mvlcreader::systemEnd()
+{
+    if (inConfig && !sysContinue)
+        applyConfig();
+    inConfig = 0;
+}
+
+void mvlcreader::applyConfig()
+{
+    //{"VMEConfig": {"events": [{"modules": [{"type": "mdpp16_scp",
+    //"enabled": true, ...}, ...], ...}, ...], ...}}, event i is read out by
+    //stack i+1, disabled modules are not read out
+    std::vector<std::vector<u32> > types;
+    std::vector<std::vector<std::string> > names;
+    jsonscan js = { config.data(), config.data()+config.size() };
+    bool ok = js.object([&](const std::string &section) -> bool {
+        if ((section!="VMEConfig")&&(section!="DAQConfig"))
+            return js.value();
+        return js.object([&](const std::string &key) -> bool {
+            if (key!="events")
+                return js.value();
+            return js.array([&](size_t) -> bool {
+                types.push_back(std::vector<u32>());
+                names.push_back(std::vector<std::string>());
+                return js.object([&](const std::string &eventkey) -> bool {
+                    if (eventkey!="modules")
+                        return js.value();
+                    return js.array([&](size_t) -> bool {
+                        std::string type;
+                        bool enabled = 1;
+                        bool modok = js.object([&](const std::string &modkey) -> bool {
+                            if (modkey=="type")
+                                return js.text(type);
+                            if (modkey=="enabled")
+                                return js.boolean(enabled);
+                            return js.value();
+                        });
+                        if (enabled){
+                            types.back().push_back(moduleType(type.c_str()));
+                            names.back().push_back(type);
+                        }
+                        return modok;
+                    });
+                });
+            });
+        });
+    });
+    if (!ok){
+        cout << "Warning: the MVMEConfig system event is no mvme VME config, its modules are not used" << endl;
+        return;
+    }
+
+    //unknown modules keep their place in the readout, their data is skipped
+    for (size_t i=0; (i<types.size())&&(i<16); i++){
+        if (types[i].empty())
+            continue;
+        configFound = 1;
+        if (given[i])
+            continue;
+        modules[i] = types[i];
+        cout << "Event " << i << " modules from the MVMEConfig:";
+        for (size_t j=0; j<types[i].size(); j++){
+            cout << (j ? ", " : " ");
+            if (types[i][j])
+                cout << listfile::get_vme_module_name((listfile::VMEModuleType)types[i][j]);
+            else
+                cout << names[i][j] << " (skipped)";
+        }
+        cout << endl;
+    }
+}
+
+void mvlcreader::keepPieces()
+{
+    //the read block (or packet) of data is left after parse
+    if (!inEvent)
+        return;
+    for (size_t i=0; i<pieces.size(); i++){
+        piece &pc = pieces[i];
+        if (!pc.data)
+            continue;
+        pc.offset = buffer.size();
+        buffer.insert(buffer.end(), pc.data, pc.data+pc.nwords);
+        pc.data = 0;
+    }
+}
+
+void mvlcreader::finishEvent(eventsink &sink, bool complete)
+{
+    //events with lost data are passed on without their module data
+    sink.beginEvent();
+    if (complete){
+        for (size_t i=0; i<pieces.size(); i++){
+            const piece &pc = pieces[i];
+            sink.subEvent(pc.type, pc.data ? pc.data : buffer.data()+pc.offset, pc.nwords);
+        }
+    }
+    for (; pendingTicks>0; pendingTicks--)
+        sink.timetick();
+    sink.endEvent(eventIndex, complete);
+    pieces.clear();
+    buffer.clear();
+    inEvent = 0;
+    blockLeft = 0;
+    blockContinue = 0;
+    nevents++;
+    if (!complete)
+        ndropped++;
+}
@@ -0,0 +1,325 @@
+
+#include "mxdc32.hh"
+#include "livehistos.hh"
+#include "eventselector.hh"
+
+#include "TTree.h"
+#include "TString.h"
+
+#include <cstdio>
+#include <iostream>
+using std::cout;
+using std::cerr;
+using std::endl;
+
+template<int TYPE>
+mxdc32<TYPE>::mxdc32(bool verbose_, bool histos)
+{
+    //initialize variables
+    fillON = 1;
+    treeON = 1;
+    histsON = histos;
+    started = 0;
+    live = 0;
+    verbose = verbose_;
+    module_id = 0;
+    time_stamp = 0;
+    extendedtime = 0;
+    treebytes = 0;
+    histshift = 0;
+    for (int i=0; i<num_chn; i++){
+        value[i] = 0;
+        overflow[i] = 0;
+        hValue[i] = 0;
+    }
+    hitmask = 0;
+    initEvent();
+
+    //the spectra (8 MB for the MTDC-32) are only made once the module is
+    //seen, most runs have none of these modules
+    makeTree();
+}
+
+template<int TYPE>
+mxdc32<TYPE>::~mxdc32()
+{
+
+}
+
+template<int TYPE>
+void mxdc32<TYPE>::makeTree()
+{
+    //tree in the current directory
+    roottree = new TTree(label(), Form("%s data", label()));
+
+    roottree->Branch(Form("%s[%i]", valueName(), num_chn), value, Form("%s[%i]/I", valueName(), num_chn));
+    if (TYPE==listfile::MTDC32)
+        roottree->Branch(Form("Trigger[%i]", num_trigger), Trigger, Form("Trigger[%i]/I", num_trigger));
+    else
+        roottree->Branch(Form("overflow[%i]", num_chn), overflow, Form("overflow[%i]/O", num_chn));
+    roottree->Branch("module_id", &module_id);
+    roottree->Branch("time_stamp", &time_stamp);
+    roottree->Branch("extendedtime", &extendedtime);
+    if (treebytes>0)
+        configureTree();
+}
+
+template<int TYPE>
+void mxdc32<TYPE>::makeHistos()
+{
+    //names get the module as prefix so they do not replace the MDPP ones
+    //in memory
+    int nbins = (1 << value_bits) >> histshift;
+    for (int i=0; i<num_chn; i++){
+        hValue[i] = makeSpectrum(!treeON, Form("%s_h%s%i", label(), valueName(), i),
+                                 Form("h%s%i", valueName(), i), nbins, 0, 1 << value_bits);
+    }
+}
+
+template<int TYPE>
+void mxdc32<TYPE>::nextFile()
+{
+    //closing the previous file deleted its tree and histograms
+    if (treeON)
+        makeTree();
+    if (histsON && started)
+        makeHistos();
+}
+
+template<int TYPE>
+u32 mxdc32<TYPE>::decode(const u32 *data, u32 nwords)
+{
+    u32 ndata = 0;
+    for (u32 i=0; i<nwords; i++){
+        u32 word = data[i];
+        if (verbose)
+            printf("    %2u = 0x%08x\n", i, word);
+
+        if ((word==0)||(word==0xffffffff)){
+            if (verbose)
+                cout << "\tFill" << endl;
+            continue;
+        }
+        ndata++;
+
+        u32 sig = word >> 30;
+        if (sig==1){ //header
+            module_id = (word >> 16) & 0xff;
+            if (verbose)
+                cout << "\tHeader\tmodule " << module_id << "\twords " << (word & 0xfff) << endl;
+        }
+        else if (sig==3){ //end of event
+            time_stamp = word & 0x3fffffff;
+            if (verbose)
+                cout << "\tEnd of event\t" << time_stamp << endl;
+        }
+        else if ((word >> 16)==0x0480){ //extended time stamp
+            extendedtime = word & 0xffff;
+            if (verbose)
+                cout << "\tExtended time stamp:\t" << extendedtime << endl;
+        }
+        else if ((TYPE==listfile::MTDC32) ? ((word >> 22)==0x010) : ((word >> 21)==0x020)){ //data
+            int chn = (word >> 16) & 0x1f;
+            int v = word & ((1u << value_bits)-1);
+            if ((TYPE==listfile::MTDC32)&&((word >> 21) & 1)){
+                Trigger[chn%num_trigger] = v;
+            }
+            else{
+                value[chn] = v;
+                if (TYPE!=listfile::MTDC32)
+                    overflow[chn] = (word >> overflow_bit) & 1;
+                hitmask |= 1u << chn;
+                hValue[chn]->AddBinContent((v>>histshift)+1);
+            }
+            if (verbose)
+                cout << "\tData\t" << chn << "\t" << v << endl;
+        }
+    }
+    return ndata;
+}
+
+template<int TYPE>
+void mxdc32<TYPE>::initEvent()
+{
+    //call at start of event, only the channels the last event set
+    for (uint32_t mask=hitmask; mask; mask&=mask-1){
+        int i = __builtin_ctz(mask);
+        value[i] = 0;
+        overflow[i] = 0;
+    }
+    for (int i=0; i<num_trigger; i++){
+        Trigger[i] = 0;
+    }
+    hitmask = 0;
+    mult = 0;
+}
+
+template<int TYPE>
+void mxdc32<TYPE>::endEvent()
+{
+    //call at end of event
+    mult = __builtin_popcount(hitmask);
+}
+
+template<int TYPE>
+void mxdc32<TYPE>::writeEvent()
+{
+    //call after endEvent for events that are kept
+    if (fillON)
+        roottree->Fill();
+}
+
+template<int TYPE>
+void mxdc32<TYPE>::fillEmpty(Long64_t n)
+{
+    //entries for the events before the module was first seen
+    if (histsON && !started){
+        makeHistos();
+        if (histshift>0)
+            cout << "\nMemory budget: " << label() << " spectra reduced to "
+                 << ((1 << value_bits) >> histshift) << " bins" << endl;
+        if (live)
+            attachLive(live);
+    }
+    started = 1;
+    initEvent();
+    if (fillON){
+        for (Long64_t i=0; i<n; i++)
+            roottree->Fill();
+    }
+}
+
+template<int TYPE>
+void mxdc32<TYPE>::fillRecord(shmrecord *rec)
+{
+    //copy the current event for a --split-events writer; the record does
+    //not go to the shared memory, module_id is kept in reserved
+    rec->module = TYPE;
+    rec->num_chn = num_chn;
+    rec->time_stamp = time_stamp;
+    rec->extendedtime = extendedtime;
+    rec->hitmask = hitmask;
+    rec->overflowmask = 0;
+    rec->reserved = module_id;
+    for (int i=0; i<num_chn; i++){
+        rec->ADC[i] = value[i];
+        rec->overflowmask |= (uint32_t)overflow[i] << i;
+    }
+    for (int i=0; i<num_trigger; i++){
+        rec->Trigger[i] = Trigger[i];
+    }
+}
+
+template<int TYPE>
+void mxdc32<TYPE>::loadRecord(const shmrecord *rec)
+{
+    //restore an event copied with fillRecord
+    initEvent();
+    time_stamp = rec->time_stamp;
+    extendedtime = rec->extendedtime;
+    module_id = rec->reserved;
+    hitmask = rec->hitmask;
+    mult = __builtin_popcount(hitmask);
+    for (uint32_t mask=hitmask; mask; mask&=mask-1){
+        int i = __builtin_ctz(mask);
+        value[i] = rec->ADC[i];
+        overflow[i] = (rec->overflowmask >> i) & 1;
+    }
+    for (int i=0; i<num_trigger; i++){
+        Trigger[i] = rec->Trigger[i];
+    }
+}
+
+template<int TYPE>
+void mxdc32<TYPE>::writeTree()
+{
+    //call at end of file
+    roottree->Write();
+}
+
+template<int TYPE>
+void mxdc32<TYPE>::writeHistos()
+{
+    for (int i=0; i<num_chn; i++){
+        hValue[i]->Write(Form("h%s%i", valueName(), i));
+    }
+}
+
+template<int TYPE>
+void mxdc32<TYPE>::attachLive(livehistos *live_)
+{
+    live = live_;
+    if (!hValue[0])
+        return;
+    for (int i=0; i<num_chn; i++){
+        live->attach(label(), hValue[i]);
+    }
+}
+
+template<int TYPE>
+void mxdc32<TYPE>::registerVariables(eventselector &sel, const char *prefix)
+{
+    sel.addVariable(Form("%s.%s", prefix, valueName()), value, num_chn);
+    if (TYPE==listfile::MTDC32)
+        sel.addVariable(Form("%s.Trigger", prefix), Trigger, num_trigger);
+    else
+        sel.addVariable(Form("%s.overflow", prefix), overflow, num_chn);
+    sel.addVariable(Form("%s.time_stamp", prefix), &time_stamp);
+    sel.addVariable(Form("%s.extendedtime", prefix), &extendedtime);
+    sel.addVariable(Form("%s.mask", prefix), &hitmask);
+    sel.addVariable(Form("%s.mult", prefix), &mult);
+}
+
+template<int TYPE>
+void mxdc32<TYPE>::setFillTree(bool fill){
+    fillON = fill;
+}
+
+template<int TYPE>
+void mxdc32<TYPE>::dropTree(){
+    //the tree was made in the constructor, nextFile makes no new one
+    fillON = 0;
+    treeON = 0;
+    delete roottree;
+    roottree = 0;
+
+    //the spectra again, as TH1I
+    if (histsON && started){
+        for (int i=0; i<num_chn; i++)
+            delete hValue[i];
+        makeHistos();
+    }
+}
+
+template<int TYPE>
+void mxdc32<TYPE>::setMemoryBudget(size_t bytes){
+    //half for the spectra (all without a tree): halve the bins until the
+    //histograms fit, they are made when the module is first seen
+    size_t spectrabytes = treeON ? bytes/2 : bytes;
+    int nbins = 1 << value_bits;
+    while ((nbins>1024)&&(num_chn*(nbins+2)*sizeof(float)>spectrabytes)){
+        nbins /= 2;
+        histshift++;
+    }
+
+    //half for the tree
+    if (treeON){
+        treebytes = bytes/2;
+        configureTree();
+    }
+}
+
+template<int TYPE>
+void mxdc32<TYPE>::configureTree(){
+    //small baskets, flushed to the file before treebytes are buffered
+    int nbranches = roottree->GetListOfBranches()->GetEntriesFast();
+    Long64_t basket = treebytes/(4*nbranches);
+    if (basket>32000) basket = 32000;
+    if (basket<4096) basket = 4096;
+    roottree->SetBasketSize("*", basket);
+    roottree->SetAutoFlush(-treebytes/2);
+}
+
+template class mxdc32<listfile::MADC32>;
+template class mxdc32<listfile::MQDC32>;
+template class mxdc32<listfile::MTDC32>;
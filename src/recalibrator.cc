@@ -0,0 +1,202 @@
+
+#include "recalibrator.hh"
+#include "mdpp_SCP.hh"
+
+#include "TTree.h"
+#include "TBranch.h"
+#include "TString.h"
+#include "TFile.h"
+#include "TH1.h"
+#include "TVectorD.h"
+#include "TROOT.h"
+
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <vector>
+using std::cout;
+using std::cerr;
+using std::endl;
+
+recalibrator::recalibrator(TString analysis_filename, int nthreads_)
+{
+    ROOT::EnableThreadSafety();
+
+    nthreads = nthreads_;
+    if (nthreads<=0)
+        nthreads = std::thread::hardware_concurrency();
+    if (nthreads<1)
+        nthreads = 1;
+
+    //same defaults as the conversion for channels without a calibration
+    for (int i=0; i<16; i++){
+        min16[i] = 0;
+        max16[i] = 16*4096;
+    }
+    for (int i=0; i<32; i++){
+        min32[i] = 0;
+        max32[i] = 16*4096;
+    }
+    ok = (mdpp16_SCP::readCalibration(analysis_filename, min16, max16)==0) &&
+         (mdpp32_SCP::readCalibration(analysis_filename, min32, max32)==0);
+}
+
+recalibrator::~recalibrator()
+{
+
+}
+
+//energies of rows events, 0 for channels without an ADC value like the
+//ADC branch itself. The channel loop has a fixed length and no branches,
+//so it is vectorized.
+template<int NCHN>
+static void calibrate(const int *adc, double *en, long rows, const double *m, const double *b)
+{
+    double mm[NCHN], bb[NCHN];
+    memcpy(mm, m, sizeof(mm));
+    memcpy(bb, b, sizeof(bb));
+    for (long i=0; i<rows; i++){
+        const int *a = adc + i*NCHN;
+        double *e = en + i*NCHN;
+        for (int c=0; c<NCHN; c++)
+            e[c] = (a[c]>0)*(mm[c]*a[c]+bb[c]);
+    }
+}
+
+int recalibrator::recalibrate(TString rootfilename)
+{
+    TFile *in = TFile::Open(rootfilename);
+    if ((!in)||(in->IsZombie())){
+        cerr << "Error opening " << rootfilename.Data() << " for reading" << endl;
+        delete in;
+        return 1;
+    }
+
+    TString calfilename = rootfilename;
+    if (calfilename.EndsWith(".root"))
+        calfilename.Remove(calfilename.Length()-5);
+    calfilename.Append("_cal.root");
+    TFile *out = new TFile(calfilename, "RECREATE");
+    if (out->IsZombie()){
+        cerr << "Error opening " << calfilename.Data() << " for writing" << endl;
+        delete out;
+        delete in;
+        return 1;
+    }
+    cout << rootfilename.Data() << " -> " << calfilename.Data() << endl;
+
+    int ret16 = recalibrateTree<16>(in, out, min16, max16);
+    int ret32 = recalibrateTree<32>(in, out, min32, max32);
+    int ret = (ret16>0)||(ret32>0);
+    if ((ret16<0)&&(ret32<0)){
+        cerr << rootfilename.Data() << " has no MDPP16_SCP or MDPP32_SCP tree" << endl;
+        ret = 1;
+    }
+
+    out->Close();
+    in->Close();
+    delete out;
+    delete in;
+    return ret;
+}
+
+template<int NCHN>
+int recalibrator::recalibrateTree(TFile *in, TFile *out, const double *min, const double *max)
+{
+    const char *label = mdpp_SCP<NCHN>::label();
+    TTree *tree = (TTree *)in->Get(Form("MDPP%i_SCP", NCHN));
+    if (!tree)
+        return -1;
+    TBranch *branch = tree->GetBranch("ADC");
+    if (!branch)
+        branch = tree->GetBranch(Form("ADC[%i]", NCHN));
+    if (!branch){
+        cerr << tree->GetName() << " has no ADC branch" << endl;
+        return 1;
+    }
+
+    //linear calibration like mdpp_SCP::readAnalysis
+    TVectorD m(NCHN);
+    TVectorD b(NCHN);
+    double mm[NCHN], bb[NCHN];
+    for (int i=0; i<NCHN; i++){
+        bb[i] = b[i] = min[i];
+        mm[i] = m[i] = (max[i]-min[i])/65536.;
+    }
+
+    //only the ADC baskets are read
+    int adc[NCHN];
+    branch->SetAddress(adc);
+    tree->SetCacheSize(32*1024*1024);
+    tree->AddBranchToCache(branch, true);
+
+    out->cd();
+    double en[NCHN];
+    TTree *cal = new TTree(Form("MDPP%i_SCP_cal", NCHN), Form("MDPP%i energies", NCHN));
+    cal->Branch(Form("En[%i]", NCHN), en, Form("En[%i]/D", NCHN));
+
+    //chunk k is read and calibrated while the writer fills chunk k-1
+    std::vector<int> adcbuf[2];
+    std::vector<double> enbuf[2];
+    for (int k=0; k<2; k++){
+        adcbuf[k].resize((size_t)Chunk*NCHN);
+        enbuf[k].resize((size_t)Chunk*NCHN);
+    }
+    std::thread writer;
+    Long64_t entries = tree->GetEntries();
+    int k = 0;
+    for (Long64_t first=0; first<entries; first+=Chunk, k^=1){
+        long rows = (entries-first<Chunk) ? entries-first : Chunk;
+        int *a = adcbuf[k].data();
+        double *e = enbuf[k].data();
+        for (long i=0; i<rows; i++){
+            branch->GetEntry(first+i);
+            memcpy(&a[i*NCHN], adc, sizeof(adc));
+        }
+
+        std::vector<std::thread> workers;
+        long slice = (rows+nthreads-1)/nthreads;
+        for (long r=0; r<rows; r+=slice){
+            long n = (rows-r<slice) ? rows-r : slice;
+            workers.push_back(std::thread(calibrate<NCHN>, a+r*NCHN, e+r*NCHN, n, mm, bb));
+        }
+        for (size_t t=0; t<workers.size(); t++)
+            workers[t].join();
+
+        if (writer.joinable())
+            writer.join();
+        writer = std::thread([cal, e, rows, &en](){
+            for (long i=0; i<rows; i++){
+                memcpy(en, &e[i*NCHN], sizeof(en));
+                cal->Fill();
+            }
+        });
+    }
+    if (writer.joinable())
+        writer.join();
+    tree->SetCacheSize(0);
+
+    out->cd();
+    cal->Write();
+    m.Write(Form("m[%i]", NCHN));
+    b.Write(Form("b[%i]", NCHN));
+
+    //hEn has the bins of hADC on the axis of the calibration
+    TString histdir = Form("histos_%s", label);
+    out->mkdir(histdir);
+    out->cd(histdir);
+    for (int i=0; i<NCHN; i++){
+        TH1 *hADC = (TH1 *)in->Get(Form("%s/hADC%i", histdir.Data(), i));
+        if (!hADC)
+            continue;
+        TH1 *hEn = (TH1 *)hADC->Clone(Form("hEn%i", i));
+        hEn->SetDirectory(0);
+        hEn->SetTitle(Form("hEn%i", i));
+        hEn->GetXaxis()->Set(hEn->GetNbinsX(), min[i], max[i]);
+        hEn->Write(Form("hEn%i", i));
+        delete hEn;
+    }
+
+    cout << tree->GetName() << ": " << entries << " events recalibrated" << endl;
+    return 0;
+}
@@ -0,0 +1,201 @@
+
+#include "runcatalog.hh"
+#include "eventselector.hh"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+using std::cout;
+using std::cerr;
+using std::endl;
+
+static const char *CatalogHeader =
+    "file,listfile,part,start_time,start,stop,seconds,events,kept,lost,modules,calibrated,converted\n";
+static const size_t CatalogFields = 13;
+
+//modules that can be present, also the query variables
+static const char *CatalogModules[] = {"SCP", "QDC", "SCP32", "QDC32", "MADC32", "MQDC32", "MTDC32"};
+static const int NumCatalogModules = sizeof(CatalogModules)/sizeof(CatalogModules[0]);
+
+runcatalog::runcatalog(TString filename_)
+{
+    filename = filename_;
+}
+
+runcatalog::~runcatalog()
+{
+
+}
+
+std::string runcatalog::quote(const TString &field)
+{
+    //CSV quoting, only where needed
+    std::string s = field.Data();
+    if (s.find_first_of(",\"\n")==std::string::npos)
+        return s;
+    std::string q = "\"";
+    for (size_t i=0; i<s.size(); i++){
+        if (s[i]=='"')
+            q += '"';
+        q += s[i];
+    }
+    return q + "\"";
+}
+
+bool runcatalog::split(const std::string &line, std::vector<std::string> &fields)
+{
+    //fields of a CSV line, 0 if a quote is not closed
+    fields.clear();
+    std::string field;
+    bool quoted = 0;
+    for (size_t i=0; i<line.size(); i++){
+        char c = line[i];
+        if (quoted){
+            if ((c=='"')&&(i+1<line.size())&&(line[i+1]=='"')){
+                field += '"';
+                i++;
+            }
+            else if (c=='"'){
+                quoted = 0;
+            }
+            else{
+                field += c;
+            }
+        }
+        else if (c=='"'){
+            quoted = 1;
+        }
+        else if (c==','){
+            fields.push_back(field);
+            field.clear();
+        }
+        else{
+            field += c;
+        }
+    }
+    fields.push_back(field);
+    return !quoted;
+}
+
+int runcatalog::append(const entry &e)
+{
+    char start_time[32] = "";
+    if (e.start){
+        time_t t = e.start;
+        struct tm tm;
+        localtime_r(&t, &tm);
+        strftime(start_time, sizeof(start_time), "%Y-%m-%d %H:%M:%S", &tm);
+    }
+    char numbers[256];
+    snprintf(numbers, sizeof(numbers), "%d,%s,%u,%u,%d,%.0f,%.0f,%.0f,",
+             e.part, start_time, e.start, e.stop, e.seconds, e.events, e.kept, e.lost);
+    std::string line = quote(e.file) + "," + quote(e.listfile) + "," + numbers
+                     + quote(e.modules) + (e.calibrated ? ",1," : ",0,")
+                     + std::to_string(e.converted) + "\n";
+
+    int fd = open(filename.Data(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+    if (fd<0){
+        cerr << "Error opening catalog " << filename.Data() << ": " << std::strerror(errno) << endl;
+        return 1;
+    }
+
+    //the lock keeps the header to the first writer and lines from
+    //interleaving on file systems where O_APPEND alone does not
+    int ret = 0;
+    flock(fd, LOCK_EX);
+    struct stat st;
+    if ((fstat(fd, &st)==0)&&(st.st_size==0))
+        line = CatalogHeader + line;
+    ssize_t n = write(fd, line.data(), line.size());
+    if (n!=(ssize_t)line.size()){
+        cerr << "Error writing catalog " << filename.Data() << ": "
+             << ((n<0) ? std::strerror(errno) : "short write") << endl;
+        ret = 1;
+    }
+    flock(fd, LOCK_UN);
+    if (close(fd)!=0)
+        ret = 1;
+    return ret;
+}
+
+int runcatalog::query(TString expr)
+{
+    //values of the current line, bound to the selection by address
+    int part = 0;
+    uint32_t start = 0, stop = 0, converted = 0;
+    int seconds = 0;
+    double events = 0, kept = 0, lost = 0;
+    bool calibrated = 0;
+    bool present[NumCatalogModules] = {0};
+
+    eventselector select;
+    if (select.parse(expr))
+        return -1;
+    select.addVariable("part", &part);
+    select.addVariable("start", &start);
+    select.addVariable("stop", &stop);
+    select.addVariable("seconds", &seconds);
+    select.addVariable("events", &events);
+    select.addVariable("kept", &kept);
+    select.addVariable("lost", &lost);
+    select.addVariable("calibrated", &calibrated);
+    select.addVariable("converted", &converted);
+    for (int i=0; i<NumCatalogModules; i++)
+        select.addVariable(CatalogModules[i], &present[i]);
+    if (select.bind())
+        return -1;
+
+    std::ifstream in(filename.Data());
+    if (!in.is_open()){
+        cerr << "Error opening catalog " << filename.Data() << " for reading" << endl;
+        return -1;
+    }
+
+    cout << CatalogHeader;
+    std::string line;
+    std::vector<std::string> fields;
+    long nruns = 0;
+    long nselected = 0;
+    long nbad = 0;
+    while (std::getline(in, line)){
+        if ((line.compare(0, 5, "file,")==0)||line.empty())
+            continue;
+        //a line still being appended has fewer fields
+        if ((!split(line, fields))||(fields.size()!=CatalogFields)){
+            nbad++;
+            continue;
+        }
+        nruns++;
+        part = atoi(fields[2].c_str());
+        start = strtoul(fields[4].c_str(), 0, 10);
+        stop = strtoul(fields[5].c_str(), 0, 10);
+        seconds = atoi(fields[6].c_str());
+        events = atof(fields[7].c_str());
+        kept = atof(fields[8].c_str());
+        lost = atof(fields[9].c_str());
+        calibrated = (fields[11]=="1");
+        converted = strtoul(fields[12].c_str(), 0, 10);
+        std::string modules = "|" + fields[10] + "|";
+        for (int i=0; i<NumCatalogModules; i++)
+            present[i] = (modules.find(std::string("|") + CatalogModules[i] + "|")!=std::string::npos);
+
+        if (select.evaluate()){
+            cout << line << "\n";
+            nselected++;
+        }
+    }
+    cout.flush();
+    cerr << nselected << " of " << nruns << " catalog entries selected";
+    if (nbad>0)
+        cerr << ", " << nbad << " incomplete lines skipped";
+    cerr << endl;
+    return nselected;
+}
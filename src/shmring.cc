@@ -0,0 +1,209 @@
+
+#include "shmring.hh"
+
+#include "TString.h"
+
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <signal.h>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+using std::cout;
+using std::cerr;
+using std::endl;
+
+static_assert(sizeof(shmheader)==80, "shmheader layout changed");
+static_assert(sizeof(shmrecord)%8==0, "shmrecord must stay 8 byte aligned");
+
+//pid of the converter still publishing to the segment, 0 if there is none
+//(no segment, not ours, finished, or its writer is gone)
+static uint32_t live_writer(const char *shmname)
+{
+    int fd = shm_open(shmname, O_RDONLY, 0);
+    if (fd<0)
+        return 0;
+    struct stat st;
+    void *mem = MAP_FAILED;
+    if ((fstat(fd, &st)==0)&&(st.st_size>=(off_t)sizeof(shmheader)))
+        mem = mmap(0, sizeof(shmheader), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mem==MAP_FAILED)
+        return 0;
+
+    const shmheader *old = (const shmheader *)mem;
+    uint32_t pid = 0;
+    if ((std::memcmp(old->magic, ShmMagic, sizeof(ShmMagic))==0)&&(old->state.load()==1))
+        pid = old->writer_pid;
+    munmap(mem, sizeof(shmheader));
+    if ((pid==0)||(pid==(uint32_t)getpid()))
+        return 0;
+    if ((kill(pid, 0)!=0)&&(errno==ESRCH))
+        return 0;
+    return pid;
+}
+
+shmring::shmring(TString name, uint32_t capacity)
+{
+    shmname = name;
+    if (!shmname.BeginsWith("/"))
+        shmname.Prepend("/");
+    header = 0;
+    slots = 0;
+    next = 0;
+    file = 0;
+
+    if ((capacity<1)||(capacity>ShmMaxSlots)){
+        cerr << "Shared memory " << shmname.Data() << ": " << capacity
+             << " slots is not 1 to " << ShmMaxSlots << endl;
+        return;
+    }
+
+    //round capacity up to a power of 2
+    uint32_t cap = 1;
+    while (cap<capacity) cap <<= 1;
+
+    size_t header_size = 4096;
+    mapsize = header_size + (size_t)cap*sizeof(shmrecord);
+
+    //another converter publishing under the name keeps it, unlinking would
+    //leave its consumers on a segment nobody writes to anymore
+    uint32_t pid = live_writer(shmname.Data());
+    if (pid){
+        cerr << "Shared memory " << shmname.Data() << " is in use by the converter with pid "
+             << pid << ", give another --shm name" << endl;
+        return;
+    }
+
+    //a new segment instead of truncating the old one, consumers that still
+    //have the old one mapped keep reading it instead of getting SIGBUS
+    shm_unlink(shmname.Data());
+    int fd = shm_open(shmname.Data(), O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd<0){
+        cerr << "Error creating shared memory " << shmname.Data() << ": "
+             << std::strerror(errno) << endl;
+        return;
+    }
+    if (ftruncate(fd, mapsize)!=0){
+        cerr << "Error sizing shared memory " << shmname.Data() << ": "
+             << std::strerror(errno) << endl;
+        close(fd);
+        return;
+    }
+    void *mem = mmap(0, mapsize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mem==MAP_FAILED){
+        cerr << "Error mapping shared memory " << shmname.Data() << ": "
+             << std::strerror(errno) << endl;
+        return;
+    }
+
+    //fresh shm pages are zero, only the header needs filling
+    header = (shmheader *)mem;
+    slots = (shmrecord *)((char *)mem + header_size);
+    header->version = ShmVersion;
+    header->header_size = header_size;
+    header->record_size = sizeof(shmrecord);
+    header->capacity = cap;
+    header->writer_pid = getpid();
+    header->state.store(1);
+    header->write_index.store(0);
+    header->file_index.store(0);
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(header->magic, ShmMagic, sizeof(ShmMagic));
+
+    cout << "Publishing events to shared memory " << shmname.Data()
+         << " (" << cap << " slots of " << sizeof(shmrecord) << " bytes)" << endl;
+}
+
+shmring::~shmring()
+{
+    //the segment is left in place so consumers can finish reading,
+    //the next converter using the same name unlinks it and makes a new one
+    if (header){
+        header->state.store(2);
+        munmap(header, mapsize);
+    }
+}
+
+void shmring::setFile(uint32_t value)
+{
+    file = value;
+    header->file_index.store(value);
+}
+
+shmconsumer::shmconsumer(TString name)
+{
+    TString shmname = name;
+    if (!shmname.BeginsWith("/"))
+        shmname.Prepend("/");
+    header = 0;
+    slots = 0;
+    mapsize = 0;
+    readindex = 0;
+    nlost = 0;
+
+    int fd = shm_open(shmname.Data(), O_RDONLY, 0);
+    if (fd<0){
+        cerr << "Error opening shared memory " << shmname.Data() << ": "
+             << std::strerror(errno) << endl;
+        return;
+    }
+    struct stat st;
+    if (fstat(fd, &st)!=0 || st.st_size<(off_t)sizeof(shmheader)){
+        close(fd);
+        return;
+    }
+    void *mem = mmap(0, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mem==MAP_FAILED)
+        return;
+
+    const shmheader *h = (const shmheader *)mem;
+    if ((std::memcmp(h->magic, ShmMagic, sizeof(ShmMagic))!=0)
+        ||(h->version!=ShmVersion)||(h->record_size!=sizeof(shmrecord))){
+        cerr << "Shared memory " << shmname.Data() << " has an unknown layout" << endl;
+        munmap(mem, st.st_size);
+        return;
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    mapsize = st.st_size;
+    header = h;
+    slots = (const shmrecord *)((const char *)mem + h->header_size);
+    //start with the newest record
+    readindex = h->write_index.load(std::memory_order_acquire);
+}
+
+shmconsumer::~shmconsumer()
+{
+    if (header)
+        munmap((void *)header, mapsize);
+}
+
+const shmrecord *shmconsumer::next()
+{
+    uint64_t written = header->write_index.load(std::memory_order_acquire);
+    while (readindex<written){
+        //skip what the writer has already overwritten
+        if (written-readindex>header->capacity){
+            nlost += written-readindex-header->capacity;
+            readindex = written-header->capacity;
+        }
+        const shmrecord *rec = slots + (readindex & (header->capacity-1));
+        uint64_t seq = rec->seq.load(std::memory_order_acquire);
+        readindex++;
+        if (seq==2*readindex)
+            return rec;
+        nlost++;
+    }
+    return 0;
+}
+
+bool shmconsumer::valid(const shmrecord *rec) const
+{
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return rec->seq.load(std::memory_order_relaxed)==2*readindex;
+}
@@ -0,0 +1,168 @@
+
+#include "spoolqueue.hh"
+
+#include "TString.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <string>
+#include <vector>
+using std::cout;
+using std::cerr;
+using std::endl;
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+spoolqueue::spoolqueue(TString dir)
+{
+    spooldir = dir;
+    if (!spooldir.EndsWith("/"))
+        spooldir += "/";
+    char host[256] = "localhost";
+    gethostname(host, sizeof(host)-1);
+    worker = Form("%s.%i", host, (int)getpid());
+    starttime = 0;
+    njobs = 0;
+}
+
+spoolqueue::~spoolqueue()
+{
+
+}
+
+int spoolqueue::init()
+{
+    const char *subdirs[] = {"", "pending", "claimed", "done", "failed", "tmp"};
+    for (int i=0; i<6; i++){
+        TString path = spooldir + subdirs[i];
+        if ((mkdir(path.Data(), 0775)!=0)&&(errno!=EEXIST)){
+            cerr << "Error creating " << path.Data() << ": " << std::strerror(errno) << endl;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int spoolqueue::enqueue(TString listfile)
+{
+    char *path = realpath(listfile.Data(), 0);
+    if (!path){
+        cerr << "Error queueing " << listfile.Data() << ": " << std::strerror(errno) << endl;
+        return 1;
+    }
+
+    //write the job under a private name, then link it into pending/ so
+    //workers never see a partial job and existing jobs are not replaced
+    TString tmp = spooldir + Form("tmp/%s.%i", worker.Data(), njobs++);
+    {
+        std::ofstream out(tmp.Data());
+        out << path << endl;
+        if (!out.good()){
+            cerr << "Error writing " << tmp.Data() << endl;
+            free(path);
+            return 1;
+        }
+    }
+
+    TString base = path;
+    base.Remove(0, base.Last('/')+1);
+    free(path);
+    int ret = 1;
+    for (int n=0; n<1000; n++){
+        TString job = spooldir + "pending/" + base;
+        if (n>0)
+            job += Form(".%i", n);
+        if (link(tmp.Data(), job.Data())==0){
+            cout << "Queued " << job.Data() << endl;
+            ret = 0;
+            break;
+        }
+        if (errno!=EEXIST){
+            cerr << "Error queueing " << job.Data() << ": " << std::strerror(errno) << endl;
+            break;
+        }
+    }
+    unlink(tmp.Data());
+    return ret;
+}
+
+bool spoolqueue::claim(TString &listfile)
+{
+    TString pending = spooldir + "pending/";
+    while (1){
+        DIR *dir = opendir(pending.Data());
+        if (!dir){
+            cerr << "Error reading " << pending.Data() << ": " << std::strerror(errno) << endl;
+            return 0;
+        }
+        std::vector<std::string> names;
+        while (struct dirent *ent = readdir(dir)){
+            if (ent->d_name[0]!='.')
+                names.push_back(ent->d_name);
+        }
+        closedir(dir);
+        if (names.empty())
+            return 0;
+        std::sort(names.begin(), names.end());
+
+        //whoever renames a job first owns it, the others move on
+        bool raced = 0;
+        for (size_t i=0; i<names.size(); i++){
+            TString from = pending + names[i].c_str();
+            TString to = spooldir + "claimed/" + names[i].c_str() + "@" + worker;
+            if (rename(from.Data(), to.Data())!=0){
+                if (errno==ENOENT)
+                    raced = 1;
+                else
+                    cerr << "Error claiming " << from.Data() << ": " << std::strerror(errno) << endl;
+                continue;
+            }
+
+            std::ifstream in(to.Data());
+            std::string line;
+            std::getline(in, line);
+            claimed = names[i].c_str();
+            starttime = now();
+            listfile = line.c_str();
+            return 1;
+        }
+        //all taken while we looked, check again for new ones
+        if (!raced)
+            return 0;
+    }
+}
+
+void spoolqueue::finish(bool ok)
+{
+    if (claimed.IsNull())
+        return;
+    TString from = spooldir + "claimed/" + claimed + "@" + worker;
+    TString to = spooldir + (ok ? "done/" : "failed/") + claimed;
+
+    std::ofstream out(from.Data(), std::ios::app);
+    time_t t = time(0);
+    char date[64];
+    strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", localtime(&t));
+    out << (ok ? "done" : "failed") << " by " << worker.Data() << " at " << date
+        << " after " << Form("%.1f", now()-starttime) << " s" << endl;
+    out.close();
+
+    if (rename(from.Data(), to.Data())!=0)
+        cerr << "Error moving " << from.Data() << " to " << to.Data() << ": "
+             << std::strerror(errno) << endl;
+    claimed = "";
+}
@@ -0,0 +1,401 @@
+
+#include "textdump.hh"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <iostream>
+using std::cout;
+using std::cerr;
+using std::endl;
+
+//what is kept of a module's shmrecord
+struct dumpvalues
+{
+    uint32_t num_chn;
+    int32_t time_stamp;
+    int32_t extendedtime;
+    uint32_t pileupmask;
+    uint32_t overflowmask;
+    int32_t Trigger[ShmMaxTrigger];
+    double seconds;
+    int32_t ADC[ShmMaxChn];
+    int32_t ADC_short[ShmMaxChn];
+    int32_t TDC[ShmMaxChn];
+};
+
+static const size_t ValueWords = (sizeof(dumpvalues)+3)/4;
+
+//number formatting without locale or stdio
+static void putUInt(std::string &out, uint64_t v)
+{
+    char buf[20];
+    int n = 0;
+    do{
+        buf[n++] = '0' + v%10;
+        v /= 10;
+    } while (v);
+    while (n)
+        out += buf[--n];
+}
+
+static void putInt(std::string &out, int64_t v)
+{
+    if (v<0){
+        out += '-';
+        putUInt(out, -(uint64_t)v);
+    }
+    else{
+        putUInt(out, v);
+    }
+}
+
+static void putHex(std::string &out, uint32_t v)
+{
+    static const char digits[] = "0123456789abcdef";
+    out += "\"0x";
+    for (int shift=28; shift>=0; shift-=4)
+        out += digits[(v >> shift) & 15];
+    out += '"';
+}
+
+static void putSeconds(std::string &out, double s)
+{
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.9f", s);
+    out += buf;
+}
+
+textdump::textdump(TString filename_, int format, int nthreads)
+{
+    filename = filename_;
+    layout = format;
+    failed = 0;
+    nevents = 0;
+    eventstart = 0;
+    inEvent = 0;
+    nextseq = 0;
+    nextwrite = 0;
+    finishing = 0;
+
+    fd = open(filename.Data(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd<0)
+        throw std::runtime_error(std::string("Error opening ") + filename.Data()
+                                 + " for writing: " + std::strerror(errno));
+    if (layout==CSV)
+        writeText("event,type,tick,module,chn,ADC,ADC_short,TDC,pileup,overflow,"
+                  "time_stamp,extendedtime,seconds\n");
+
+    //two chunks per thread so the decoder never waits for a formatted one
+    //to be written
+    if (nthreads<1)
+        nthreads = 1;
+    chunks.resize(2*nthreads+1);
+    for (size_t i=0; i<chunks.size(); i++){
+        chunks[i].raw.reserve(ChunkWords+64*1024);
+        chunks[i].seq = 0;
+        chunks[i].state = Free;
+    }
+    cur = &chunks[0];
+    cur->state = Filling;
+    for (int i=0; i<nthreads; i++)
+        workers.push_back(std::thread(&textdump::worker, this));
+}
+
+textdump::~textdump()
+{
+    finish();
+}
+
+int textdump::addModule(const char *label, bool qdc)
+{
+    moduleinfo m;
+    m.label = label;
+    m.qdc = qdc;
+    modules.push_back(m);
+    return modules.size()-1;
+}
+
+void textdump::beginEvent(int event, int tick)
+{
+    if (inEvent)
+        cur->raw.resize(eventstart);
+    inEvent = 1;
+    eventstart = cur->raw.size();
+    uint32_t header[HeaderWords] = {(uint32_t)event, (uint32_t)tick, 0, 0, 0};
+    put(header, HeaderWords);
+}
+
+void textdump::subEvent(u32 moduleType, const u32 *data, u32 nwords)
+{
+    uint32_t rec[3] = {RecSubevent, moduleType, nwords};
+    put(rec, 3);
+    put(data, nwords);
+}
+
+void textdump::module(int index, const shmrecord *rec)
+{
+    dumpvalues v;
+    v.num_chn = rec->num_chn;
+    v.time_stamp = rec->time_stamp;
+    v.extendedtime = rec->extendedtime;
+    v.pileupmask = rec->pileupmask;
+    v.overflowmask = rec->overflowmask;
+    std::memcpy(v.Trigger, rec->Trigger, sizeof(v.Trigger));
+    v.seconds = rec->seconds;
+    std::memcpy(v.ADC, rec->ADC, sizeof(v.ADC));
+    std::memcpy(v.ADC_short, rec->ADC_short, sizeof(v.ADC_short));
+    std::memcpy(v.TDC, rec->TDC, sizeof(v.TDC));
+
+    uint32_t words[2+ValueWords] = {RecModule, (uint32_t)index};
+    std::memcpy(&words[2], &v, sizeof(v));
+    put(words, 2+ValueWords);
+}
+
+void textdump::endEvent(u32 eventType, bool complete)
+{
+    uint32_t *header = &cur->raw[eventstart];
+    header[2] = eventType;
+    header[3] = complete;
+    header[4] = cur->raw.size()-eventstart;
+    inEvent = 0;
+    nevents++;
+    if (cur->raw.size()>=ChunkWords)
+        submit();
+}
+
+void textdump::submit()
+{
+    std::unique_lock<std::mutex> lock(mtx);
+    cur->seq = nextseq++;
+    cur->state = Queued;
+    cv.notify_all();
+
+    chunk *next = 0;
+    while (!next){
+        for (size_t i=0; (i<chunks.size())&&(!next); i++){
+            if (chunks[i].state==Free)
+                next = &chunks[i];
+        }
+        if (!next)
+            cv.wait(lock);
+    }
+    next->state = Filling;
+    next->raw.clear();
+    cur = next;
+}
+
+void textdump::worker()
+{
+    std::unique_lock<std::mutex> lock(mtx);
+    while (1){
+        //the oldest queued chunk, so the one written next is never waiting
+        //behind the others
+        chunk *c = 0;
+        while (1){
+            for (size_t i=0; i<chunks.size(); i++){
+                if ((chunks[i].state==Queued)&&((!c)||(chunks[i].seq<c->seq)))
+                    c = &chunks[i];
+            }
+            if (c || finishing)
+                break;
+            cv.wait(lock);
+        }
+        if (!c)
+            return;
+        c->state = Formatting;
+        lock.unlock();
+
+        c->text.clear();
+        format(c->raw, c->text);
+
+        //written in the order the chunks were queued
+        lock.lock();
+        c->state = Formatted;
+        while (nextwrite!=c->seq)
+            cv.wait(lock);
+        lock.unlock();
+        writeText(c->text);
+        lock.lock();
+        nextwrite++;
+        c->state = Free;
+        cv.notify_all();
+    }
+}
+
+void textdump::finish()
+{
+    if (workers.empty())
+        return;
+    {
+        //an event that was not ended is left out
+        std::lock_guard<std::mutex> lock(mtx);
+        if (inEvent)
+            cur->raw.resize(eventstart);
+        if (!cur->raw.empty()){
+            cur->seq = nextseq++;
+            cur->state = Queued;
+        }
+        finishing = 1;
+    }
+    cv.notify_all();
+    for (size_t i=0; i<workers.size(); i++)
+        workers[i].join();
+    workers.clear();
+    if (close(fd)!=0 && !failed)
+        cerr << "Error writing " << filename.Data() << ": " << std::strerror(errno) << endl;
+    fd = -1;
+}
+
+void textdump::writeText(const std::string &text)
+{
+    size_t done = 0;
+    while ((!failed)&&(done<text.size())){
+        ssize_t n = write(fd, text.data()+done, text.size()-done);
+        if (n<0){
+            if (errno==EINTR)
+                continue;
+            cerr << "Error writing " << filename.Data() << ": " << std::strerror(errno) << endl;
+            failed = 1;
+            break;
+        }
+        done += n;
+    }
+}
+
+void textdump::format(const std::vector<uint32_t> &raw, std::string &out) const
+{
+    out.reserve(raw.size()*(layout==JSON ? 14 : 8));
+    size_t pos = 0;
+    while (pos<raw.size()){
+        const uint32_t *ev = &raw[pos];
+        if (layout==CSV)
+            formatCSV(ev, out);
+        else
+            formatJSON(ev, out);
+        pos += ev[4];
+    }
+}
+
+void textdump::formatCSV(const uint32_t *ev, std::string &out) const
+{
+    //a row per channel with a value
+    const uint32_t *end = ev+ev[4];
+    for (const uint32_t *p=ev+HeaderWords; p<end; ){
+        if (p[0]==RecSubevent){
+            p += 3+p[2];
+            continue;
+        }
+        const moduleinfo &m = modules[p[1]];
+        dumpvalues v;
+        std::memcpy(&v, p+2, sizeof(v));
+        p += 2+ValueWords;
+        for (uint32_t chn=0; chn<v.num_chn; chn++){
+            if ((v.ADC[chn]==0)&&(v.ADC_short[chn]==0)&&(v.TDC[chn]==0))
+                continue;
+            putUInt(out, ev[0]);
+            out += ',';
+            putUInt(out, ev[2]);
+            out += ',';
+            putUInt(out, ev[1]);
+            out += ',';
+            out += m.label;
+            out += ',';
+            putUInt(out, chn);
+            out += ',';
+            putInt(out, v.ADC[chn]);
+            out += ',';
+            if (m.qdc)
+                putInt(out, v.ADC_short[chn]);
+            out += ',';
+            putInt(out, v.TDC[chn]);
+            out += ',';
+            out += (char)('0' + ((v.pileupmask >> chn) & 1));
+            out += ',';
+            out += (char)('0' + ((v.overflowmask >> chn) & 1));
+            out += ',';
+            putInt(out, v.time_stamp);
+            out += ',';
+            putInt(out, v.extendedtime);
+            out += ',';
+            putSeconds(out, v.seconds);
+            out += '\n';
+        }
+    }
+}
+
+void textdump::formatJSON(const uint32_t *ev, std::string &out) const
+{
+    //one object per line
+    out += "{\"event\":";
+    putUInt(out, ev[0]);
+    out += ",\"type\":";
+    putUInt(out, ev[2]);
+    out += ",\"tick\":";
+    putUInt(out, ev[1]);
+    out += ev[3] ? ",\"complete\":true,\"subevents\":[" : ",\"complete\":false,\"subevents\":[";
+
+    const uint32_t *end = ev+ev[4];
+    const uint32_t *p = ev+HeaderWords;
+    for (bool first=1; (p<end)&&(p[0]==RecSubevent); first=0){
+        if (!first)
+            out += ',';
+        out += "{\"module\":\"";
+        out += listfile::get_vme_module_name((listfile::VMEModuleType)p[1]);
+        out += "\",\"words\":[";
+        for (uint32_t i=0; i<p[2]; i++){
+            if (i)
+                out += ',';
+            putHex(out, p[3+i]);
+        }
+        out += "]}";
+        p += 3+p[2];
+    }
+    out += ']';
+
+    for (; p<end; p+=2+ValueWords){
+        const moduleinfo &m = modules[p[1]];
+        dumpvalues v;
+        std::memcpy(&v, p+2, sizeof(v));
+        out += ",\"";
+        out += m.label;
+        out += "\":{\"time_stamp\":";
+        putInt(out, v.time_stamp);
+        out += ",\"extendedtime\":";
+        putInt(out, v.extendedtime);
+        out += ",\"seconds\":";
+        putSeconds(out, v.seconds);
+        out += ",\"Trigger\":[";
+        for (int i=0; i<ShmMaxTrigger; i++){
+            if (i)
+                out += ',';
+            putInt(out, v.Trigger[i]);
+        }
+        out += "],\"hits\":[";
+        bool first = 1;
+        for (uint32_t chn=0; chn<v.num_chn; chn++){
+            if ((v.ADC[chn]==0)&&(v.ADC_short[chn]==0)&&(v.TDC[chn]==0))
+                continue;
+            if (!first)
+                out += ',';
+            first = 0;
+            out += "{\"chn\":";
+            putUInt(out, chn);
+            out += ",\"ADC\":";
+            putInt(out, v.ADC[chn]);
+            if (m.qdc){
+                out += ",\"ADC_short\":";
+                putInt(out, v.ADC_short[chn]);
+            }
+            out += ",\"TDC\":";
+            putInt(out, v.TDC[chn]);
+            out += ((v.pileupmask >> chn) & 1) ? ",\"pileup\":true" : ",\"pileup\":false";
+            out += ((v.overflowmask >> chn) & 1) ? ",\"overflow\":true}" : ",\"overflow\":false}";
+        }
+        out += "]}";
+    }
+    out += "}\n";
+}
@@ -0,0 +1,84 @@
+
+#include "tickseries.hh"
+
+#include "TH1I.h"
+#include "TH2I.h"
+
+#include <iostream>
+using std::cerr;
+using std::endl;
+
+tickseries::tickseries(uint32_t maxseconds_)
+{
+    maxseconds = maxseconds_;
+    ticks = 0;
+    first = 0;
+}
+
+tickseries::~tickseries()
+{
+    for (size_t i=0; i<modules.size(); i++)
+        delete modules[i].counts;
+}
+
+int tickseries::addModule(TString label, int nchn)
+{
+    module m;
+    m.label = label;
+    m.counts = new matrix2d(64, 0, nchn, 0, 1, maxseconds);
+    m.used = 0;
+    modules.push_back(m);
+    return modules.size()-1;
+}
+
+void tickseries::nextFile()
+{
+    //the closed part wrote the series up to now
+    first = ticks;
+    events.clear();
+    nlost.clear();
+    nkept.clear();
+    for (size_t i=0; i<modules.size(); i++){
+        modules[i].counts->reset();
+        modules[i].used = 0;
+    }
+}
+
+void tickseries::writeSeries(const std::vector<uint32_t> &series, const char *name, const char *title)
+{
+    //one bin per second up to the current one, axis in seconds since start
+    //of run
+    int nbins = ticks-first+1;
+    TH1I h(name, title, nbins, first, first+nbins);
+    h.SetDirectory(0);
+    double entries = 0;
+    for (int i=0; (i<nbins)&&(i<(int)series.size()); i++){
+        if (series[i]){
+            h.SetBinContent(i+1, series[i]);
+            entries += series[i];
+        }
+    }
+    h.SetEntries(entries);
+    h.Write();
+}
+
+void tickseries::write()
+{
+    writeSeries(events, "hEvents", "Events per second;seconds since start of run;events");
+    writeSeries(nlost, "hLost", "Events with lost data per second;seconds since start of run;events");
+    writeSeries(nkept, "hKept", "Events written per second;seconds since start of run;events");
+
+    for (size_t i=0; i<modules.size(); i++){
+        if (!modules[i].used)
+            continue;
+        const char *label = modules[i].label.Data();
+        TH2I *h = modules[i].counts->makeHist(Form("hHits_%s", label),
+                      Form("%s hits per second;seconds since start of run;channel", label));
+        h->GetXaxis()->Set(h->GetNbinsX(), first, first+h->GetNbinsX());
+        h->Write();
+        delete h;
+        if (modules[i].counts->outside())
+            cerr << "Warning: hHits_" << label << ": " << modules[i].counts->outside()
+                 << " hits past --max-run-seconds left out" << endl;
+    }
+}
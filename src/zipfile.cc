@@ -0,0 +1,266 @@
+
+#include "zipfile.hh"
+
+#include "TString.h"
+
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+using std::cout;
+using std::cerr;
+using std::endl;
+
+//little endian field access
+static inline uint16_t get16(const unsigned char *p){ return p[0] | (p[1]<<8); }
+static inline uint32_t get32(const unsigned char *p){ return get16(p) | ((uint32_t)get16(p+2)<<16); }
+static inline uint64_t get64(const unsigned char *p){ return get32(p) | ((uint64_t)get32(p+4)<<32); }
+
+static const uint32_t LocalHeaderSig    = 0x04034b50;
+static const uint32_t CentralHeaderSig  = 0x02014b50;
+static const uint32_t EndRecordSig      = 0x06054b50;
+static const uint32_t Zip64LocatorSig   = 0x07064b50;
+static const uint32_t Zip64EndRecordSig = 0x06064b50;
+
+static const size_t ChunkSize = 1024*1024;
+
+zipfile::zipfile(TString name)
+{
+    filename = name;
+    filesize = 0;
+    fd = open(filename.Data(), O_RDONLY | O_CLOEXEC);
+    if (fd<0)
+        return;
+    struct stat st;
+    if (fstat(fd, &st)==0)
+        filesize = st.st_size;
+}
+
+zipfile::~zipfile()
+{
+    if (fd>=0)
+        close(fd);
+}
+
+bool zipfile::readAt(uint64_t offset, void *dest, size_t nbytes)
+{
+    size_t done = 0;
+    while (done<nbytes){
+        ssize_t n = pread(fd, (char *)dest+done, nbytes-done, offset+done);
+        if (n<0 && errno==EINTR) continue;
+        if (n<=0) return 0;
+        done += n;
+    }
+    return 1;
+}
+
+int zipfile::readDirectory()
+{
+    //find the end of central directory record, it is followed by at most
+    //a 64k comment
+    size_t tail = (filesize<65536+22) ? filesize : 65536+22;
+    std::vector<unsigned char> buf(tail);
+    if ((tail<22)||(!readAt(filesize-tail, &buf[0], tail))){
+        cerr << filename.Data() << " is not a zip file" << endl;
+        return 1;
+    }
+    long eocd = -1;
+    for (long i=tail-22; i>=0; i--){
+        if (get32(&buf[i])==EndRecordSig){
+            eocd = i;
+            break;
+        }
+    }
+    if (eocd<0){
+        cerr << filename.Data() << " is not a zip file" << endl;
+        return 1;
+    }
+
+    uint64_t nentries = get16(&buf[eocd+10]);
+    uint64_t cdsize = get32(&buf[eocd+12]);
+    uint64_t cdoffset = get32(&buf[eocd+16]);
+
+    //zip64: the real values are in the zip64 end record
+    if ((nentries==0xffff)||(cdsize==0xffffffff)||(cdoffset==0xffffffff)){
+        unsigned char loc[20], rec[56];
+        uint64_t locpos = filesize-tail+eocd-20;
+        if ((eocd+filesize-tail<20)||(!readAt(locpos, loc, 20))||(get32(loc)!=Zip64LocatorSig)
+            ||(!readAt(get64(loc+8), rec, 56))||(get32(rec)!=Zip64EndRecordSig)){
+            cerr << "Broken zip64 directory in " << filename.Data() << endl;
+            return 1;
+        }
+        nentries = get64(rec+32);
+        cdsize = get64(rec+40);
+        cdoffset = get64(rec+48);
+    }
+
+    std::vector<unsigned char> cd(cdsize);
+    if ((cdsize>0)&&(!readAt(cdoffset, &cd[0], cdsize))){
+        cerr << "Error reading zip directory of " << filename.Data() << endl;
+        return 1;
+    }
+
+    entries.clear();
+    uint64_t pos = 0;
+    for (uint64_t n=0; n<nentries; n++){
+        if ((pos+46>cdsize)||(get32(&cd[pos])!=CentralHeaderSig)){
+            cerr << "Broken zip directory in " << filename.Data() << endl;
+            return 1;
+        }
+        const unsigned char *h = &cd[pos];
+        entry e;
+        e.method = get16(h+10);
+        e.crc = get32(h+16);
+        e.csize = get32(h+20);
+        e.usize = get32(h+24);
+        uint16_t namelen = get16(h+28);
+        uint16_t extralen = get16(h+30);
+        uint16_t commentlen = get16(h+32);
+        e.offset = get32(h+42);
+        if (pos+46+namelen+extralen>cdsize){
+            cerr << "Broken zip directory in " << filename.Data() << endl;
+            return 1;
+        }
+        e.name.assign((const char *)h+46, namelen);
+
+        //zip64 extended information, only the saturated fields are present
+        const unsigned char *x = h+46+namelen;
+        const unsigned char *xend = x+extralen;
+        while (x+4<=xend){
+            uint16_t id = get16(x);
+            uint16_t len = get16(x+2);
+            const unsigned char *f = x+4;
+            if (id==0x0001){
+                if ((e.usize==0xffffffff)&&(f+8<=x+4+len)){ e.usize = get64(f); f += 8; }
+                if ((e.csize==0xffffffff)&&(f+8<=x+4+len)){ e.csize = get64(f); f += 8; }
+                if ((e.offset==0xffffffff)&&(f+8<=x+4+len)){ e.offset = get64(f); f += 8; }
+            }
+            x += 4+len;
+        }
+
+        entries.push_back(e);
+        pos += 46+namelen+extralen+commentlen;
+    }
+    return 0;
+}
+
+int zipfile::extractAll(TString dir)
+{
+    if (entries.empty() && readDirectory())
+        return 1;
+
+    for (size_t i=0; i<entries.size(); i++){
+        const entry &e = entries[i];
+
+        //directories are created as needed below
+        if (e.name.empty() || e.name[e.name.size()-1]=='/')
+            continue;
+        if ((e.name[0]=='/')||(e.name.find("..")!=std::string::npos)){
+            cerr << "Skipping unsafe path " << e.name << " in " << filename.Data() << endl;
+            continue;
+        }
+
+        TString path = dir + e.name.c_str();
+        for (int p=dir.Length(); p<path.Length(); p++){
+            if (path[p]=='/')
+                mkdir(TString(path(0, p)).Data(), 0755);
+        }
+        cout << "  inflating: " << path.Data() << endl;
+        if (extract(e, path))
+            return 1;
+    }
+    return 0;
+}
+
+int zipfile::extract(const entry &e, TString path)
+{
+    unsigned char lh[30];
+    if ((!readAt(e.offset, lh, 30))||(get32(lh)!=LocalHeaderSig)){
+        cerr << "Broken entry " << e.name << " in " << filename.Data() << endl;
+        return 1;
+    }
+    uint64_t dataoffset = e.offset+30+get16(lh+26)+get16(lh+28);
+
+    if ((e.method!=0)&&(e.method!=8)){
+        cerr << "Unsupported compression method " << e.method << " for "
+             << e.name << " in " << filename.Data() << endl;
+        return 1;
+    }
+
+    int out = open(path.Data(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (out<0){
+        cerr << "Error opening " << path.Data() << " for writing: "
+             << std::strerror(errno) << endl;
+        return 1;
+    }
+
+    std::vector<unsigned char> in(ChunkSize), outbuf(ChunkSize);
+    uLong crc = crc32(0L, Z_NULL, 0);
+    uint64_t written = 0;
+    uint64_t consumed = 0;
+    int ret = 0;
+
+    z_stream zs;
+    std::memset(&zs, 0, sizeof(zs));
+    if ((e.method==8)&&(inflateInit2(&zs, -MAX_WBITS)!=Z_OK)){
+        close(out);
+        return 1;
+    }
+
+    bool done = 0;
+    while (!done && ret==0){
+        size_t n = (e.csize-consumed<ChunkSize) ? e.csize-consumed : ChunkSize;
+        if ((n>0)&&(!readAt(dataoffset+consumed, &in[0], n))){
+            cerr << "Error reading " << e.name << " from " << filename.Data() << endl;
+            ret = 1;
+            break;
+        }
+        consumed += n;
+
+        if (e.method==0){
+            crc = crc32(crc, &in[0], n);
+            if (write(out, &in[0], n)!=(ssize_t)n) ret = 1;
+            written += n;
+            done = (consumed==e.csize);
+            continue;
+        }
+
+        zs.next_in = &in[0];
+        zs.avail_in = n;
+        do{
+            zs.next_out = &outbuf[0];
+            zs.avail_out = ChunkSize;
+            int zret = inflate(&zs, Z_NO_FLUSH);
+            if (zret==Z_BUF_ERROR)  //no progress, needs more input
+                zret = Z_OK;
+            if ((zret!=Z_OK)&&(zret!=Z_STREAM_END)){
+                cerr << "Error inflating " << e.name << " from " << filename.Data() << endl;
+                ret = 1;
+                break;
+            }
+            size_t have = ChunkSize-zs.avail_out;
+            crc = crc32(crc, &outbuf[0], have);
+            if (write(out, &outbuf[0], have)!=(ssize_t)have) ret = 1;
+            written += have;
+            if (zret==Z_STREAM_END) done = 1;
+        }while ((ret==0)&&(!done)&&(zs.avail_out==0));
+
+        if ((ret==0)&&(!done)&&(consumed==e.csize)){
+            cerr << "Truncated entry " << e.name << " in " << filename.Data() << endl;
+            ret = 1;
+        }
+    }
+    if (e.method==8)
+        inflateEnd(&zs);
+    if (close(out)!=0) ret = 1;
+
+    if ((ret==0)&&((written!=e.usize)||((uint32_t)crc!=e.crc))){
+        cerr << "CRC or size mismatch for " << e.name << " in " << filename.Data() << endl;
+        ret = 1;
+    }
+    return ret;
+}